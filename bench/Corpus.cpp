@@ -0,0 +1,291 @@
+#include "Corpus.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <XNB.hpp>
+#include <Xbox360.hpp>
+
+namespace {
+
+// splitmix64; the standard library's distributions are not specified to be the same everywhere
+class Random
+{
+	public:
+		explicit Random(const uint64_t seed)
+		:
+			state(seed)
+		{
+		}
+
+		uint64_t next()
+		{
+			uint64_t z = (this->state += 0x9E3779B97F4A7C15);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+			return z ^ (z >> 31);
+		}
+
+	private:
+		uint64_t state;
+};
+
+class BodyWriter
+{
+	public:
+		void UInt8(const uint_fast32_t v)
+		{
+			this->data.push_back(static_cast<uint8_t>(v));
+		}
+
+		void UInt16(const uint_fast32_t v)
+		{
+			for(uint_fast32_t i = 0; i < 2; ++i)
+			{
+				this->UInt8((v >> (8 * (this->big_endian ? 1 - i : i))) & 0xFF);
+			}
+		}
+
+		void UInt32(const uint_fast64_t v)
+		{
+			for(uint_fast32_t i = 0; i < 4; ++i)
+			{
+				this->UInt8((v >> (8 * (this->big_endian ? 3 - i : i))) & 0xFF);
+			}
+		}
+
+		void Int7Bit(uint_fast64_t v)
+		{
+			while(v >= 0x80)
+			{
+				this->UInt8((v & 0x7F) | 0x80);
+				v >>= 7;
+			}
+			this->UInt8(static_cast<uint_fast32_t>(v));
+		}
+
+		void StringMS(const std::string& s)
+		{
+			this->Int7Bit(s.size());
+			this->data.insert(this->data.end(), s.begin(), s.end());
+		}
+
+		void Bytes(const std::vector<uint8_t>& bytes)
+		{
+			this->data.insert(this->data.end(), bytes.begin(), bytes.end());
+		}
+
+		// one type reader, no shared resources, then the primary object's type id
+		void Header(const std::string& type_reader)
+		{
+			this->Int7Bit(1);
+			this->StringMS(type_reader + ", Microsoft.Xna.Framework.Graphics, Version=4.0.0.0, Culture=neutral, PublicKeyToken=842cf8be1d2d2c3e");
+			this->UInt32(0);
+			this->Int7Bit(0);
+			this->Int7Bit(1);
+		}
+
+		std::vector<uint8_t> data;
+		bool big_endian = false; // as Xbox 360 content
+};
+
+uint8_t clamp_byte(const double v)
+{
+	return static_cast<uint8_t>(std::min(255.0, std::max(0.0, v)));
+}
+
+std::vector<uint8_t> make_texels(const TextureKind kind, const uint32_t width, const uint32_t height, Random& random)
+{
+	std::vector<uint8_t> texels(static_cast<std::size_t>(width) * height * 4);
+	for(uint32_t y = 0; y < height; ++y)
+	{
+		for(uint32_t x = 0; x < width; ++x)
+		{
+			uint8_t* p = &texels[(static_cast<std::size_t>(y) * width + x) * 4];
+			switch(kind)
+			{
+				case TextureKind::flat:
+				{
+					p[0] = 0x40;
+					p[1] = 0x80;
+					p[2] = 0xC0;
+					p[3] = 0xFF;
+					break;
+				}
+				case TextureKind::noisy:
+				{
+					const uint64_t r = random.next();
+					p[0] = static_cast<uint8_t>(r);
+					p[1] = static_cast<uint8_t>(r >> 8);
+					p[2] = static_cast<uint8_t>(r >> 16);
+					p[3] = static_cast<uint8_t>(r >> 24);
+					break;
+				}
+				case TextureKind::photographic:
+				{
+					const double u = static_cast<double>(x) / width;
+					const double v = static_cast<double>(y) / height;
+					const double grain = static_cast<double>(random.next() % 9) - 4;
+					p[0] = clamp_byte(128 + 100 * std::sin(6 * u + 2 * v) + grain);
+					p[1] = clamp_byte(128 + 90 * std::cos(4 * v - 3 * u * v) + grain);
+					p[2] = clamp_byte(255 * (1 - v) * (0.5 + 0.5 * u) + grain);
+					p[3] = 0xFF;
+					break;
+				}
+			}
+		}
+	}
+	return texels;
+}
+
+// 2x2 box filter
+std::vector<uint8_t> next_mip(const std::vector<uint8_t>& texels, const uint32_t width, const uint32_t height)
+{
+	const uint32_t w = std::max(width / 2, 1u);
+	const uint32_t h = std::max(height / 2, 1u);
+	std::vector<uint8_t> mip(static_cast<std::size_t>(w) * h * 4);
+	for(uint32_t y = 0; y < h; ++y)
+	{
+		for(uint32_t x = 0; x < w; ++x)
+		{
+			for(uint32_t c = 0; c < 4; ++c)
+			{
+				const uint32_t x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+				const uint32_t y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+				auto at = [&](const uint32_t tx, const uint32_t ty) -> uint32_t
+				{
+					return texels[(static_cast<std::size_t>(ty) * width + tx) * 4 + c];
+				};
+				mip[(static_cast<std::size_t>(y) * w + x) * 4 + c] = static_cast<uint8_t>((at(x0, y0) + at(x1, y0) + at(x0, y1) + at(x1, y1) + 2) / 4);
+			}
+		}
+	}
+	return mip;
+}
+
+const char* to_string(const TextureKind kind)
+{
+	switch(kind)
+	{
+		case TextureKind::flat:			return "flat";
+		case TextureKind::noisy:		return "noisy";
+		case TextureKind::photographic:	return "photographic";
+	}
+	return "?";
+}
+
+} // namespace
+
+std::vector<uint8_t> make_texture_body(const TextureKind kind, uint32_t width, uint32_t height, const uint64_t seed, const XNA::XNB::Platform platform)
+{
+	Random random(seed);
+	BodyWriter body;
+	body.big_endian = (platform == XNA::XNB::Platform::Xbox_360);
+	body.Header("Microsoft.Xna.Framework.Content.Texture2DReader");
+	uint32_t mip_count = 1;
+	while((width >> mip_count) != 0 || (height >> mip_count) != 0)
+	{
+		++mip_count;
+	}
+	body.UInt32(0); // RGBA8888
+	body.UInt32(width);
+	body.UInt32(height);
+	body.UInt32(mip_count);
+	std::vector<uint8_t> texels = make_texels(kind, width, height, random);
+	for(uint32_t i = 0; i < mip_count; ++i)
+	{
+		if(body.big_endian)
+		{
+			std::vector<uint8_t> swapped = texels;
+			XNA::Content::byte_swap(swapped.data(), swapped.size(), 4);
+			std::vector<uint8_t> tiled(XNA::Content::xbox360_tiled_size(width, height, 4));
+			XNA::Content::xbox360_tile(swapped.data(), tiled.data(), width, height, 4);
+			body.UInt32(tiled.size());
+			body.Bytes(tiled);
+		}
+		else
+		{
+			body.UInt32(texels.size());
+			body.Bytes(texels);
+		}
+		texels = next_mip(texels, width, height);
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+	return body.data;
+}
+
+std::vector<uint8_t> make_sound_body(const uint32_t frame_count, const uint64_t seed, const XNA::XNB::Platform platform)
+{
+	Random random(seed);
+	const uint32_t sample_rate = 44100;
+	BodyWriter body;
+	body.big_endian = (platform == XNA::XNB::Platform::Xbox_360);
+	body.Header("Microsoft.Xna.Framework.Content.SoundEffectReader");
+	body.UInt32(18);
+	body.UInt16(1); // PCM
+	body.UInt16(2);
+	body.UInt32(sample_rate);
+	body.UInt32(sample_rate * 4);
+	body.UInt16(4);
+	body.UInt16(16);
+	body.UInt16(0);
+	body.UInt32(static_cast<uint_fast64_t>(frame_count) * 4);
+	const double pi = 3.14159265358979323846;
+	for(uint32_t i = 0; i < frame_count; ++i)
+	{
+		const double t = static_cast<double>(i) / sample_rate;
+		const double tone = 0.3 * std::sin(2 * pi * 220 * t) + 0.2 * std::sin(2 * pi * 331 * t) + 0.1 * std::sin(2 * pi * 1047 * t);
+		for(uint_fast32_t channel = 0; channel < 2; ++channel)
+		{
+			const double noise = (static_cast<double>(random.next() % 2001) - 1000) / 1000 * 0.02;
+			const double v = (channel == 0 ? tone : 0.8 * tone) + noise;
+			body.UInt16(static_cast<uint16_t>(static_cast<int16_t>(std::lround(v * 32767))));
+		}
+	}
+	body.UInt32(0); // loop start
+	body.UInt32(frame_count); // loop length
+	body.UInt32(static_cast<uint_fast64_t>(frame_count) * 1000 / sample_rate);
+	return body.data;
+}
+
+std::vector<CorpusFile> make_corpus(const uint_fast32_t scale)
+{
+	struct CorpusBody
+	{
+		std::string name;
+		std::vector<uint8_t> body;
+		XNA::XNB::Platform platform;
+	};
+	const XNA::XNB::Platform windows = XNA::XNB::Platform::Microsoft_Windows;
+	const XNA::XNB::Platform xbox360 = XNA::XNB::Platform::Xbox_360;
+	std::vector<CorpusBody> bodies;
+	const uint32_t size = static_cast<uint32_t>(256 * scale);
+	for(const TextureKind kind : {TextureKind::flat, TextureKind::noisy, TextureKind::photographic})
+	{
+		bodies.push_back({std::string("texture_") + to_string(kind), make_texture_body(kind, size, size, 1 + static_cast<uint64_t>(kind), windows), windows});
+	}
+	bodies.push_back({"sound_pcm16", make_sound_body(static_cast<uint32_t>(44100 * scale), 7, windows), windows});
+	bodies.push_back({"texture_photographic_xbox360", make_texture_body(TextureKind::photographic, size, size, 1 + static_cast<uint64_t>(TextureKind::photographic), xbox360), xbox360});
+	bodies.push_back({"sound_pcm16_xbox360", make_sound_body(static_cast<uint32_t>(44100 * scale), 7, xbox360), xbox360});
+
+	std::vector<CorpusFile> corpus;
+	for(const CorpusBody& body : bodies)
+	{
+		for(const XNA::XNB::Compression compression : {XNA::XNB::Compression::none, XNA::XNB::Compression::lzx, XNA::XNB::Compression::lz4})
+		{
+			// LZ4 is MonoGame's, which has no Xbox 360
+			if(body.platform == xbox360 && compression == XNA::XNB::Compression::lz4)
+			{
+				continue;
+			}
+			CorpusFile file;
+			file.name = body.name + ((compression == XNA::XNB::Compression::lzx) ? "_lzx" : (compression == XNA::XNB::Compression::lz4) ? "_lz4" : "");
+			file.xnb = XNA::XNB::encode(body.body.data(), body.body.size(), body.platform, XNA::XNB::Profile::Reach, compression);
+			file.body_size = body.body.size();
+			file.compression = compression;
+			corpus.push_back(std::move(file));
+		}
+	}
+	return corpus;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <XNB.hpp>
+
+// deterministic synthetic XNBs: the same scale always produces the same bytes, on any machine
+
+enum class TextureKind
+{
+	flat,			// one color: the best case for LZX
+	noisy,			// uniform random texels: the worst case
+	photographic,	// smooth gradients with some grain
+};
+
+struct CorpusFile
+{
+	std::string name;
+	std::vector<uint8_t> xnb;
+	uint_fast64_t body_size; // decompressed
+	XNA::XNB::Compression compression;
+};
+
+// an RGBA8888 Texture2D with a full mip chain, as the body of an XNB; for Xbox 360, big-endian with tiled mips
+std::vector<uint8_t> make_texture_body(TextureKind kind, uint32_t width, uint32_t height, uint64_t seed, XNA::XNB::Platform platform = XNA::XNB::Platform::Microsoft_Windows);
+
+// 16-bit stereo 44100 Hz PCM: a few tones with some noise
+std::vector<uint8_t> make_sound_body(uint32_t frame_count, uint64_t seed, XNA::XNB::Platform platform = XNA::XNB::Platform::Microsoft_Windows);
+
+/*
+every texture kind and a sound, each uncompressed and compressed with LZX and LZ4, and the photographic texture and
+the sound as Xbox 360 content (uncompressed and LZX); scale 1 is 256x256 textures and 1 s of sound
+*/
+std::vector<CorpusFile> make_corpus(uint_fast32_t scale);
@@ -0,0 +1,478 @@
+#include <BinaryReader.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <AdpcmDecoder.hpp>
+#include <Export.hpp>
+#include <Lz4Decoder.hpp>
+#include <LzxDecoder.hpp>
+#include <XNB.hpp>
+#include <xna_exception.hpp>
+
+#include "Corpus.hpp"
+
+struct Options
+{
+	uint_fast32_t scale = 1;
+	uint_fast32_t reps = 5;
+	double min_rep_seconds = 0.1;
+	std::string corpus_dir;
+	std::string convertxnb;
+};
+
+struct Result
+{
+	double median; // seconds per iteration
+	double best;
+};
+
+/*
+runs f in repetitions of at least min_rep_seconds each and returns the median and best time per call;
+the median is what to compare between builds, the best shows how noisy the machine is
+*/
+Result measure(const std::function<void()>& f, const Options& options)
+{
+	using clock = std::chrono::steady_clock;
+	f(); // warm up caches and allocators
+	std::vector<double> times;
+	for(uint_fast32_t rep = 0; rep < options.reps; ++rep)
+	{
+		uint_fast64_t iterations = 0;
+		const clock::time_point start = clock::now();
+		double elapsed;
+		do
+		{
+			f();
+			++iterations;
+			elapsed = std::chrono::duration<double>(clock::now() - start).count();
+		}
+		while(elapsed < options.min_rep_seconds);
+		times.push_back(elapsed / static_cast<double>(iterations));
+	}
+	std::sort(times.begin(), times.end());
+	return {times[times.size() / 2], times.front()};
+}
+
+void print_header(const std::string& unit)
+{
+	std::printf("%-48s %12s %12s %12s\n", "benchmark", "bytes", ("median " + unit).c_str(), ("best " + unit).c_str());
+}
+
+void print_throughput(const std::string& name, const uint_fast64_t bytes, const Result& r)
+{
+	const double mb = static_cast<double>(bytes) / 1e6;
+	std::printf("%-48s %12llu %12.1f %12.1f\n", name.c_str(), static_cast<unsigned long long>(bytes), mb / r.median, mb / r.best);
+}
+
+struct Frame
+{
+	const uint8_t* block;
+	uint_fast32_t block_size;
+	uint_fast32_t frame_size;
+};
+
+// the LZX frames of a compressed XNB, split as XNB::read does
+std::vector<Frame> split_frames(const std::vector<uint8_t>& xnb)
+{
+	std::vector<Frame> frames;
+	std::size_t pos = 14;
+	while(pos + 2 <= xnb.size())
+	{
+		Frame frame;
+		if(xnb[pos] == 0xFF)
+		{
+			frame.frame_size = static_cast<uint_fast32_t>((xnb[pos + 1] << 8) | xnb[pos + 2]);
+			pos += 3;
+		}
+		else
+		{
+			frame.frame_size = 0x8000;
+		}
+		frame.block_size = static_cast<uint_fast32_t>((xnb[pos] << 8) | xnb[pos + 1]);
+		pos += 2;
+		frame.block = xnb.data() + pos;
+		pos += frame.block_size;
+		frames.push_back(frame);
+	}
+	return frames;
+}
+
+void bench_lzx(const std::vector<CorpusFile>& corpus, const Options& options)
+{
+	for(const CorpusFile& file : corpus)
+	{
+		if(file.compression != XNA::XNB::Compression::lzx)
+		{
+			continue;
+		}
+		const std::vector<Frame> frames = split_frames(file.xnb);
+		std::unique_ptr<uint8_t[]> out(new uint8_t[file.body_size]);
+		const Result r = measure([&]()
+		{
+			LzxDecoder lzx(16);
+			uint_fast64_t pos = 0;
+			for(const Frame& frame : frames)
+			{
+				lzx.Decompress(frame.block, frame.block_size, out.get() + pos, frame.frame_size);
+				pos += frame.frame_size;
+			}
+		}, options);
+		print_throughput("LzxDecoder::Decompress " + file.name, file.body_size, r);
+	}
+}
+
+void bench_lz4(const std::vector<CorpusFile>& corpus, const Options& options)
+{
+	for(const CorpusFile& file : corpus)
+	{
+		if(file.compression != XNA::XNB::Compression::lz4)
+		{
+			continue;
+		}
+		// one block after the 14-byte header
+		std::unique_ptr<uint8_t[]> out(new uint8_t[file.body_size]);
+		const Result r = measure([&]()
+		{
+			Lz4Decoder::Decompress(file.xnb.data() + 14, file.xnb.size() - 14, out.get(), file.body_size);
+		}, options);
+		print_throughput("Lz4Decoder::Decompress " + file.name, file.body_size, r);
+	}
+}
+
+void bench_decode_table(const Options& options)
+{
+	// a flat code that fits the direct lookup, and a skewed one with codes longer than MAINTREE_TABLEBITS
+	std::array<uint8_t, MAINTREE_MAXSYMBOLS> flat = {};
+	std::fill_n(flat.begin(), 512, 9);
+	std::array<uint8_t, MAINTREE_MAXSYMBOLS> skewed = {};
+	for(uint8_t i = 0; i < 16; ++i)
+	{
+		skewed[i] = i + 1;
+	}
+	skewed[16] = 16;
+
+	std::array<uint16_t, (1 << MAINTREE_TABLEBITS) + (MAINTREE_MAXSYMBOLS * 2)> table;
+	for(const std::pair<const char*, uint8_t*>& code : {std::make_pair("flat", flat.data()), std::make_pair("skewed", skewed.data())})
+	{
+		const Result r = measure([&]()
+		{
+			LzxDecoder::MakeDecodeTable(MAINTREE_MAXSYMBOLS, MAINTREE_TABLEBITS, code.second, table.data());
+		}, options);
+		std::printf("%-48s %12s %12.2f %12.2f\n", (std::string("MakeDecodeTable main tree ") + code.first).c_str(), "-", r.median * 1e6, r.best * 1e6);
+	}
+}
+
+void bench_xnb(const std::vector<CorpusFile>& corpus, const Options& options)
+{
+	for(const CorpusFile& file : corpus)
+	{
+		const Result r = measure([&]()
+		{
+			// includes one copy of the file, as BinaryReader owns its buffer
+			std::unique_ptr<uint8_t[]> data(new uint8_t[file.xnb.size()]);
+			std::memcpy(data.get(), file.xnb.data(), file.xnb.size());
+			BinaryReader reader(std::move(data), file.xnb.size());
+			XNA::XNB::XNB xnb(reader);
+		}, options);
+		print_throughput("XNB " + file.name, file.body_size, r);
+	}
+}
+
+/*
+seek indexes are files that anyone can write, so before timing one, make sure that copies of it with checkpoints no
+decoder could have saved are rejected rather than decoded
+*/
+void check_hostile_seek_index(const XNA::XNB::SeekIndex& index, const std::function<std::unique_ptr<BinaryReader>()>& make_reader)
+{
+	const std::vector<std::function<void(LzxCheckpoint&)>> corruptions =
+	{
+		[](LzxCheckpoint& c) { c.R[0] = 0x40000000; },
+		[](LzxCheckpoint& c) { c.R[1] = 0; },
+		[](LzxCheckpoint& c) { c.R[2] = static_cast<uint32_t>(c.window.size() + 1); },
+		[](LzxCheckpoint& c) { c.window_position = static_cast<uint32_t>(c.window.size() + 1); },
+		[](LzxCheckpoint& c) { c.block_remaining = c.block_length + 1; },
+	};
+	for(std::size_t i = 0; i < corruptions.size(); ++i)
+	{
+		XNA::XNB::SeekIndex hostile = index;
+		corruptions[i](hostile.checkpoints.back().lzx);
+		// through the file format, as an index from disk would be
+		const std::vector<uint8_t> data = XNA::XNB::encode_seek_index(hostile);
+		hostile = XNA::XNB::decode_seek_index(data.data(), data.size());
+		// rejected when the decoder takes the checkpoint, not by luck somewhere in the frames after it
+		bool rejected = false;
+		try
+		{
+			LzxDecoder(16).RestoreCheckpoint(hostile.checkpoints.back().lzx);
+		}
+		catch(const lzx_error&)
+		{
+			rejected = true;
+		}
+		try
+		{
+			XNA::XNB::XNB::read_range(*make_reader(), hostile.checkpoints.back().out_position, 1, &hostile);
+			rejected = false;
+		}
+		catch(const xna_error&)
+		{
+		}
+		if(!rejected)
+		{
+			throw std::string("hostile seek index " + std::to_string(i) + " was not rejected");
+		}
+	}
+}
+
+/*
+ADPCM coefficients come from the file, so a block predicted with the most negative ones from the most negative samples
+must decode to the clamped sample, not to whatever an int32 overflow gives
+*/
+void check_hostile_adpcm()
+{
+	std::vector<XNA::Content::AdpcmCoefficient> coefficients(7);
+	coefficients[0].coef1 = -32768;
+	coefficients[0].coef2 = -32768;
+	const uint16_t block_align = 8;
+	const AdpcmDecoder decoder(1, block_align, 4, coefficients);
+	// predictor 0, delta 16, sample1 and sample2 -32768, then two zero nibbles
+	const uint8_t block[block_align] = { 0, 16, 0, 0x00, 0x80, 0x00, 0x80, 0x00 };
+	int16_t out[4];
+	decoder.DecodeBlock(block, block_align, out);
+	// (-32768 * -32768 * 2) >> 8 is far above the largest sample, and the next prediction is (32767 - 32768) * -32768 >> 8
+	if(out[2] != 32767 || out[3] != 128)
+	{
+		throw std::string("hostile ADPCM coefficients decoded to " + std::to_string(out[2]) + ", " + std::to_string(out[3]) + " instead of 32767, 128");
+	}
+}
+
+// the last 64 KiB of each compressed body, decoded from the start and from the nearest checkpoint of a seek index
+void bench_seek(const std::vector<CorpusFile>& corpus, const Options& options)
+{
+	for(const CorpusFile& file : corpus)
+	{
+		if(file.compression != XNA::XNB::Compression::lzx || file.body_size < 0x10000)
+		{
+			continue;
+		}
+		auto make_reader = [&file]()
+		{
+			std::unique_ptr<uint8_t[]> data(new uint8_t[file.xnb.size()]);
+			std::memcpy(data.get(), file.xnb.data(), file.xnb.size());
+			return std::unique_ptr<BinaryReader>(new BinaryReader(std::move(data), file.xnb.size()));
+		};
+		const XNA::XNB::SeekIndex index = XNA::XNB::XNB::build_seek_index(*make_reader());
+		// a checkpoint before every frame, so that small corpora have one too
+		const XNA::XNB::SeekIndex dense_index = XNA::XNB::XNB::build_seek_index(*make_reader(), 1);
+		if(!dense_index.checkpoints.empty())
+		{
+			check_hostile_seek_index(dense_index, make_reader);
+		}
+		for(const XNA::XNB::SeekIndex* i : {static_cast<const XNA::XNB::SeekIndex*>(nullptr), &index})
+		{
+			const Result r = measure([&]()
+			{
+				XNA::XNB::XNB::read_range(*make_reader(), file.body_size - 0x10000, 0x10000, i);
+			}, options);
+			std::printf("%-48s %12s %12.2f %12.2f\n", ("read_range end " + file.name + ((i == nullptr) ? "" : " (index)")).c_str(), "-", r.median * 1e3, r.best * 1e3);
+		}
+	}
+}
+
+// takes everything, keeping only the count, so that what is timed is the encoder
+class CountingSink : public XNA::Export::OutputSink
+{
+	public:
+		void write(const uint8_t*, const size_t size) override
+		{
+			this->bytes += size;
+		}
+
+		uint_fast64_t bytes = 0;
+};
+
+// the first mip of each uncompressed PC texture as PNG, QOI and TGA; bytes are of RGBA pixels. PAM is left out, as it
+// hands the pixels to the sink as they are.
+void bench_export(const std::vector<CorpusFile>& corpus, const Options& options)
+{
+	using XNA::Export::ImageFormat;
+	for(const CorpusFile& file : corpus)
+	{
+		if(file.compression != XNA::XNB::Compression::none || file.name.compare(0, 8, "texture_") != 0 || file.name.find("xbox360") != std::string::npos)
+		{
+			continue;
+		}
+		std::unique_ptr<uint8_t[]> data(new uint8_t[file.xnb.size()]);
+		std::memcpy(data.get(), file.xnb.data(), file.xnb.size());
+		BinaryReader reader(std::move(data), file.xnb.size());
+		const XNA::XNB::XNB xnb(reader);
+		const auto texture = std::static_pointer_cast<XNA::Content::Texture2D>(xnb.objects.at(0));
+		const uint_fast64_t bytes = texture->get_mip_data(0).size();
+		for(const ImageFormat format : { ImageFormat::png, ImageFormat::qoi, ImageFormat::tga })
+		{
+			CountingSink sink;
+			const Result r = measure([&]()
+			{
+				XNA::Export::write_image(*texture, 0, format, sink);
+			}, options);
+			print_throughput("export " + XNA::Export::to_string(format) + " " + file.name, bytes, r);
+		}
+	}
+}
+
+std::vector<std::string> write_corpus(const std::vector<CorpusFile>& corpus, const std::string& dir)
+{
+	std::vector<std::string> filenames;
+	for(const CorpusFile& file : corpus)
+	{
+		const std::string filename = dir + "/" + file.name + ".xnb";
+		std::ofstream out(filename, std::ios::binary);
+		out.write(reinterpret_cast<const char*>(file.xnb.data()), static_cast<std::streamsize>(file.xnb.size()));
+		if(!out)
+		{
+			throw std::string("could not write " + filename);
+		}
+		filenames.push_back(filename);
+	}
+	return filenames;
+}
+
+void bench_convertxnb(const std::vector<CorpusFile>& corpus, const std::vector<std::string>& filenames, const Options& options)
+{
+	std::string command = "'" + options.convertxnb + "' --batch";
+	uint_fast64_t bytes = 0;
+	for(std::size_t i = 0; i < filenames.size(); ++i)
+	{
+		command += " '" + filenames[i] + "'";
+		bytes += corpus[i].xnb.size();
+	}
+	command += " > /dev/null";
+	const Result r = measure([&]()
+	{
+		if(std::system(command.c_str()) != 0)
+		{
+			throw std::string("failed: " + command);
+		}
+	}, options);
+	print_throughput("convertxnb --batch (whole corpus)", bytes, r);
+}
+
+void print_usage(const char* argv0)
+{
+	std::cout << "usage: " << argv0 << " [options]\n"
+	          << "options:\n"
+	          << "  --scale=N              corpus size: 256N x 256N textures and N seconds of sound (default 1)\n"
+	          << "  --reps=N               repetitions per benchmark (default 5)\n"
+	          << "  --min-time=MS          minimum time per repetition (default 100)\n"
+	          << "  --corpus-dir=DIR       write the corpus here (default: a temporary directory, if needed)\n"
+	          << "  --convertxnb=PATH      also time end-to-end conversion of the corpus by this convertxnb\n";
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for(int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		auto value = [&arg](const std::string& prefix, std::string& out)
+		{
+			if(arg.compare(0, prefix.size(), prefix) == 0)
+			{
+				out = arg.substr(prefix.size());
+				return true;
+			}
+			return false;
+		};
+		std::string v;
+		if(value("--scale=", v))
+		{
+			options.scale = static_cast<uint_fast32_t>(std::max(1ul, std::stoul(v)));
+		}
+		else if(value("--reps=", v))
+		{
+			options.reps = static_cast<uint_fast32_t>(std::max(1ul, std::stoul(v)));
+		}
+		else if(value("--min-time=", v))
+		{
+			options.min_rep_seconds = std::stod(v) / 1000;
+		}
+		else if(value("--corpus-dir=", v))
+		{
+			options.corpus_dir = v;
+		}
+		else if(value("--convertxnb=", v))
+		{
+			options.convertxnb = v;
+		}
+		else
+		{
+			print_usage(argv[0]);
+			return (arg == "--help") ? 0 : 1;
+		}
+	}
+
+	try
+	{
+		const std::vector<CorpusFile> corpus = make_corpus(options.scale);
+		std::printf("corpus (scale %u):\n", static_cast<unsigned int>(options.scale));
+		for(const CorpusFile& file : corpus)
+		{
+			std::printf("  %-28s %10llu bytes (body %llu)\n", file.name.c_str(), static_cast<unsigned long long>(file.xnb.size()), static_cast<unsigned long long>(file.body_size));
+		}
+		std::printf("\n");
+		check_hostile_adpcm();
+
+		print_header("MB/s");
+		bench_lzx(corpus, options);
+		bench_lz4(corpus, options);
+		bench_xnb(corpus, options);
+		bench_export(corpus, options);
+		std::printf("\n");
+		print_header("us");
+		bench_decode_table(options);
+		std::printf("\n");
+		print_header("ms");
+		bench_seek(corpus, options);
+
+		if(options.corpus_dir.empty() && !options.convertxnb.empty())
+		{
+			char dir[] = "/tmp/benchxnb.XXXXXX";
+			if(mkdtemp(dir) == nullptr)
+			{
+				throw std::string("could not create a temporary directory");
+			}
+			options.corpus_dir = dir;
+		}
+		if(!options.corpus_dir.empty())
+		{
+			const std::vector<std::string> filenames = write_corpus(corpus, options.corpus_dir);
+			if(!options.convertxnb.empty())
+			{
+				std::printf("\n");
+				print_header("MB/s");
+				bench_convertxnb(corpus, filenames, options);
+			}
+		}
+	}
+	catch(const std::string& e)
+	{
+		std::cerr << e << "\n";
+		return 1;
+	}
+	catch(const xna_error& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
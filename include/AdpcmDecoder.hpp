@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "Content.hpp"
+
+// Microsoft ADPCM to 16-bit PCM, one block at a time
+class AdpcmDecoder
+{
+	public:
+		AdpcmDecoder(uint16_t channel_count, uint16_t block_align, uint16_t samples_per_block, const std::vector<XNA::Content::AdpcmCoefficient>& coefficients);
+		explicit AdpcmDecoder(const XNA::Content::Sound& sound);
+
+		// samples per channel in a block of block_size bytes (the last block of a stream may be short)
+		uint_fast32_t SamplesInBlock(uint_fast32_t block_size) const;
+		// samples per channel in a stream of whole blocks followed by an optional short block
+		uint_fast64_t SamplesInStream(uint_fast64_t size) const;
+
+		// out receives SamplesInBlock(in_len) * channel_count interleaved samples; returns samples per channel
+		uint_fast32_t DecodeBlock(const uint8_t* in, uint_fast32_t in_len, int16_t* out) const;
+
+		// decodes a whole stream of blocks
+		std::vector<int16_t> Decode(const uint8_t* in, uint_fast64_t in_len) const;
+
+		uint16_t channel_count;
+		uint16_t block_align;
+		uint16_t samples_per_block;
+
+	private:
+		std::vector<XNA::Content::AdpcmCoefficient> coefficients;
+};
@@ -1,10 +1,13 @@
 #pragma once
 
-#include <BinaryReader.hpp>
 #include <BinaryWriter.hpp>
+#include <array>
 #include <vector>
 #include <memory>
 
+#include "ContentReader.hpp"
+#include "Types.hpp"
+
 namespace XNA {
 namespace Content {
 
@@ -16,7 +19,7 @@ class ContentBase
 	public:
 		std::string get_type_reader_name();
 
-		static std::shared_ptr<ContentBase> Read(BinaryReader& reader, const std::string& type_reader_name);
+		static std::shared_ptr<ContentBase> Read(ContentReader& reader, const std::string& type_reader_name);
 
 	protected:
 		std::string type_reader_name;
@@ -47,19 +50,28 @@ enum class Texture2D_SurfaceFormat : int32_t
 	HdrBlendable = 19,
 };
 std::string to_string(Texture2D_SurfaceFormat);
+uint_fast32_t bytes_per_pixel(Texture2D_SurfaceFormat);
 
 class Texture2D : public ContentBase
 {
 	public:
-		explicit Texture2D(BinaryReader& reader);
+		explicit Texture2D(ContentReader& reader);
+
+		const std::vector<uint8_t>& get_mip_data(uint_fast32_t i) const;
+		std::pair<uint32_t, uint32_t> get_mip_size(uint_fast32_t i) const;
+		uint_fast32_t get_mip_count() const;
+		Texture2D_SurfaceFormat get_surface_format() const;
 
-		std::vector<uint8_t> get_mip_data(uint_fast32_t i);
-		std::pair<uint32_t, uint32_t> get_mip_size(uint_fast32_t i);
+		// RGBA8888 only; the content pipeline premultiplies alpha by default
+		void unpremultiply_alpha();
+		void premultiply_alpha();
 
 		void write(BinaryWriter& writer);
 
 	private:
-		void read(BinaryReader& reader);
+		void read(ContentReader& reader);
+		// byte-swapped and untiled (see ReadOptions::untile_xbox360_textures)
+		std::vector<uint8_t> read_xbox360_mip(ContentReader& reader, uint_fast32_t i, uint32_t mip_size);
 
 		std::vector<std::vector<uint8_t>> mips;
 		uint32_t width;
@@ -74,35 +86,95 @@ enum class SoundFormat : uint16_t
 };
 std::string to_string(SoundFormat);
 
+struct AdpcmCoefficient
+{
+	int16_t coef1;
+	int16_t coef2;
+};
+
 class Sound : public ContentBase
 {
 	public:
-		explicit Sound(BinaryReader& reader);
+		explicit Sound(ContentReader& reader);
+		// a sound over data owned elsewhere (e.g. a wave bank entry); extra_info is as in WAVEFORMATEX
+		Sound(SoundFormat format, uint16_t channel_count, uint32_t sample_rate, uint16_t block_align, uint16_t bits_per_sample, std::vector<uint8_t> extra_info, std::shared_ptr<const uint8_t> data, uint32_t data_size);
 
 		uint16_t channel_count;
 		uint32_t sample_rate;
 		uint32_t average_byte_rate;
 		uint16_t block_align;
 		uint16_t bits_per_sample;
-		std::vector<uint8_t> data;
+		std::vector<uint8_t> data; // empty if ReadOptions::copy_sound_data is false
 		SoundFormat format;
-		uint32_t loop_start; // bytes
-		uint32_t loop_length; // bytes
+		uint32_t loop_start; // samples
+		uint32_t loop_length; // samples
 		uint32_t loop_duration; // milliseconds
 
+		// format-specific bytes after WAVEFORMATEX (cbSize bytes)
+		std::vector<uint8_t> extra_info;
+
+		uint16_t samples_per_block; // per channel; 1 for PCM
+		std::vector<AdpcmCoefficient> adpcm_coefficients; // ADPCM only (parsed from extra_info)
+
+		// the sample data, whether or not it was copied into data
+		const uint8_t* get_data() const;
+		uint32_t get_data_size() const;
+
 		void write(BinaryWriter& writer);
 
 	private:
-		void read(BinaryReader& reader);
+		void read(ContentReader& reader);
+		void check_format();
+		void read_adpcm_format();
+
+		std::shared_ptr<const uint8_t> data_ref; // into the XNB body if not copied (or a byte-swapped copy for Xbox 360 content)
+		uint32_t data_size;
+};
+
+struct Glyph
+{
+	Rectangle bounds; // in the texture
+	Rectangle cropping; // where the glyph is placed in its cell
+	float left_side_bearing;
+	float width;
+	float right_side_bearing;
 };
 
 class SpriteFont : public ContentBase
 {
 	public:
-		explicit SpriteFont(BinaryReader& reader);
+		explicit SpriteFont(ContentReader& reader);
+
+		std::shared_ptr<Texture2D> texture;
+		int32_t line_spacing;
+		float spacing;
+		bool has_default_character;
+		char32_t default_character;
+
+		// in file order (sorted by the content pipeline); glyphs[i] is for characters[i]
+		const std::vector<char32_t>& get_characters() const;
+		const std::vector<Glyph>& get_glyphs() const;
+
+		// nullptr if the font has no glyph for c (the default character is not substituted)
+		const Glyph* find_glyph(char32_t c) const;
+
+		// size of text as drawn by SpriteBatch.DrawString, as SpriteFont.MeasureString computes it; text is UTF-8
+		Vector2 MeasureString(const std::string& text) const;
+		Vector2 MeasureString(const std::u32string& text) const;
 
 	private:
-		void read(BinaryReader& reader);
+		void read(ContentReader& reader);
+		void build_index();
+		const Glyph& glyph_or_default(char32_t c) const;
+		template <typename Cursor> Vector2 measure(Cursor cursor) const;
+
+		std::vector<char32_t> characters;
+		std::vector<Glyph> glyphs;
+
+		// glyph index + 1 (0: none); U+0000 to U+00FF are looked up directly and the rest are binary searched
+		std::array<uint32_t, 256> latin1_glyphs;
+		std::vector<std::pair<char32_t, uint32_t>> other_glyphs;
+		uint32_t default_glyph;
 };
 
 } // namespace Content
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace XNA {
+namespace Content {
+
+class ContentBase;
+
+struct ReadOptions
+{
+	// if false, Sound::data is left empty and the sample data is referenced in the XNB body instead (see Sound::get_data)
+	bool copy_sound_data = true;
+	// if true, arrays of fixed-size value types (see Generic.hpp) point into the XNB body where it is suitably aligned instead of being copied
+	bool view_arrays = false;
+
+	// limits for untrusted files: a file over any of them is rejected before the memory for it is allocated
+	uint_fast64_t max_body_size = UINT32_MAX;		// size of the XNB body after decompression
+	uint_fast64_t max_objects = UINT32_MAX;			// objects read, including nested ones
+	uint_fast64_t max_mip_size = UINT32_MAX;		// bytes of one texture mip level
+	uint_fast64_t max_total_bytes = UINT64_MAX;		// bytes held at once while reading a file (see MemoryBudget)
+
+	/*
+	partial reads, e.g. for thumbnails: a compressed body is then only decoded as far as the content that is read,
+	and the rest of it is not checked
+	*/
+	bool primary_only = false;						// read only the primary asset, not the shared resources after it (which it must not refer to)
+	uint32_t max_mip_count = UINT32_MAX;			// texture mip levels to read; the smaller ones after them are skipped
+
+	// Xbox 360 textures are stored tiled (see Xbox360.hpp); if false, the mips are left that way, padded to whole tiles
+	bool untile_xbox360_textures = true;
+};
+
+/*
+counts the bytes a load holds: the file, the compressed data, the body and whatever content readers copy out of it
+(not the objects themselves, which are small next to their data). allocate throws memory_error before the limit
+would be passed.
+*/
+class MemoryBudget
+{
+	public:
+		explicit MemoryBudget(uint_fast64_t limit);
+
+		void allocate(uint_fast64_t bytes, const std::string& what);
+		void release(uint_fast64_t bytes);
+		uint_fast64_t get_current() const;
+		uint_fast64_t get_peak() const;
+
+	private:
+		uint_fast64_t limit;
+		uint_fast64_t current;
+		uint_fast64_t peak;
+};
+
+/*
+reader over the (decompressed) body of an XNB, which it shares with anything read without copying. numbers are
+little-endian, or big-endian for Xbox 360 content (see SetBigEndian).
+*/
+class ContentReader
+{
+	public:
+		ContentReader(std::shared_ptr<const uint8_t> buffer, uint_fast64_t size, const ReadOptions& options = ReadOptions());
+		// continues counting in budget, which should already include buffer
+		ContentReader(std::shared_ptr<const uint8_t> buffer, uint_fast64_t size, const ReadOptions& options, const MemoryBudget& budget);
+		/*
+		for a buffer that is filled as it is read (e.g. by decompressing): fill(end) is called before a read that goes
+		past the valid bytes and returns how many are now valid, which is at least end
+		*/
+		ContentReader(std::shared_ptr<const uint8_t> buffer, uint_fast64_t size, const ReadOptions& options, const MemoryBudget& budget, std::function<uint_fast64_t(uint_fast64_t end)> fill);
+
+		uint_fast64_t GetSize() const;
+		uint_fast64_t GetPosition() const;
+		uint_fast64_t GetRemaining() const;
+		const ReadOptions& GetOptions() const;
+		MemoryBudget& GetBudget();
+		// Xbox 360 content has its numbers byte-swapped; content readers swap bulk data themselves (see ReadSwapped)
+		void SetBigEndian(bool big_endian);
+		bool IsBigEndian() const;
+
+		uint8_t ReadUInt8();
+		int8_t ReadInt8();
+		uint16_t ReadUInt16();
+		int16_t ReadInt16();
+		uint32_t ReadUInt32();
+		int32_t ReadInt32();
+		uint64_t ReadUInt64();
+		uint_fast64_t Read7BitEncodedInt();
+		std::string ReadString(uint_fast64_t length);
+		std::string ReadStringMS(); // 7-bit encoded length prefix
+		std::vector<uint8_t> ReadBytes(uint_fast64_t length);
+		float ReadFloat();
+		bool ReadBoolean();
+		char32_t ReadChar(); // one UTF-8 encoded character, as System.IO.BinaryReader.ReadChar
+
+		// no copy: the pointer is valid while this reader (or a ReadShared result) is alive
+		const uint8_t* ReadView(uint_fast64_t length);
+		// no copy: shares ownership of the whole buffer
+		std::shared_ptr<const uint8_t> ReadShared(uint_fast64_t length);
+		/*
+		length bytes of unit-byte numbers in little-endian order: as ReadShared, or for big-endian content a copy with
+		each number byte-swapped
+		*/
+		std::shared_ptr<const uint8_t> ReadSwapped(uint_fast64_t length, uint_fast32_t unit);
+
+		// the XNB's type readers, indexed by type id - 1
+		void SetTypeReaders(const std::vector<std::string>& qualified_names);
+		// reads the type id that precedes a nested object and returns its type reader name without assembly names; "" for null
+		std::string ReadTypeReaderName();
+		// reads a type id and the object it introduces; nullptr for null
+		std::shared_ptr<ContentBase> ReadObject();
+		// moves past length bytes without reading (or filling) them
+		void Skip(uint_fast64_t length);
+		// the name of an asset in another file, relative to this one; "" for none
+		std::string ReadExternalReference();
+
+		/*
+		reads a shared resource id: 0 for null, otherwise index + 1 into the shared resources. they follow the primary
+		asset, so the object that read the id keeps it and looks the resource up in a fixup (see AddSharedResourceFixup).
+		*/
+		uint_fast64_t ReadSharedResource();
+		// fixup is called with the shared resources by ResolveSharedResources
+		void AddSharedResourceFixup(std::function<void(const std::vector<std::shared_ptr<ContentBase>>&)> fixup);
+		void ResolveSharedResources(const std::vector<std::shared_ptr<ContentBase>>& shared_resources);
+		// whether ids other than null have been read and not resolved yet
+		bool HasUnresolvedSharedResources() const;
+
+	private:
+		void require(uint_fast64_t length);
+
+		std::shared_ptr<const uint8_t> buffer;
+		uint_fast64_t size;
+		uint_fast64_t position;
+		uint_fast64_t available; // bytes of buffer that are valid
+		std::function<uint_fast64_t(uint_fast64_t)> fill;
+		ReadOptions options;
+		MemoryBudget budget;
+		uint_fast64_t object_count;
+		bool big_endian;
+		std::vector<std::string> type_reader_names;
+		uint_fast64_t unresolved_shared_resources;
+		std::vector<std::function<void(const std::vector<std::shared_ptr<ContentBase>>&)>> shared_resource_fixups;
+};
+
+/*
+removes assembly qualifiers from a .NET type name, including those of generic arguments:
+"ListReader`1[[Rectangle, Microsoft.Xna.Framework, Version=4.0.0.0]], Microsoft.Xna.Framework" -> "ListReader`1[[Rectangle]]"
+*/
+std::string strip_assembly_names(const std::string& qualified_name);
+
+} // namespace Content
+} // namespace XNA
@@ -0,0 +1,13 @@
+#pragma once
+
+namespace XNA {
+namespace CPU {
+
+// runtime checks for optional instruction sets (always false on non-x86 targets)
+bool has_ssse3();
+bool has_sse41();
+bool has_avx2();
+bool has_f16c();
+
+} // namespace CPU
+} // namespace XNA
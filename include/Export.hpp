@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "Content.hpp"
+#include "ImageWriter.hpp"
+#include "OutputSink.hpp"
+#include "PngWriter.hpp"
+
+namespace XNA {
+namespace Export {
+
+enum class ImageFormat
+{
+	// one mip as 8-bit RGBA (see Content::to_RGBA8)
+	png,
+	qoi,	// see ImageWriter.hpp for these three
+	tga,
+	pam,
+	// the surface format as it is, with every mip
+	dds,
+};
+
+// "png", "qoi", "tga", "pam" or "dds", which is also the file extension; image_format_from_string throws xna_error for anything else
+std::string to_string(ImageFormat format);
+ImageFormat image_format_from_string(const std::string& name);
+
+struct ExportOptions
+{
+	ImageFormat image_format = ImageFormat::png;
+	uint32_t mip = 0;				// the mip level written, unless image_format is dds
+	bool unpremultiply = false;		// for RGBA8888 textures (see Texture2D::unpremultiply_alpha)
+	bool decode_adpcm = false;		// writes ADPCM sounds as 16-bit PCM
+	PngOptions png;
+};
+
+// mip of texture as PNG
+void write_png(const Content::Texture2D& texture, uint32_t mip, OutputSink& sink, const PngOptions& options = PngOptions());
+
+// mip of texture as format, which cannot be dds (see write_dds); png_options are for png only
+void write_image(const Content::Texture2D& texture, uint32_t mip, ImageFormat format, OutputSink& sink, const PngOptions& png_options = PngOptions());
+
+/*
+texture as DDS, with every mip. block-compressed, 16-bit and RGBA8888 formats have a plain DDS header that any
+reader takes; the others need the DX10 extension header (a DXGI format).
+*/
+void write_dds(const Content::Texture2D& texture, OutputSink& sink);
+
+// sound as a RIFF WAVE file, with a smpl chunk for its loop; ADPCM stays ADPCM unless decode_adpcm is set
+void write_wav(const Content::Sound& sound, OutputSink& sink, bool decode_adpcm = false);
+
+/*
+converts the primary asset of the XNB in data (size bytes), e.g. an upload held in memory: a texture or a sprite font's
+texture to options.image_format, or a sound to WAV. returns the file extension of what it wrote to sink (to_string of
+the image format, or "wav"); throws xna_error for anything else.
+*/
+std::string export_xnb(const uint8_t* data, uint_fast64_t size, OutputSink& sink, const ExportOptions& options = ExportOptions(), const Content::ReadOptions& read_options = Content::ReadOptions());
+
+} // namespace Export
+} // namespace XNA
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Content.hpp"
+#include "ContentReader.hpp"
+#include "Stats.hpp"
+#include "Types.hpp"
+
+namespace XNA {
+namespace Content {
+
+/*
+contiguous elements of a value type. the storage is either owned or, with ReadOptions::view_arrays,
+a view into the XNB body; either way it is shared and stays valid while any copy of the view exists.
+*/
+template <typename T> class ArrayView
+{
+	public:
+		ArrayView()
+		:
+			count(0)
+		{
+		}
+
+		ArrayView(std::shared_ptr<const T> elements, const size_t count)
+		:
+			elements(std::move(elements)),
+			count(count)
+		{
+		}
+
+		const T* data() const { return this->elements.get(); }
+		size_t size() const { return this->count; }
+		bool empty() const { return this->count == 0; }
+		const T* begin() const { return this->elements.get(); }
+		const T* end() const { return this->elements.get() + this->count; }
+		const T& operator[](const size_t i) const { return this->elements.get()[i]; }
+
+	private:
+		std::shared_ptr<const T> elements;
+		size_t count;
+};
+
+// count elements of T over bytes: a view if view is true and bytes is aligned for T, otherwise a copy
+template <typename T> ArrayView<T> view_or_copy(const std::shared_ptr<const uint8_t>& bytes, const size_t count, const bool view = true)
+{
+	if(view && reinterpret_cast<uintptr_t>(bytes.get()) % alignof(T) == 0)
+	{
+		return ArrayView<T>(std::shared_ptr<const T>(bytes, reinterpret_cast<const T*>(bytes.get())), count);
+	}
+	Stats::add_allocation(count * sizeof(T));
+	std::shared_ptr<T> elements(new T[count], std::default_delete<T[]>());
+	std::memcpy(elements.get(), bytes.get(), count * sizeof(T));
+	return ArrayView<T>(std::move(elements), count);
+}
+
+// a single value read by one of the primitive or math type readers (Int32Reader, Vector3Reader, ...)
+template <typename T> class Value : public ContentBase
+{
+	public:
+		Value(ContentReader& reader, const std::string& type_reader_name);
+
+		T value;
+};
+
+class String : public ContentBase
+{
+	public:
+		explicit String(ContentReader& reader);
+
+		std::string value;
+};
+
+// List<T> or T[] of a value type; fixed-size elements are read in bulk
+template <typename T> class ValueList : public ContentBase
+{
+	public:
+		ValueList(ContentReader& reader, const std::string& type_reader_name);
+
+		ArrayView<T> items;
+};
+
+// List<T> or T[] of a reference type; every element is a nested object (or null)
+class ObjectList : public ContentBase
+{
+	public:
+		ObjectList(ContentReader& reader, const std::string& type_reader_name, const std::string& element_type);
+
+		std::string element_type;
+		std::vector<std::shared_ptr<ContentBase>> items;
+};
+
+// Dictionary<K, V>; value-type keys and values are boxed as Value<T>
+class Dictionary : public ContentBase
+{
+	public:
+		Dictionary(ContentReader& reader, const std::string& type_reader_name, const std::string& key_type, const std::string& value_type);
+
+		std::string key_type;
+		std::string value_type;
+		std::vector<std::pair<std::shared_ptr<ContentBase>, std::shared_ptr<ContentBase>>> entries;
+};
+
+// the generic and primitive type readers; nullptr if type_reader_name is none of them
+std::shared_ptr<ContentBase> read_generic(ContentReader& reader, const std::string& type_reader_name);
+
+} // namespace Content
+} // namespace XNA
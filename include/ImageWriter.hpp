@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "OutputSink.hpp"
+
+namespace XNA {
+namespace Export {
+
+/*
+lossless images that are much faster to write than PNG, for when the size of the file matters less than the time it
+takes. every writer takes 8-bit RGBA pixels, rows from the top, like write_png_RGBA.
+*/
+
+/*
+QOI (https://qoiformat.org): one pass over the pixels with a 64-entry cache, runs and small differences. typically a
+little bigger than PNG and many times faster to write.
+*/
+void write_qoi_RGBA(OutputSink& sink, const uint8_t* buf, uint32_t width, uint32_t height);
+
+// uncompressed 32-bit Truevision TGA, rows from the top; throws xna_error for an image over 65535 pixels on a side
+void write_tga_RGBA(OutputSink& sink, const uint8_t* buf, uint32_t width, uint32_t height);
+
+// Netpbm PAM with TUPLTYPE RGB_ALPHA: a text header and then buf as it is
+void write_pam_RGBA(OutputSink& sink, const uint8_t* buf, uint32_t width, uint32_t height);
+
+} // namespace Export
+} // namespace XNA
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+the LZ4 block format (no frame header or checksums), as MonoGame stores a compressed XNB body: one block for all of it.
+every read and write is bounds checked; copies are done 16 bytes at a time where the buffers leave room for that.
+*/
+class Lz4Decoder
+{
+	public:
+		// decodes all of in, which must produce exactly out_len bytes; throws lz4_error with the offset into in otherwise
+		static void Decompress(const uint8_t* in, uint_fast64_t in_len, uint8_t* out, uint_fast64_t out_len);
+
+		// the most any in_len bytes can decode to, for rejecting a decompressed size before allocating it
+		static uint_fast64_t MaxDecompressedSize(uint_fast64_t in_len);
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// greedy LZ4 block compressor producing what Lz4Decoder reads, for writing MonoGame-style XNBs
+class Lz4Encoder
+{
+	public:
+		Lz4Encoder();
+
+		// compresses all of data as one block
+		std::vector<uint8_t> Compress(const uint8_t* data, uint_fast64_t size);
+
+	private:
+		// match finder: the last position of each hashed 4-byte prefix
+		std::vector<uint32_t> table;
+};
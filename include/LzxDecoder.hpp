@@ -1,7 +1,9 @@
 #pragma once
 
 #include <array>
+#include <ostream>
 #include <string>
+#include <vector>
 
 #include <BinaryReader.hpp>
 #include <BinaryWriter.hpp>
@@ -25,6 +27,60 @@ const uint8_t MAINTREE_TABLEBITS = 12;
 const uint8_t LENGTH_TABLEBITS = 12;
 const uint8_t ALIGNED_TABLEBITS = 7;
 
+// what LZX streams are made of, as seen by LzxDecoder::Decompress
+struct LzxAnalysis
+{
+	uint64_t frames = 0;
+	uint64_t compressed_bytes = 0;
+	uint64_t decompressed_bytes = 0;
+
+	// by block type: 1 verbatim, 2 aligned, 3 uncompressed
+	std::array<uint64_t, 4> blocks = {};
+	uint64_t uncompressed_block_bytes = 0;
+
+	// Huffman trees of verbatim and aligned blocks: symbols with a code, summed over blocks, and the bits of their headers
+	uint64_t main_tree_symbols = 0;
+	uint64_t length_tree_symbols = 0;
+	uint64_t aligned_tree_symbols = 0;
+	uint64_t tree_bits = 0;
+
+	uint64_t matches = 0;
+	uint64_t match_bytes = 0;
+	// matches that reused R0, R1 or R2 instead of coding an offset
+	std::array<uint64_t, 3> repeat_offsets = {};
+	// by floor(log2(x)): lengths are 2 to 257, offsets 1 to the window size (at most 2^21)
+	std::array<uint64_t, 9> match_lengths = {};
+	std::array<uint64_t, 22> match_offsets = {};
+
+	// bytes of verbatim and aligned blocks that were not produced by matches
+	uint64_t literals() const
+	{
+		return this->decompressed_bytes - this->match_bytes - this->uncompressed_block_bytes;
+	}
+
+	void merge(const LzxAnalysis& other);
+	void print(std::ostream& out) const;
+};
+
+/*
+the state of an LzxDecoder between two frames, from which decoding can resume without the frames before it: the
+window (the output it can still refer back to), the repeated offsets, the block being decoded and the code lengths
+that the next block's are coded as deltas from
+*/
+struct LzxCheckpoint
+{
+	std::vector<uint8_t> window;
+	uint32_t window_position = 0;
+	std::array<uint32_t, 3> R = {{1, 1, 1}};
+	bool header_read = false;
+	uint8_t block_type = 0;
+	uint32_t block_length = 0;
+	uint32_t block_remaining = 0;
+	std::array<uint8_t, MAINTREE_MAXSYMBOLS> main_tree_lengths = {};
+	std::array<uint8_t, LENGTH_MAXSYMBOLS> length_tree_lengths = {};
+	std::array<uint8_t, ALIGNED_MAXSYMBOLS> aligned_tree_lengths = {};
+};
+
 class LzxDecoder
 {
 	public:
@@ -33,10 +89,26 @@ class LzxDecoder
 		~LzxDecoder();
 		void Decompress(const uint8_t* inBuf, const uint_fast32_t inLen, uint8_t* outBuf, const uint_fast32_t outLen);
 
+		// back to the start of a new stream, as if just constructed, keeping the window's memory
+		void Reset();
+
+		// every following frame adds to analysis (none if nullptr), which must outlive the decoding
+		void SetAnalysis(LzxAnalysis* analysis);
+
+		// only valid between frames; RestoreCheckpoint throws lzx_error for a checkpoint this decoder could not have saved
+		void SaveCheckpoint(LzxCheckpoint& checkpoint) const;
+		void RestoreCheckpoint(const LzxCheckpoint& checkpoint);
+
+		// builds the lookup table for the Huffman code with the given lengths; public so it can be benchmarked alone
+		static void MakeDecodeTable(uint16_t nsyms, uint8_t nbits, uint8_t* length, uint16_t* table);
+
 	private:
-		void MakeDecodeTable(uint16_t nsyms, uint8_t nbits, uint8_t* length, uint16_t* table);
 		void ReadLengths(uint8_t* lens, uint_fast32_t first, uint_fast32_t last, BitBuffer& bitbuf);
 		uint32_t ReadHuffSym(const uint16_t* table, const uint8_t* lengths, uint32_t nsyms, uint8_t nbits, BitBuffer& bitbuf);
+		void AnalyzeTrees(uint_fast64_t bits);
+		void AnalyzeMatch(uint_fast32_t match_length, uint_fast32_t match_offset, uint_fast32_t slot);
+
+		LzxAnalysis* analysis;
 
 		std::array<uint32_t, 51> position_base;
 		std::array<uint8_t, 52> extra_bits;
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+#include "LzxDecoder.hpp"
+
+/*
+greedy LZX compressor producing the stream LzxDecoder reads: every frame is one verbatim block that ends
+on a 16-bit boundary, so it can be stored as an XNB chunk. matches may refer back into earlier frames.
+*/
+class LzxEncoder
+{
+	public:
+		static const uint_fast32_t FRAME_SIZE = 0x8000;
+
+		explicit LzxEncoder(const uint_fast16_t window_bits);
+		LzxEncoder(const LzxEncoder&) = delete;
+
+		/*
+		compresses all of data, calling write_frame with the compressed bytes of each frame of FRAME_SIZE
+		bytes (the last may be shorter) in order. every call compresses an independent stream.
+		*/
+		void Compress(const uint8_t* data, uint_fast64_t size, const std::function<void(const std::vector<uint8_t>& block, uint_fast32_t frame_size)>& write_frame);
+
+	private:
+		struct Token
+		{
+			uint16_t main_element;
+			int16_t length_footer; // -1 if none
+			uint8_t extra_bit_count;
+			uint32_t extra_bits;
+		};
+
+		void Parse(const uint8_t* data, uint_fast64_t size, uint_fast64_t begin, uint_fast64_t end);
+		void Insert(const uint8_t* data, uint_fast64_t size, uint_fast64_t pos);
+		void WriteBlock(uint_fast32_t block_length, bool first, std::vector<uint8_t>& out);
+
+		uint_fast32_t window_size;
+		uint16_t main_elements;
+		std::array<uint32_t, 51> position_base;
+		std::array<uint8_t, 52> extra_bits;
+
+		// match finder: hash chains over 3-byte prefixes
+		std::vector<int_fast64_t> head;
+		std::vector<int_fast64_t> prev;
+
+		uint_fast32_t R0, R1, R2;
+		std::vector<Token> tokens;
+
+		// the previous block's lengths, which the next block's are delta coded against
+		std::array<uint8_t, MAINTREE_MAXSYMBOLS> MAINTREE_len;
+		std::array<uint8_t, LENGTH_MAXSYMBOLS> LENGTH_len;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace XNA {
+
+// read-only memory mapping of a whole file; pages are only read when touched
+class MappedFile
+{
+	public:
+		explicit MappedFile(const std::string& filename);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const uint8_t* data() const;
+		uint_fast64_t size() const;
+
+	private:
+		const uint8_t* mapping;
+		uint_fast64_t length;
+};
+
+} // namespace XNA
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Content.hpp"
+#include "ContentReader.hpp"
+#include "Generic.hpp"
+#include "Types.hpp"
+#include "xna_exception.hpp"
+
+namespace XNA {
+namespace Content {
+
+enum class VertexElementFormat : int32_t
+{
+	Single = 0,
+	Vector2 = 1,
+	Vector3 = 2,
+	Vector4 = 3,
+	Color = 4,
+	Byte4 = 5,
+	Short2 = 6,
+	Short4 = 7,
+	NormalizedShort2 = 8,
+	NormalizedShort4 = 9,
+	HalfVector2 = 10,
+	HalfVector4 = 11,
+};
+std::string to_string(VertexElementFormat);
+uint_fast32_t element_size(VertexElementFormat);
+
+enum class VertexElementUsage : int32_t
+{
+	Position = 0,
+	Color = 1,
+	TextureCoordinate = 2,
+	Normal = 3,
+	Binormal = 4,
+	Tangent = 5,
+	BlendIndices = 6,
+	BlendWeight = 7,
+	Depth = 8,
+	Fog = 9,
+	PointSize = 10,
+	Sample = 11,
+	TessellateFactor = 12,
+};
+std::string to_string(VertexElementUsage);
+
+struct VertexElement
+{
+	uint32_t offset; // in the vertex
+	VertexElementFormat format;
+	VertexElementUsage usage;
+	uint32_t usage_index;
+};
+
+class VertexDeclaration : public ContentBase
+{
+	public:
+		VertexDeclaration();
+		explicit VertexDeclaration(ContentReader& reader);
+
+		uint32_t stride;
+		std::vector<VertexElement> elements;
+
+		// nullptr if there is no such element
+		const VertexElement* find_element(VertexElementUsage usage, uint32_t usage_index = 0) const;
+};
+
+// the vertex data is not copied: it is shared with the XNB body (except for Xbox 360 content, which is byte-swapped)
+class VertexBuffer : public ContentBase
+{
+	public:
+		explicit VertexBuffer(ContentReader& reader);
+
+		VertexDeclaration declaration;
+		uint32_t vertex_count;
+
+		// vertex_count * declaration.stride bytes
+		const uint8_t* get_data() const;
+		uint_fast64_t get_data_size() const;
+
+		// the vertices as T, whose size must be the stride; a view unless the data is misaligned for T
+		template <typename T> ArrayView<T> get_vertices() const
+		{
+			if(sizeof(T) != this->declaration.stride)
+			{
+				throw xna_error("vertex type size (" + std::to_string(sizeof(T)) + ") is not the vertex stride (" + std::to_string(this->declaration.stride) + ")");
+			}
+			return view_or_copy<T>(this->data, this->vertex_count);
+		}
+
+	private:
+		std::shared_ptr<const uint8_t> data;
+};
+
+// the index data is not copied: it is shared with the XNB body (except for Xbox 360 content, which is byte-swapped)
+class IndexBuffer : public ContentBase
+{
+	public:
+		explicit IndexBuffer(ContentReader& reader);
+
+		bool sixteen_bits;
+
+		const uint8_t* get_data() const;
+		uint32_t get_data_size() const;
+		uint32_t get_index_count() const;
+
+		// the indices of a 16 or 32 bit buffer respectively; a view unless the data is misaligned
+		ArrayView<uint16_t> get_indices16() const;
+		ArrayView<uint32_t> get_indices32() const;
+
+	private:
+		std::shared_ptr<const uint8_t> data;
+		uint32_t data_size;
+};
+
+// compiled effect (fx_2_0 or later) bytecode
+class Effect : public ContentBase
+{
+	public:
+		explicit Effect(ContentReader& reader);
+
+		const uint8_t* get_bytecode() const;
+		uint32_t get_bytecode_size() const;
+
+	private:
+		std::shared_ptr<const uint8_t> bytecode;
+		uint32_t bytecode_size;
+};
+
+class BasicEffect : public ContentBase
+{
+	public:
+		explicit BasicEffect(ContentReader& reader);
+
+		std::string texture; // external reference; "" for none
+		Vector3 diffuse_color;
+		Vector3 emissive_color;
+		Vector3 specular_color;
+		float specular_power;
+		float alpha;
+		bool vertex_color_enabled;
+};
+
+class EffectMaterial : public ContentBase
+{
+	public:
+		explicit EffectMaterial(ContentReader& reader);
+
+		std::string effect; // external reference
+		std::shared_ptr<ContentBase> parameters; // Dictionary<string, object> (see Generic.hpp)
+};
+
+struct ModelBone
+{
+	static const uint32_t NONE = UINT32_MAX;
+
+	std::string name;
+	Matrix transform; // relative to the parent
+	uint32_t parent; // NONE for a root
+	std::vector<uint32_t> children;
+};
+
+struct ModelMeshPart
+{
+	uint32_t vertex_offset;
+	uint32_t vertex_count;
+	uint32_t start_index;
+	uint32_t primitive_count; // triangles
+	std::shared_ptr<ContentBase> tag;
+
+	// shared resources, so parts (and models) can share them
+	std::shared_ptr<VertexBuffer> vertex_buffer;
+	std::shared_ptr<IndexBuffer> index_buffer;
+	std::shared_ptr<ContentBase> effect; // BasicEffect, EffectMaterial, ...
+};
+
+struct ModelMesh
+{
+	std::string name;
+	uint32_t parent_bone; // ModelBone::NONE if none
+	BoundingSphere bounds;
+	std::shared_ptr<ContentBase> tag;
+	std::vector<ModelMeshPart> parts;
+};
+
+/*
+the vertex and index buffers, and effects, of mesh parts are shared resources, so they are only set
+once the XNB has read its shared resources (they are the same objects as in XNB::objects).
+*/
+class Model : public ContentBase
+{
+	public:
+		explicit Model(ContentReader& reader);
+
+		std::vector<ModelBone> bones;
+		std::vector<ModelMesh> meshes;
+		uint32_t root_bone;
+		std::shared_ptr<ContentBase> tag;
+
+		/*
+		sets the shared resources of the mesh parts from the ids that were read with them; throws xna_error for an id
+		past the end or a resource of the wrong type. XNB::read calls it through a ContentReader fixup.
+		*/
+		void resolve_shared_resources(const std::vector<std::shared_ptr<ContentBase>>& shared_resources);
+
+	private:
+		// of a mesh part, in the order of meshes and their parts; 0 for null
+		struct SharedResourceIds
+		{
+			uint_fast64_t vertex_buffer;
+			uint_fast64_t index_buffer;
+			uint_fast64_t effect;
+		};
+
+		void read(ContentReader& reader);
+		uint32_t read_bone_reference(ContentReader& reader) const;
+
+		std::vector<SharedResourceIds> shared_resource_ids;
+};
+
+} // namespace Content
+} // namespace XNA
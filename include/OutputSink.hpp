@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdio>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace XNA {
+namespace Export {
+
+// where an exporter writes what it makes, in order; implement write to send it anywhere else
+class OutputSink
+{
+	public:
+		virtual ~OutputSink();
+
+		// throws xna_error if the bytes cannot be taken
+		virtual void write(const uint8_t* data, size_t size) = 0;
+};
+
+// collects everything written in data
+class MemorySink : public OutputSink
+{
+	public:
+		void write(const uint8_t* data, size_t size) override;
+
+		std::vector<uint8_t> data;
+};
+
+// writes a new file, replacing any old one. call close to find out whether the last of it was written.
+class FileSink : public OutputSink
+{
+	public:
+		explicit FileSink(const std::string& filename);
+		~FileSink() override;
+
+		FileSink(const FileSink&) = delete;
+		FileSink& operator=(const FileSink&) = delete;
+
+		void write(const uint8_t* data, size_t size) override;
+		void close();
+
+	private:
+		std::string filename;
+		std::FILE* file;
+};
+
+} // namespace Export
+} // namespace XNA
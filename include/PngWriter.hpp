@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "OutputSink.hpp"
+
+namespace XNA {
+namespace Export {
+
+enum class PngFilter
+{
+	libpng_default,
+	none,
+	sub,
+	up,
+	average,
+	paeth,
+	adaptive, // per row, the filter with the smallest sum of absolute differences
+};
+
+struct PngOptions
+{
+	int compression_level = -1; // zlib level 0-9; -1 for the zlib default
+	PngFilter filter = PngFilter::libpng_default;
+
+	/*
+	if > 1, images of at least parallel_min_bytes are deflated in independent chunks on this many threads, of which
+	all but the calling one are started for the image. leave it at 1 when the caller already encodes images in parallel.
+	*/
+	unsigned int threads = 1;
+	uint_fast64_t parallel_min_bytes = 4 << 20;
+};
+
+// "default", "none", "sub", "up", "average", "paeth" or "adaptive"; throws xna_error for anything else
+PngFilter png_filter_from_string(const std::string& name);
+
+// 8-bit RGBA pixels, rows from the top
+void write_png_RGBA(OutputSink& sink, const uint8_t* buf, uint32_t width, uint32_t height, const PngOptions& options = PngOptions());
+
+} // namespace Export
+} // namespace XNA
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "Content.hpp"
+
+namespace XNA {
+namespace Content {
+
+/*
+converts between interleaved integer PCM and planar float32 in [-1, 1].
+8-bit samples are unsigned (128 is silence); 16, 24 and 32-bit samples are signed little-endian.
+up to 24 bits the round trip is exact; 32-bit samples keep the 24 most significant bits.
+planes holds one pointer per channel; frames are counted per channel.
+*/
+void deinterleave_to_float(const uint8_t* in, uint_fast32_t bits_per_sample, uint_fast32_t channel_count, size_t frames, float* const* planes);
+// values outside [-1, 1] are clamped and NaN becomes silence; rounds to nearest
+void interleave_from_float(const float* const* planes, uint_fast32_t bits_per_sample, uint_fast32_t channel_count, size_t frames, uint8_t* out);
+
+// PCM sounds only (decode ADPCM with AdpcmDecoder first)
+uint_fast64_t frame_count(const Sound& sound);
+// frames [first_frame, first_frame + frames) of the sound; consecutive calls can stream the sound in pieces
+void to_planar_float(const Sound& sound, uint_fast64_t first_frame, size_t frames, float* const* planes);
+std::vector<std::vector<float>> to_planar_float(const Sound& sound);
+// writes frames * block_align bytes in the sound's sample format
+void from_planar_float(const Sound& sound, const float* const* planes, size_t frames, uint8_t* out);
+
+} // namespace Content
+} // namespace XNA
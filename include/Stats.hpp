@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <stdint.h>
+
+/*
+per-stage timings and counters for finding out where a load spends its time. nothing is recorded until
+Stats::enable(true), and building with XNA_NO_STATS defined removes the instrumentation entirely (snapshots are then
+all zero). counters are shared by all threads.
+*/
+
+namespace XNA {
+namespace Stats {
+
+// stage times are inclusive: decompress contains lzx_decode, which contains decode_table
+enum class Stage : uint8_t
+{
+	file_read,		// reading an input file (timed by the caller, e.g. convertxnb)
+	xnb_read,		// XNB::read, the whole load
+	decompress,		// decoding LZX frames of an XNB body (during content for a partial read)
+	lzx_decode,		// LzxDecoder::Decompress
+	decode_table,	// LzxDecoder::MakeDecodeTable
+	lz4_decode,		// Lz4Decoder::Decompress
+	content,		// reading the objects of an XNB body
+	export_,		// converting and writing output (timed by the caller)
+	count
+};
+
+enum class Counter : uint8_t
+{
+	files,					// XNBs read
+	bytes_in,				// XNB file bytes
+	bytes_out,				// XNB body bytes, after decompression
+	lzx_frames,
+	lzx_verbatim_blocks,
+	lzx_aligned_blocks,
+	lzx_uncompressed_blocks,
+	decode_tables,			// Huffman decode tables built
+	allocations,			// buffers allocated for file data (bodies, windows, copies of content)
+	allocated_bytes,
+	objects,				// content objects read, including nested ones
+	count
+};
+
+const char* to_string(Stage stage);
+const char* to_string(Counter counter);
+
+struct Snapshot
+{
+	std::array<uint64_t, static_cast<size_t>(Stage::count)> stage_ns = {};
+	std::array<uint64_t, static_cast<size_t>(Stage::count)> stage_calls = {};
+	std::array<uint64_t, static_cast<size_t>(Counter::count)> counters = {};
+
+	uint64_t get(const Stage stage) const
+	{
+		return this->stage_ns[static_cast<size_t>(stage)];
+	}
+
+	uint64_t get(const Counter counter) const
+	{
+		return this->counters[static_cast<size_t>(counter)];
+	}
+};
+
+Snapshot snapshot();
+void reset();
+
+// a table of the stages that ran and the counters that are not zero
+void print(std::ostream& out, const Snapshot& snapshot);
+
+#ifdef XNA_NO_STATS
+
+inline void enable(bool)
+{
+}
+
+inline bool enabled()
+{
+	return false;
+}
+
+inline void add(Counter, uint_fast64_t = 1)
+{
+}
+
+inline void add_allocation(uint_fast64_t)
+{
+}
+
+class Timer
+{
+	public:
+		explicit Timer(Stage)
+		{
+		}
+};
+
+#else
+
+namespace detail {
+extern std::atomic<bool> enabled;
+void add(Counter counter, uint_fast64_t n);
+void add_time(Stage stage, uint64_t ns);
+} // namespace detail
+
+void enable(bool on);
+
+inline bool enabled()
+{
+	return detail::enabled.load(std::memory_order_relaxed);
+}
+
+inline void add(const Counter counter, const uint_fast64_t n = 1)
+{
+	if(enabled())
+	{
+		detail::add(counter, n);
+	}
+}
+
+inline void add_allocation(const uint_fast64_t bytes)
+{
+	if(enabled())
+	{
+		detail::add(Counter::allocations, 1);
+		detail::add(Counter::allocated_bytes, bytes);
+	}
+}
+
+// adds the time until it goes out of scope to a stage
+class Timer
+{
+	public:
+		explicit Timer(const Stage stage)
+		:
+			stage(stage),
+			running(enabled())
+		{
+			if(this->running)
+			{
+				this->start = std::chrono::steady_clock::now();
+			}
+		}
+
+		Timer(const Timer&) = delete;
+
+		~Timer()
+		{
+			if(this->running)
+			{
+				const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - this->start;
+				detail::add_time(this->stage, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+			}
+		}
+
+	private:
+		Stage stage;
+		bool running;
+		std::chrono::steady_clock::time_point start;
+};
+
+#endif
+
+} // namespace Stats
+} // namespace XNA
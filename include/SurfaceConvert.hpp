@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "Content.hpp"
+
+namespace XNA {
+namespace Content {
+
+// IEEE 754 binary16 to binary32; uses F16C when the CPU has it
+void half_to_float(const uint16_t* in, float* out, size_t count);
+
+// expands any readable surface format to 4 floats (RGBA) per pixel; missing channels become (0, 0, 1)
+std::vector<float> to_RGBA32F(Texture2D_SurfaceFormat format, const std::vector<uint8_t>& data);
+
+/*
+converts to 8 or 16 bits per channel RGBA. values are clamped to [0, 1] except:
+- half-float (HDR) formats are tone mapped with x*exposure / (1 + x*exposure)
+- signed formats (NormalizedByte2/4) are remapped from [-1, 1] to [0, 1]
+*/
+std::vector<uint8_t> to_RGBA8(Texture2D_SurfaceFormat format, const std::vector<uint8_t>& data, float exposure = 1.0f);
+std::vector<uint16_t> to_RGBA16(Texture2D_SurfaceFormat format, const std::vector<uint8_t>& data, float exposure = 1.0f);
+
+// in place on RGBA8888 pixels; unpremultiply leaves pixels with zero alpha unchanged
+void unpremultiply_RGBA8(uint8_t* data, size_t pixels);
+void premultiply_RGBA8(uint8_t* data, size_t pixels);
+
+} // namespace Content
+} // namespace XNA
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace XNA {
+
+// value types of Microsoft.Xna.Framework, laid out as they are stored in XNB files
+
+struct Rectangle
+{
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+};
+
+struct Vector2
+{
+	float x;
+	float y;
+};
+
+struct Vector3
+{
+	float x;
+	float y;
+	float z;
+};
+
+struct Vector4
+{
+	float x;
+	float y;
+	float z;
+	float w;
+};
+
+struct Point
+{
+	int32_t x;
+	int32_t y;
+};
+
+struct Color
+{
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+	uint8_t a;
+};
+
+struct Quaternion
+{
+	float x;
+	float y;
+	float z;
+	float w;
+};
+
+// row major: m[0] is M11 M12 M13 M14
+struct Matrix
+{
+	float m[4][4];
+};
+
+struct BoundingSphere
+{
+	Vector3 center;
+	float radius;
+};
+
+} // namespace XNA
@@ -0,0 +1,8 @@
+#pragma once
+
+namespace XNA {
+
+// changed whenever converting the same file can give different output, so that tools can tell old outputs are stale
+const char* const VERSION = "0.3.1";
+
+} // namespace XNA
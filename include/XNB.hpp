@@ -7,6 +7,8 @@
 #include <BinaryReader.hpp>
 
 #include "../include/Content.hpp"
+#include "../include/ContentReader.hpp"
+#include "../include/LzxDecoder.hpp"
 
 namespace XNA {
 namespace XNB {
@@ -14,7 +16,8 @@ namespace XNB {
 enum class Flag : uint8_t
 {
 	hidef = 0x01, // content is for HiDef profile (otherwise Reach)
-	compressed = 0x80,
+	lz4 = 0x40, // compressed with LZ4 (MonoGame)
+	compressed = 0x80, // compressed with LZX
 };
 
 using Flag_type = std::underlying_type<Flag>::type;
@@ -36,20 +39,101 @@ enum class Profile : uint8_t
 	HiDef = 1,
 };
 
+enum class Compression : uint8_t
+{
+	none,
+	lzx,
+	lz4,
+};
+
+// the body of an XNB (everything after the header) and what the header says about it
+struct Body
+{
+	std::shared_ptr<const uint8_t> data;
+	uint_fast64_t size;
+	Platform platform;
+	Profile profile;
+	Compression compression;
+	// how many leading bytes of data are valid: size, unless read_body was asked for less of a compressed body
+	uint_fast64_t decoded;
+};
+
+class BodyDecoder;
+
+// the decoder state at the start of an LZX frame of a compressed body
+struct SeekCheckpoint
+{
+	uint_fast64_t in_position;	// of the frame in the compressed data, which starts after the 14-byte header
+	uint_fast64_t out_position;	// of the frame's output in the body
+	LzxCheckpoint lzx;
+};
+
+/*
+decoder state every interval frames of a compressed body, so that reading from the middle of it (XNB::read_range)
+only decodes from the checkpoint before it. each one holds a 64 KiB window: with an interval of 16 frames (512 KiB of
+body), an index is about an eighth of the body size. the sizes are the only check that an index belongs to a file,
+so it should be rebuilt whenever the file changes.
+*/
+struct SeekIndex
+{
+	uint_fast64_t file_length = 0;
+	uint_fast64_t body_size = 0;
+	uint_fast32_t interval = 0;
+	std::vector<SeekCheckpoint> checkpoints; // by position
+};
+
+// a seek index as a file, e.g. to keep next to its XNB; decode_seek_index throws xna_error for a malformed one
+std::vector<uint8_t> encode_seek_index(const SeekIndex& index);
+SeekIndex decode_seek_index(const uint8_t* data, uint_fast64_t size);
+
+/*
+an XNB file around body, which is everything after the header: the type readers, the shared resource count and the
+objects. profile is stored in the flags.
+*/
+std::vector<uint8_t> encode(const uint8_t* body, uint_fast64_t body_size, Platform platform, Profile profile, Compression compression);
+
 class XNB
 {
 	public:
-		explicit XNB(BinaryReader& br);
+		explicit XNB(BinaryReader& br, const Content::ReadOptions& options = Content::ReadOptions());
 		~XNB();
 
+		/*
+		decompresses the body of the XNB in br without reading its content, e.g. to write it back with encode. LZX
+		frames are decoded in order until at least end bytes are valid (see Body::decoded), so a small end skips most
+		of the work; the default decodes and checks all of it.
+		*/
+		static Body read_body(BinaryReader& br, const Content::ReadOptions& options = Content::ReadOptions(), uint_fast64_t end = UINT64_MAX);
+
+		/*
+		decompresses the XNB in br without reading its content, adding what its LZX stream is made of to analysis;
+		an XNB that is not LZX compressed adds nothing
+		*/
+		static void analyze_lzx(BinaryReader& br, LzxAnalysis& analysis);
+
+		/*
+		decompresses the XNB in br, saving the decoder state before every interval-th LZX frame; an XNB that is not
+		LZX compressed, or one of no more than interval frames, gets an index without checkpoints, as it needs none
+		*/
+		static SeekIndex build_seek_index(BinaryReader& br, uint_fast32_t interval = 16);
+
+		/*
+		length bytes of the body of the XNB in br from offset. a compressed body is decoded from the last checkpoint in
+		index at or before offset, or from the start without an index.
+		*/
+		static std::vector<uint8_t> read_range(BinaryReader& br, uint_fast64_t offset, uint_fast64_t length, const SeekIndex* index = nullptr);
+
 		std::vector<std::pair<std::string, int32_t>> type_readers;
 		std::vector<std::shared_ptr<Content::ContentBase>> objects;
 		Platform platform;
+		// the most bytes the load held at once (see Content::MemoryBudget)
+		uint_fast64_t peak_memory;
 
 	private:
-		void read(BinaryReader& reader);
-		std::shared_ptr<Content::ContentBase> read_object(BinaryReader& reader);
-		static std::unique_ptr<uint8_t[]> decompress(std::unique_ptr<uint8_t[]> compressed, const uint_fast64_t compressed_size, const uint_fast64_t decompressed_size);
+		void read(BinaryReader& reader, const Content::ReadOptions& options);
+		void read_content(Content::ContentReader& reader, const Content::ReadOptions& options);
+		// a compressed body is left to decoder, with nothing decoded yet
+		static Body read_body(BinaryReader& reader, const Content::ReadOptions& options, Content::MemoryBudget& budget, std::unique_ptr<BodyDecoder>& decoder);
 };
 
 } // namespace XNB
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "../include/Content.hpp"
+#include "../include/MappedFile.hpp"
+
+namespace XNA {
+namespace XWB {
+
+// WAVEBANKMINIWAVEFORMAT format tags
+enum class WaveFormat : uint8_t
+{
+	PCM = 0,
+	XMA = 1,
+	ADPCM = 2,
+	WMA = 3,
+};
+std::string to_string(WaveFormat);
+
+struct Entry
+{
+	std::string name; // empty if the bank has no entry names
+	WaveFormat format;
+	uint16_t channel_count;
+	uint32_t sample_rate;
+	uint16_t block_align;
+	uint16_t bits_per_sample;
+	uint32_t duration; // samples; 0 if unknown (compact banks)
+	uint32_t offset; // bytes, from the start of the file
+	uint32_t length; // bytes
+	uint32_t loop_start; // samples
+	uint32_t loop_length; // samples
+};
+
+/*
+XACT 3 wave bank (.xwb), as built by XNA Game Studio 3.x/4.0.
+the file is memory mapped and only the header and entry table are read up front;
+wave data is handed out as views into the mapping.
+*/
+class WaveBank
+{
+	public:
+		explicit WaveBank(const std::string& filename);
+
+		std::string name;
+		bool streaming; // otherwise an in-memory bank
+		bool big_endian; // Xbox 360
+		std::vector<Entry> entries;
+
+		// index of the entry with this name, or entries.size()
+		std::size_t find(const std::string& entry_name) const;
+
+		// no copy: valid while this bank (or a Sound from get_sound) is alive
+		const uint8_t* get_wave_data(std::size_t i) const;
+
+		// PCM and ADPCM entries only; the Sound references the mapped file instead of copying
+		std::shared_ptr<Content::Sound> get_sound(std::size_t i) const;
+
+	private:
+		void read();
+
+		std::shared_ptr<const MappedFile> file;
+};
+
+} // namespace XWB
+} // namespace XNA
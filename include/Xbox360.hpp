@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace XNA {
+namespace Content {
+
+/*
+reverses the byte order of each unit-byte value in data, in place; size is a multiple of unit. units of 2, 4 and 8
+bytes use SSSE3 or AVX2 when the CPU has them.
+*/
+void byte_swap(uint8_t* data, size_t size, uint_fast32_t unit);
+
+/*
+Xbox 360 textures are stored tiled: in 32x32 tiles of blocks (pixels, or 4x4 pixel blocks for DXT), with the blocks
+in each tile in the order the GPU fetches them. width and height are in blocks; block_size is a power of 2 up to 16.
+*/
+// bytes of a tiled image: its width and height padded to whole tiles, and more for blocks of 1 or 2 bytes
+uint_fast64_t xbox360_tiled_size(uint_fast32_t width, uint_fast32_t height, uint_fast32_t block_size);
+// tiled (of xbox360_tiled_size bytes) to linear (of width * height * block_size bytes)
+void xbox360_untile(const uint8_t* tiled, uint8_t* linear, uint_fast32_t width, uint_fast32_t height, uint_fast32_t block_size);
+// linear to tiled, e.g. to make Xbox 360 content; the padding is left as it is
+void xbox360_tile(const uint8_t* linear, uint8_t* tiled, uint_fast32_t width, uint_fast32_t height, uint_fast32_t block_size);
+
+} // namespace Content
+} // namespace XNA
@@ -1,22 +1,56 @@
 #pragma once
 
 #include <stdexcept>
+#include <stdint.h>
 #include <string>
 
 class xna_error : public std::runtime_error
 {
 	public:
-		explicit xna_error(const std::string& what_arg);
+		static const uint_fast64_t NO_POSITION = UINT64_MAX;
+
+		explicit xna_error(const std::string& what_arg, uint_fast64_t position = NO_POSITION);
 		explicit xna_error(const char* what_arg);
 
 		virtual void dummy();
+
+		// byte offset of the error (see the subclasses for what it is an offset into); NO_POSITION if not known
+		uint_fast64_t position;
 };
 
+// position is an offset into the XNB file: the start of the LZX frame that could not be decoded
 class lzx_error : public xna_error
 {
 	public:
-		explicit lzx_error(const std::string& what_arg);
+		explicit lzx_error(const std::string& what_arg, uint_fast64_t position = NO_POSITION);
 		explicit lzx_error(const char* what_arg);
 
 		virtual void dummy();
 };
+
+// position is an offset into the XNB file: the start of the LZ4 sequence that could not be decoded
+class lz4_error : public xna_error
+{
+	public:
+		explicit lz4_error(const std::string& what_arg, uint_fast64_t position = NO_POSITION);
+
+		virtual void dummy();
+};
+
+// an error in the objects of an XNB; position is an offset into its (decompressed) body
+class content_error : public xna_error
+{
+	public:
+		content_error(const std::string& what_arg, uint_fast64_t position);
+
+		virtual void dummy();
+};
+
+// a load would hold more than ReadOptions::max_total_bytes (see Content::MemoryBudget); position is not known
+class memory_error : public xna_error
+{
+	public:
+		explicit memory_error(const std::string& what_arg);
+
+		virtual void dummy();
+};
@@ -0,0 +1,191 @@
+#include "AdpcmDecoder.hpp"
+
+#include <algorithm>
+#include <string>
+
+#include "xna_exception.hpp"
+
+namespace {
+
+const int32_t ADAPTATION_TABLE[16] =
+{
+	230, 230, 230, 230, 307, 409, 512, 614,
+	768, 614, 512, 409, 307, 230, 230, 230,
+};
+
+// decoder state of one channel; the coefficients are looked up once per block
+struct Lane
+{
+	int32_t coef1;
+	int32_t coef2;
+	int32_t delta;
+	int32_t sample1;
+	int32_t sample2;
+};
+
+inline int16_t decode_nibble(Lane& lane, const uint_fast8_t nibble)
+{
+	const int32_t signed_nibble = static_cast<int32_t>(nibble) - ((nibble & 8) << 1);
+	// in 64 bits: a file may give coefficients of -32768, and two products of -32768 * -32768 overflow int32
+	const int64_t prediction = (static_cast<int64_t>(lane.sample1) * lane.coef1 + static_cast<int64_t>(lane.sample2) * lane.coef2) >> 8;
+	const int32_t predicted = static_cast<int32_t>(std::min<int64_t>(std::max<int64_t>(prediction + static_cast<int64_t>(signed_nibble) * lane.delta, -32768), 32767));
+
+	lane.sample2 = lane.sample1;
+	lane.sample1 = predicted;
+	// the upper bound only matters for corrupt data, where delta would otherwise overflow
+	lane.delta = std::min(std::max((ADAPTATION_TABLE[nibble] * lane.delta) >> 8, 16), INT32_MAX / 768);
+	return static_cast<int16_t>(predicted);
+}
+
+inline int16_t read_int16(const uint8_t* p)
+{
+	return static_cast<int16_t>(p[0] | (p[1] << 8));
+}
+
+} // namespace
+
+AdpcmDecoder::AdpcmDecoder(const uint16_t channel_count, const uint16_t block_align, const uint16_t samples_per_block, const std::vector<XNA::Content::AdpcmCoefficient>& coefficients)
+:
+	channel_count(channel_count),
+	block_align(block_align),
+	samples_per_block(samples_per_block),
+	coefficients(coefficients)
+{
+	if(channel_count == 0)
+	{
+		throw xna_error("AdpcmDecoder: channel count is 0");
+	}
+	if(block_align <= 7 * channel_count)
+	{
+		throw xna_error("AdpcmDecoder: block_align is too small: " + std::to_string(block_align));
+	}
+	if(this->SamplesInBlock(block_align) != samples_per_block)
+	{
+		throw xna_error("AdpcmDecoder: samples per block does not match block_align");
+	}
+	if(coefficients.empty())
+	{
+		throw xna_error("AdpcmDecoder: no coefficients");
+	}
+}
+
+AdpcmDecoder::AdpcmDecoder(const XNA::Content::Sound& sound)
+:
+	AdpcmDecoder(sound.channel_count, sound.block_align, sound.samples_per_block, sound.adpcm_coefficients)
+{
+	if(sound.format != XNA::Content::SoundFormat::ADPCM)
+	{
+		throw xna_error("AdpcmDecoder: sound format is " + XNA::Content::to_string(sound.format));
+	}
+}
+
+uint_fast32_t AdpcmDecoder::SamplesInBlock(const uint_fast32_t block_size) const
+{
+	const uint_fast32_t header_size = 7u * this->channel_count;
+	if(block_size < header_size)
+	{
+		return 0;
+	}
+	// the header holds the first two samples; each following byte holds two nibbles
+	return (block_size - header_size) * 2 / this->channel_count + 2;
+}
+
+uint_fast64_t AdpcmDecoder::SamplesInStream(const uint_fast64_t size) const
+{
+	return (size / this->block_align) * this->samples_per_block + this->SamplesInBlock(static_cast<uint_fast32_t>(size % this->block_align));
+}
+
+uint_fast32_t AdpcmDecoder::DecodeBlock(const uint8_t* in, const uint_fast32_t in_len, int16_t* out) const
+{
+	if(in_len > this->block_align)
+	{
+		throw xna_error("AdpcmDecoder::DecodeBlock: block is larger than block_align (" + std::to_string(in_len) + " > " + std::to_string(this->block_align) + ")");
+	}
+	const uint_fast32_t channels = this->channel_count;
+	const uint_fast32_t samples = this->SamplesInBlock(in_len);
+	if(samples == 0)
+	{
+		throw xna_error("AdpcmDecoder::DecodeBlock: block is shorter than its header (" + std::to_string(in_len) + " bytes)");
+	}
+
+	// header: predictor[channels], delta[channels], sample1[channels], sample2[channels]
+	auto init_lane = [this, in, channels, out](const uint_fast32_t c, Lane& lane)
+	{
+		const uint_fast8_t predictor = in[c];
+		if(predictor >= this->coefficients.size())
+		{
+			throw xna_error("AdpcmDecoder::DecodeBlock: invalid predictor index " + std::to_string(predictor));
+		}
+		lane.coef1 = this->coefficients[predictor].coef1;
+		lane.coef2 = this->coefficients[predictor].coef2;
+		lane.delta = read_int16(in + channels + 2*c);
+		lane.sample1 = read_int16(in + 3*channels + 2*c);
+		lane.sample2 = read_int16(in + 5*channels + 2*c);
+
+		// sample2 is the older one and is output first
+		out[c] = static_cast<int16_t>(lane.sample2);
+		out[channels + c] = static_cast<int16_t>(lane.sample1);
+	};
+
+	const uint8_t* nibbles = in + 7*channels;
+	int16_t* dest = out + 2*channels;
+	const uint_fast32_t nibble_count = (samples - 2) * channels;
+	if(channels == 1)
+	{
+		Lane lane;
+		init_lane(0, lane);
+		for(uint_fast32_t i = 0; i < nibble_count / 2; ++i)
+		{
+			const uint_fast8_t b = nibbles[i];
+			dest[2*i] = decode_nibble(lane, b >> 4);
+			dest[2*i + 1] = decode_nibble(lane, b & 0xF);
+		}
+	}
+	else if(channels == 2)
+	{
+		// one byte holds a left and a right sample; both lanes stay in registers
+		Lane left;
+		Lane right;
+		init_lane(0, left);
+		init_lane(1, right);
+		for(uint_fast32_t i = 0; i < nibble_count / 2; ++i)
+		{
+			const uint_fast8_t b = nibbles[i];
+			dest[2*i] = decode_nibble(left, b >> 4);
+			dest[2*i + 1] = decode_nibble(right, b & 0xF);
+		}
+	}
+	else
+	{
+		std::vector<Lane> lanes(channels);
+		for(uint_fast32_t c = 0; c < channels; ++c)
+		{
+			init_lane(c, lanes[c]);
+		}
+		for(uint_fast32_t i = 0; i < nibble_count; ++i)
+		{
+			const uint_fast8_t b = nibbles[i / 2];
+			const uint_fast8_t nibble = (i % 2 == 0) ? (b >> 4) : (b & 0xF);
+			dest[i] = decode_nibble(lanes[i % channels], nibble);
+		}
+	}
+
+	return samples;
+}
+
+std::vector<int16_t> AdpcmDecoder::Decode(const uint8_t* in, const uint_fast64_t in_len) const
+{
+	const uint_fast64_t full_blocks = in_len / this->block_align;
+	const uint_fast32_t tail = static_cast<uint_fast32_t>(in_len % this->block_align);
+	std::vector<int16_t> out(this->SamplesInStream(in_len) * this->channel_count);
+	int16_t* dest = out.data();
+	for(uint_fast64_t i = 0; i < full_blocks; ++i)
+	{
+		dest += this->DecodeBlock(in + i * this->block_align, this->block_align, dest) * this->channel_count;
+	}
+	if(this->SamplesInBlock(tail) != 0)
+	{
+		this->DecodeBlock(in + full_blocks * this->block_align, tail, dest);
+	}
+	return out;
+}
@@ -1,5 +1,13 @@
 #include "Content.hpp"
 
+#include <algorithm>
+#include <array>
+
+#include "Generic.hpp"
+#include "Model.hpp"
+#include "Stats.hpp"
+#include "SurfaceConvert.hpp"
+#include "Xbox360.hpp"
 #include "xna_exception.hpp"
 
 namespace XNA {
@@ -35,6 +43,72 @@ std::string to_string(const Texture2D_SurfaceFormat f)
 	return to_string(static_cast<int32_t>(f));
 }
 
+// block-compressed formats have no per-pixel size and return 0
+uint_fast32_t bytes_per_pixel(const Texture2D_SurfaceFormat f)
+{
+	static const std::array<uint8_t, 20> sizes =
+	{{
+		4,	// RGBA8888
+		2,	// BGR565
+		2,	// BGRA5551
+		2,	// BGRA4444
+		0,	// DXT1
+		0,	// DXT3
+		0,	// DXT5
+		2,	// NormalizedByte2
+		4,	// NormalizedByte4
+		4,	// RGBA1010102
+		4,	// RG32
+		8,	// RGBA64
+		1,	// Alpha8
+		4,	// Single
+		8,	// Vector2
+		16,	// Vector4
+		2,	// HalfSingle
+		4,	// HalfVector2
+		8,	// HalfVector4
+		8,	// HdrBlendable
+	}};
+	const uint_fast32_t i = static_cast<uint_fast32_t>(f);
+	return (i < sizes.size()) ? sizes[i] : 0;
+}
+
+// bytes per 4x4 block of the block-compressed formats; 0 for the others
+uint_fast32_t dxt_block_size(const Texture2D_SurfaceFormat f)
+{
+	switch(f)
+	{
+		case Texture2D_SurfaceFormat::DXT1:	return 8;
+		case Texture2D_SurfaceFormat::DXT3:	return 16;
+		case Texture2D_SurfaceFormat::DXT5:	return 16;
+		default:							return 0;
+	}
+}
+
+namespace {
+
+// the size of the numbers texel data of format f is made of, which Xbox 360 content has byte-swapped
+uint_fast32_t swap_unit(const Texture2D_SurfaceFormat f)
+{
+	switch(f)
+	{
+		case Texture2D_SurfaceFormat::RGBA8888:
+		case Texture2D_SurfaceFormat::NormalizedByte4:
+		case Texture2D_SurfaceFormat::RGBA1010102:
+		case Texture2D_SurfaceFormat::Single:
+		case Texture2D_SurfaceFormat::Vector2:
+		case Texture2D_SurfaceFormat::Vector4:
+			return 4;
+		case Texture2D_SurfaceFormat::Alpha8:
+			return 1;
+		default:
+			// 16-bit pixels and channels, and the 16-bit colors and indexes of DXT blocks
+			return 2;
+	}
+}
+
+} // namespace
+
 std::string to_string(const SoundFormat f)
 {
 	switch(f)
@@ -45,7 +119,7 @@ std::string to_string(const SoundFormat f)
 	return to_string(static_cast<uint16_t>(f));
 }
 
-std::shared_ptr<ContentBase> ContentBase::Read(BinaryReader& reader, const std::string& type_reader_name)
+std::shared_ptr<ContentBase> ContentBase::Read(ContentReader& reader, const std::string& type_reader_name)
 {
 	if(type_reader_name == "Microsoft.Xna.Framework.Content.Texture2DReader")
 	{
@@ -55,6 +129,49 @@ std::shared_ptr<ContentBase> ContentBase::Read(BinaryReader& reader, const std::
 	{
 		return std::make_shared<Sound>(reader);
 	}
+	if(type_reader_name == "Microsoft.Xna.Framework.Content.SpriteFontReader")
+	{
+		return std::make_shared<SpriteFont>(reader);
+	}
+	if(type_reader_name == "Microsoft.Xna.Framework.Content.ModelReader")
+	{
+		std::shared_ptr<Model> model = std::make_shared<Model>(reader);
+		// the shared resources come after the model, which keeps their ids until then
+		reader.AddSharedResourceFixup([model](const std::vector<std::shared_ptr<ContentBase>>& shared_resources)
+		{
+			model->resolve_shared_resources(shared_resources);
+		});
+		return model;
+	}
+	if(type_reader_name == "Microsoft.Xna.Framework.Content.VertexBufferReader")
+	{
+		return std::make_shared<VertexBuffer>(reader);
+	}
+	if(type_reader_name == "Microsoft.Xna.Framework.Content.IndexBufferReader")
+	{
+		return std::make_shared<IndexBuffer>(reader);
+	}
+	if(type_reader_name == "Microsoft.Xna.Framework.Content.VertexDeclarationReader")
+	{
+		return std::make_shared<VertexDeclaration>(reader);
+	}
+	if(type_reader_name == "Microsoft.Xna.Framework.Content.EffectReader")
+	{
+		return std::make_shared<Effect>(reader);
+	}
+	if(type_reader_name == "Microsoft.Xna.Framework.Content.BasicEffectReader")
+	{
+		return std::make_shared<BasicEffect>(reader);
+	}
+	if(type_reader_name == "Microsoft.Xna.Framework.Content.EffectMaterialReader")
+	{
+		return std::make_shared<EffectMaterial>(reader);
+	}
+	std::shared_ptr<ContentBase> generic = read_generic(reader, type_reader_name);
+	if(generic != nullptr)
+	{
+		return generic;
+	}
 	throw xna_error("unknown type reader: " + type_reader_name);
 }
 
@@ -63,13 +180,13 @@ std::string ContentBase::get_type_reader_name()
 	return this->type_reader_name;
 }
 
-Texture2D::Texture2D(BinaryReader& reader)
+Texture2D::Texture2D(ContentReader& reader)
 {
 	this->type_reader_name = "Microsoft.Xna.Framework.Content.Texture2DReader";
 	this->read(reader);
 }
 
-std::vector<uint8_t> Texture2D::get_mip_data(uint_fast32_t i)
+const std::vector<uint8_t>& Texture2D::get_mip_data(uint_fast32_t i) const
 {
 	if(i >= this->mips.size())
 	{
@@ -78,16 +195,50 @@ std::vector<uint8_t> Texture2D::get_mip_data(uint_fast32_t i)
 	return this->mips[i];
 }
 
-std::pair<uint32_t, uint32_t> Texture2D::get_mip_size(uint_fast32_t i)
+std::pair<uint32_t, uint32_t> Texture2D::get_mip_size(uint_fast32_t i) const
 {
 	if(i >= this->mips.size())
 	{
 		throw xna_error("invalid mip index (" + to_string(i) + ")");
 	}
-	return std::make_pair(this->width >> i, this->height >> i);
+	return std::make_pair(std::max(this->width >> i, 1u), std::max(this->height >> i, 1u));
+}
+
+uint_fast32_t Texture2D::get_mip_count() const
+{
+	return this->mips.size();
+}
+
+Texture2D_SurfaceFormat Texture2D::get_surface_format() const
+{
+	return this->surface_format;
+}
+
+void Texture2D::unpremultiply_alpha()
+{
+	if(this->surface_format != Texture2D_SurfaceFormat::RGBA8888)
+	{
+		throw xna_error("cannot unpremultiply alpha of surface format " + to_string(this->surface_format));
+	}
+	for(std::vector<uint8_t>& mip : this->mips)
+	{
+		unpremultiply_RGBA8(mip.data(), mip.size() / 4);
+	}
+}
+
+void Texture2D::premultiply_alpha()
+{
+	if(this->surface_format != Texture2D_SurfaceFormat::RGBA8888)
+	{
+		throw xna_error("cannot premultiply alpha of surface format " + to_string(this->surface_format));
+	}
+	for(std::vector<uint8_t>& mip : this->mips)
+	{
+		premultiply_RGBA8(mip.data(), mip.size() / 4);
+	}
 }
 
-void Texture2D::read(BinaryReader& reader)
+void Texture2D::read(ContentReader& reader)
 {
 	const int32_t surface_format_i = reader.ReadInt32();
 	this->surface_format = static_cast<Texture2D_SurfaceFormat>(surface_format_i);
@@ -95,60 +246,145 @@ void Texture2D::read(BinaryReader& reader)
 	this->height = reader.ReadUInt32();
 	const uint32_t mip_count = reader.ReadUInt32();
 
-	switch(surface_format)
+	const uint_fast32_t pixel_size = bytes_per_pixel(surface_format);
+	const uint_fast32_t block_size = dxt_block_size(surface_format);
+	if(pixel_size == 0 && block_size == 0)
 	{
-		case Texture2D_SurfaceFormat::RGBA8888:
-		{
-			break;
-		}
-		default:
-		{
-			throw xna_error("unsupported surface format: " + to_string(surface_format));
-		}
+		throw xna_error("unsupported surface format: " + to_string(surface_format));
+	}
+	if((width == 0) || (height == 0))
+	{
+		throw xna_error("image dimensions are invalid");
+	}
+	if(mip_count > 32)
+	{
+		throw xna_error("invalid mip count: " + to_string(mip_count));
 	}
 
 	for(uint_fast32_t i = 0; i < mip_count; ++i)
 	{
+		if(i >= reader.GetOptions().max_mip_count && !reader.IsBigEndian())
+		{
+			// skipped mips are not read, so their size prefixes are trusted to match the dimensions
+			const uint_fast64_t mip_width = std::max(width >> i, 1u);
+			const uint_fast64_t mip_height = std::max(height >> i, 1u);
+			const uint_fast64_t expected_size = (block_size != 0) ? ((mip_width + 3) / 4) * ((mip_height + 3) / 4) * block_size : mip_width * mip_height * pixel_size;
+			reader.Skip(4 + expected_size);
+			continue;
+		}
 		const uint32_t mip_size = reader.ReadUInt32();
-		if(mip_size % 4 != 0)
+		if(i >= reader.GetOptions().max_mip_count)
 		{
-			throw xna_error("image data size is not a multiple of 4");
+			// an Xbox 360 mip may or may not be tiled, so only its size prefix says how big it is
+			reader.Skip(mip_size);
+			continue;
 		}
-		// TODO: will floor ever cause the third check to be wrong?
-		if((width == 0) || (height == 0) || (width > UINT32_MAX / 4 / height))
+		if(mip_size > reader.GetOptions().max_mip_size)
 		{
-			throw xna_error("image dimensions are invalid");
+			throw xna_error("mip " + to_string(i) + " size (" + to_string(mip_size) + ") is over the limit (" + to_string(reader.GetOptions().max_mip_size) + ")");
 		}
-		if(width * height != mip_size / 4)
+		if(reader.IsBigEndian())
+		{
+			this->mips.push_back(this->read_xbox360_mip(reader, i, mip_size));
+			continue;
+		}
+		if(block_size != 0)
+		{
+			// 4x4 pixel blocks; partial blocks at the edges are padded
+			const uint_fast64_t blocks_wide = (std::max(width >> i, 1u) + 3) / 4;
+			const uint_fast64_t blocks_high = (std::max(height >> i, 1u) + 3) / 4;
+			if(blocks_wide * blocks_high * block_size != mip_size)
+			{
+				throw xna_error("image dimensions and data size do not match");
+			}
+			this->mips.push_back(reader.ReadBytes(mip_size));
+			continue;
+		}
+		if(mip_size % pixel_size != 0)
+		{
+			throw xna_error("image data size is not a multiple of " + to_string(pixel_size));
+		}
+		const uint_fast64_t mip_width = std::max(width >> i, 1u);
+		const uint_fast64_t mip_height = std::max(height >> i, 1u);
+		if(mip_width * mip_height != mip_size / pixel_size)
 		{
 			throw xna_error("image dimensions and data size do not match");
 		}
-		std::unique_ptr<uint8_t[]> mip_data(reader.ReadBytes(mip_size));
-		std::vector<uint8_t> mip_data_vec(mip_data.get(), mip_data.get() + mip_size);
-		this->mips.push_back(mip_data_vec);
+		this->mips.push_back(reader.ReadBytes(mip_size));
+	}
+}
+
+std::vector<uint8_t> Texture2D::read_xbox360_mip(ContentReader& reader, const uint_fast32_t i, const uint32_t mip_size)
+{
+	// blocks are pixels, or 4x4 pixel blocks for DXT
+	const uint_fast32_t block_size = dxt_block_size(this->surface_format);
+	const uint_fast32_t unit_size = (block_size != 0) ? block_size : bytes_per_pixel(this->surface_format);
+	const uint_fast32_t mip_width = std::max(this->width >> i, 1u);
+	const uint_fast32_t mip_height = std::max(this->height >> i, 1u);
+	const uint_fast32_t blocks_wide = (block_size != 0) ? (mip_width + 3) / 4 : mip_width;
+	const uint_fast32_t blocks_high = (block_size != 0) ? (mip_height + 3) / 4 : mip_height;
+	const uint_fast64_t linear_size = static_cast<uint_fast64_t>(blocks_wide) * blocks_high * unit_size;
+
+	// a mip of whole tiles is the same size either way, and is tiled
+	std::vector<uint8_t> data;
+	if(mip_size == xbox360_tiled_size(blocks_wide, blocks_high, unit_size) && reader.GetOptions().untile_xbox360_textures)
+	{
+		const uint8_t* tiled = reader.ReadView(mip_size);
+		reader.GetBudget().allocate(linear_size, "untiled copy of content data");
+		Stats::add_allocation(linear_size);
+		data.resize(linear_size);
+		xbox360_untile(tiled, data.data(), blocks_wide, blocks_high, unit_size);
 	}
+	else if(mip_size == linear_size || mip_size == xbox360_tiled_size(blocks_wide, blocks_high, unit_size))
+	{
+		data = reader.ReadBytes(mip_size);
+	}
+	else
+	{
+		throw xna_error("image dimensions and data size do not match");
+	}
+	byte_swap(data.data(), data.size(), swap_unit(this->surface_format));
+	return data;
 }
 
-Sound::Sound(BinaryReader& reader)
+Sound::Sound(ContentReader& reader)
 {
 	this->type_reader_name = "Microsoft.Xna.Framework.Content.SoundEffectReader";
 	this->read(reader);
 }
 
-void Sound::read(BinaryReader& reader)
+Sound::Sound(const SoundFormat format, const uint16_t channel_count, const uint32_t sample_rate, const uint16_t block_align, const uint16_t bits_per_sample, std::vector<uint8_t> extra_info, std::shared_ptr<const uint8_t> data, const uint32_t data_size)
+:
+	channel_count(channel_count),
+	sample_rate(sample_rate),
+	average_byte_rate(sample_rate * block_align),
+	block_align(block_align),
+	bits_per_sample(bits_per_sample),
+	format(format),
+	loop_start(0),
+	loop_length(0),
+	loop_duration(0),
+	extra_info(std::move(extra_info)),
+	data_ref(std::move(data)),
+	data_size(data_size)
+{
+	this->type_reader_name = "Microsoft.Xna.Framework.Content.SoundEffectReader";
+	this->check_format();
+	// for ADPCM, the byte rate is that of the compressed data
+	this->average_byte_rate = sample_rate * block_align / samples_per_block;
+}
+
+void Sound::read(ContentReader& reader)
 {
+	// WAVEFORMATEX, optionally followed by cbSize bytes of format-specific data
 	const uint32_t format_size = reader.ReadUInt32();
-	if(format_size != 18)
+	if(format_size < 18)
 	{
 		throw xna_error("unhandled format header size: " + to_string(format_size));
 	}
 
 	const uint16_t format_i = reader.ReadUInt16();
 	this->format = static_cast<SoundFormat>(format_i);
-	if(this->format != SoundFormat::PCM)
-	{
-		throw xna_error("unhandled sound format: " + to_string(this->format));
-	}
 
 	// see https://msdn.microsoft.com/en-us/library/windows/desktop/dd390970%28v=vs.85%29.aspx
 	this->channel_count = reader.ReadUInt16();
@@ -156,35 +392,38 @@ void Sound::read(BinaryReader& reader)
 	this->average_byte_rate = reader.ReadUInt32();
 	this->block_align = reader.ReadUInt16();
 	this->bits_per_sample = reader.ReadUInt16();
-	if(bits_per_sample % 8 != 0)
-	{
-		throw xna_error("bits per sample is not a multiple of 8: " + to_string(bits_per_sample));
-	}
-	const uint16_t bytes_per_sample = bits_per_sample / 8;
-
-	if(average_byte_rate != sample_rate * channel_count * bytes_per_sample)
-	{
-		throw xna_error("average_byte_rate does not match sample_rate * channel_count * bits_per_sample / 8");
-	}
 
-	if(block_align != channel_count * bytes_per_sample)
+	const uint16_t extra_info_size = reader.ReadUInt16();
+	if(extra_info_size != format_size - 18)
 	{
-		throw xna_error("block_align does not match channel_count * bits_per_sample / 8");
+		throw xna_error("extra info size (" + to_string(extra_info_size) + ") does not match format header size (" + to_string(format_size) + ")");
 	}
-
-	const uint16_t extra_info_size = reader.ReadUInt16();
 	if(extra_info_size != 0)
 	{
-		throw xna_error("extra info size is " + to_string(extra_info_size));
+		this->extra_info = reader.ReadBytes(extra_info_size);
 	}
 
-	const uint32_t data_size = reader.ReadUInt32();
+	this->check_format();
+
+	this->data_size = reader.ReadUInt32();
 	if(data_size == 0)
 	{
 		throw xna_error("sound is empty");
 	}
-	std::unique_ptr<uint8_t[]> data_ptr(reader.ReadBytes(data_size));
-	this->data = std::vector<uint8_t>(data_ptr.get(), data_ptr.get() + data_size);
+	// Xbox 360 PCM samples are big-endian; ADPCM blocks are the same everywhere
+	const uint_fast32_t sample_unit = (this->format == SoundFormat::PCM) ? this->bits_per_sample / 8u : 1;
+	if(reader.GetOptions().copy_sound_data)
+	{
+		this->data = reader.ReadBytes(data_size);
+		if(reader.IsBigEndian())
+		{
+			byte_swap(this->data.data(), this->data.size(), sample_unit);
+		}
+	}
+	else
+	{
+		this->data_ref = reader.ReadSwapped(data_size, sample_unit);
+	}
 
 	// TOOD: start and length 'must be format block aligned'
 	this->loop_start = reader.ReadUInt32();
@@ -192,7 +431,406 @@ void Sound::read(BinaryReader& reader)
 	this->loop_duration = reader.ReadUInt32();
 }
 
+void Sound::check_format()
+{
+	if(this->format != SoundFormat::PCM && this->format != SoundFormat::ADPCM)
+	{
+		throw xna_error("unhandled sound format: " + to_string(this->format));
+	}
+	if(this->channel_count == 0)
+	{
+		throw xna_error("channel count is 0");
+	}
+	if(this->format == SoundFormat::ADPCM)
+	{
+		this->read_adpcm_format();
+	}
+	else
+	{
+		if(bits_per_sample % 8 != 0)
+		{
+			throw xna_error("bits per sample is not a multiple of 8: " + to_string(bits_per_sample));
+		}
+		const uint16_t bytes_per_sample = bits_per_sample / 8;
+
+		if(average_byte_rate != sample_rate * channel_count * bytes_per_sample)
+		{
+			throw xna_error("average_byte_rate does not match sample_rate * channel_count * bits_per_sample / 8");
+		}
+
+		if(block_align != channel_count * bytes_per_sample)
+		{
+			throw xna_error("block_align does not match channel_count * bits_per_sample / 8");
+		}
+
+		if(!extra_info.empty())
+		{
+			throw xna_error("extra info size is " + to_string(extra_info.size()));
+		}
+		this->samples_per_block = 1;
+	}
+}
+
+const uint8_t* Sound::get_data() const
+{
+	return (this->data_ref != nullptr) ? this->data_ref.get() : this->data.data();
+}
+
+uint32_t Sound::get_data_size() const
+{
+	return this->data_size;
+}
+
+// see https://msdn.microsoft.com/en-us/library/windows/desktop/dd757713%28v=vs.85%29.aspx (ADPCMWAVEFORMAT)
+void Sound::read_adpcm_format()
+{
+	if(bits_per_sample != 4)
+	{
+		throw xna_error("ADPCM bits per sample is not 4: " + to_string(bits_per_sample));
+	}
+	if(channel_count == 0)
+	{
+		throw xna_error("ADPCM channel count is 0");
+	}
+	// each block starts with a 7-byte header per channel
+	if(block_align <= 7 * channel_count)
+	{
+		throw xna_error("ADPCM block_align is too small: " + to_string(block_align));
+	}
+	if(extra_info.size() < 4)
+	{
+		throw xna_error("ADPCM extra info is too small: " + to_string(extra_info.size()));
+	}
+
+	auto read_u16 = [this](const std::size_t pos)
+	{
+		return static_cast<uint16_t>(extra_info[pos] | (extra_info[pos + 1] << 8));
+	};
+
+	this->samples_per_block = read_u16(0);
+	const uint_fast32_t expected_samples = (block_align - 7u * channel_count) * 2u / channel_count + 2u;
+	if(samples_per_block != expected_samples)
+	{
+		throw xna_error("ADPCM samples per block (" + to_string(samples_per_block) + ") does not match block_align (expected " + to_string(expected_samples) + ")");
+	}
+
+	const uint16_t coefficient_count = read_u16(2);
+	// the 7 standard coefficient pairs must be present
+	if(coefficient_count < 7 || extra_info.size() != 4 + 4u * coefficient_count)
+	{
+		throw xna_error("ADPCM coefficient count (" + to_string(coefficient_count) + ") does not match extra info size (" + to_string(extra_info.size()) + ")");
+	}
+	this->adpcm_coefficients.resize(coefficient_count);
+	for(uint_fast32_t i = 0; i < coefficient_count; ++i)
+	{
+		this->adpcm_coefficients[i].coef1 = static_cast<int16_t>(read_u16(4 + 4*i));
+		this->adpcm_coefficients[i].coef2 = static_cast<int16_t>(read_u16(4 + 4*i + 2));
+	}
+}
+
+namespace {
+
+// reads the type id and count of a List<element_type>; each element takes at least min_element_size bytes
+uint32_t read_list_header(ContentReader& reader, const std::string& element_type, const uint_fast32_t min_element_size)
+{
+	const std::string type_reader_name = reader.ReadTypeReaderName();
+	if(type_reader_name != "Microsoft.Xna.Framework.Content.ListReader`1[[" + element_type + "]]")
+	{
+		throw xna_error("expected a list of " + element_type + ", got " + (type_reader_name.empty() ? "null" : type_reader_name));
+	}
+	const uint32_t count = reader.ReadUInt32();
+	// checked before anything is allocated for the elements
+	if(static_cast<uint_fast64_t>(count) * min_element_size > reader.GetRemaining())
+	{
+		throw xna_error("list of " + to_string(count) + " " + element_type + " is larger than the remaining data");
+	}
+	return count;
+}
+
+Rectangle read_rectangle(ContentReader& reader)
+{
+	Rectangle r;
+	r.x = reader.ReadInt32();
+	r.y = reader.ReadInt32();
+	r.width = reader.ReadInt32();
+	r.height = reader.ReadInt32();
+	return r;
+}
+
+// decodes UTF-8 one character at a time; invalid sequences become U+FFFD
+struct Utf8Cursor
+{
+	const uint8_t* p;
+	const uint8_t* end;
+
+	bool next(char32_t& c)
+	{
+		if(this->p == this->end)
+		{
+			return false;
+		}
+		const uint8_t lead = *this->p++;
+		if(lead < 0x80)
+		{
+			c = lead;
+			return true;
+		}
+		uint_fast32_t continuation;
+		if((lead & 0xE0) == 0xC0)
+		{
+			continuation = 1;
+			c = lead & 0x1F;
+		}
+		else if((lead & 0xF0) == 0xE0)
+		{
+			continuation = 2;
+			c = lead & 0x0F;
+		}
+		else if((lead & 0xF8) == 0xF0)
+		{
+			continuation = 3;
+			c = lead & 0x07;
+		}
+		else
+		{
+			c = 0xFFFD;
+			return true;
+		}
+		for(uint_fast32_t i = 0; i < continuation; ++i)
+		{
+			if(this->p == this->end || (*this->p & 0xC0) != 0x80)
+			{
+				c = 0xFFFD;
+				return true;
+			}
+			c = (c << 6) | (*this->p++ & 0x3F);
+		}
+		return true;
+	}
+};
+
+struct Utf32Cursor
+{
+	const char32_t* p;
+	const char32_t* end;
+
+	bool next(char32_t& c)
+	{
+		if(this->p == this->end)
+		{
+			return false;
+		}
+		c = *this->p++;
+		return true;
+	}
+};
+
+} // namespace
+
+SpriteFont::SpriteFont(ContentReader& reader)
+{
+	this->type_reader_name = "Microsoft.Xna.Framework.Content.SpriteFontReader";
+	this->read(reader);
+}
+
+void SpriteFont::read(ContentReader& reader)
+{
+	const std::string texture_reader = reader.ReadTypeReaderName();
+	if(texture_reader != "Microsoft.Xna.Framework.Content.Texture2DReader")
+	{
+		throw xna_error("expected a texture, got " + (texture_reader.empty() ? "null" : texture_reader));
+	}
+	this->texture = std::make_shared<Texture2D>(reader);
+
+	const uint32_t glyph_count = read_list_header(reader, "Microsoft.Xna.Framework.Rectangle", 16);
+	this->glyphs.resize(glyph_count);
+	for(Glyph& glyph : this->glyphs)
+	{
+		glyph.bounds = read_rectangle(reader);
+	}
+
+	if(read_list_header(reader, "Microsoft.Xna.Framework.Rectangle", 16) != glyph_count)
+	{
+		throw xna_error("number of cropping rectangles does not match number of glyphs");
+	}
+	for(Glyph& glyph : this->glyphs)
+	{
+		glyph.cropping = read_rectangle(reader);
+	}
 
+	if(read_list_header(reader, "System.Char", 1) != glyph_count)
+	{
+		throw xna_error("number of characters does not match number of glyphs");
+	}
+	this->characters.resize(glyph_count);
+	for(char32_t& c : this->characters)
+	{
+		c = reader.ReadChar();
+	}
+
+	this->line_spacing = reader.ReadInt32();
+	this->spacing = reader.ReadFloat();
+
+	// x: left side bearing, y: width, z: right side bearing
+	if(read_list_header(reader, "Microsoft.Xna.Framework.Vector3", 12) != glyph_count)
+	{
+		throw xna_error("number of kerning entries does not match number of glyphs");
+	}
+	for(Glyph& glyph : this->glyphs)
+	{
+		glyph.left_side_bearing = reader.ReadFloat();
+		glyph.width = reader.ReadFloat();
+		glyph.right_side_bearing = reader.ReadFloat();
+	}
+
+	// Nullable<char>: a value type, so no type id
+	this->has_default_character = reader.ReadBoolean();
+	this->default_character = this->has_default_character ? reader.ReadChar() : 0;
+
+	this->build_index();
+}
+
+void SpriteFont::build_index()
+{
+	this->latin1_glyphs.fill(0);
+	this->other_glyphs.clear();
+	for(uint32_t i = 0; i < this->characters.size(); ++i)
+	{
+		const char32_t c = this->characters[i];
+		if(c < this->latin1_glyphs.size())
+		{
+			this->latin1_glyphs[c] = i + 1;
+		}
+		else
+		{
+			this->other_glyphs.emplace_back(c, i + 1);
+		}
+	}
+	std::sort(this->other_glyphs.begin(), this->other_glyphs.end());
+
+	this->default_glyph = 0;
+	if(this->has_default_character)
+	{
+		const Glyph* glyph = this->find_glyph(this->default_character);
+		if(glyph == nullptr)
+		{
+			throw xna_error("default character " + to_string(static_cast<uint32_t>(this->default_character)) + " is not in the font");
+		}
+		this->default_glyph = static_cast<uint32_t>(glyph - this->glyphs.data()) + 1;
+	}
+}
+
+const std::vector<char32_t>& SpriteFont::get_characters() const
+{
+	return this->characters;
+}
+
+const std::vector<Glyph>& SpriteFont::get_glyphs() const
+{
+	return this->glyphs;
+}
+
+const Glyph* SpriteFont::find_glyph(const char32_t c) const
+{
+	uint32_t index = 0;
+	if(c < this->latin1_glyphs.size())
+	{
+		index = this->latin1_glyphs[c];
+	}
+	else
+	{
+		const auto i = std::lower_bound(this->other_glyphs.begin(), this->other_glyphs.end(), c, [](const std::pair<char32_t, uint32_t>& a, const char32_t b)
+		{
+			return a.first < b;
+		});
+		if(i != this->other_glyphs.end() && i->first == c)
+		{
+			index = i->second;
+		}
+	}
+	return (index != 0) ? &this->glyphs[index - 1] : nullptr;
+}
+
+const Glyph& SpriteFont::glyph_or_default(const char32_t c) const
+{
+	const Glyph* glyph = this->find_glyph(c);
+	if(glyph != nullptr)
+	{
+		return *glyph;
+	}
+	if(this->default_glyph == 0)
+	{
+		throw xna_error("character " + to_string(static_cast<uint32_t>(c)) + " is not in the font and there is no default character");
+	}
+	return this->glyphs[this->default_glyph - 1];
+}
+
+// as XNA's SpriteFont.InternalMeasure: a line is as wide as where its last glyph ends, and the text as its widest line
+template <typename Cursor> Vector2 SpriteFont::measure(Cursor cursor) const
+{
+	const float line_height = static_cast<float>(this->line_spacing);
+	float widest_line = 0;
+	float x = 0;
+	// of the previous glyph on the line; it only counts once another glyph follows, or at the end of the line
+	float right_side_bearing = 0;
+	float final_line_height = line_height;
+	uint_fast32_t full_lines = 0;
+	bool first_glyph_of_line = true;
+	bool empty = true;
+
+	char32_t c;
+	while(cursor.next(c))
+	{
+		empty = false;
+		if(c == '\r')
+		{
+			continue;
+		}
+		if(c == '\n')
+		{
+			widest_line = std::max(widest_line, x + std::max(right_side_bearing, 0.0f));
+			++full_lines;
+			final_line_height = line_height;
+			x = 0;
+			right_side_bearing = 0;
+			first_glyph_of_line = true;
+			continue;
+		}
+
+		const Glyph& glyph = this->glyph_or_default(c);
+		// a negative left side bearing on the first glyph of a line does not extend the text to the left
+		if(first_glyph_of_line)
+		{
+			x += std::max(glyph.left_side_bearing, 0.0f);
+			first_glyph_of_line = false;
+		}
+		else
+		{
+			x += this->spacing + right_side_bearing + glyph.left_side_bearing;
+		}
+		x += glyph.width;
+		right_side_bearing = glyph.right_side_bearing;
+		final_line_height = std::max(final_line_height, static_cast<float>(glyph.cropping.height));
+	}
+
+	if(empty)
+	{
+		return Vector2{0, 0};
+	}
+	const float width = std::max(widest_line, x + std::max(right_side_bearing, 0.0f));
+	return Vector2{width, static_cast<float>(full_lines) * line_height + final_line_height};
+}
+
+Vector2 SpriteFont::MeasureString(const std::string& text) const
+{
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(text.data());
+	return this->measure(Utf8Cursor{p, p + text.size()});
+}
+
+Vector2 SpriteFont::MeasureString(const std::u32string& text) const
+{
+	return this->measure(Utf32Cursor{text.data(), text.data() + text.size()});
+}
 
 } // namespace Content
 } // namespace XNA
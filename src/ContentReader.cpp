@@ -0,0 +1,423 @@
+#include "ContentReader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Content.hpp"
+#include "Stats.hpp"
+#include "Xbox360.hpp"
+#include "xna_exception.hpp"
+
+namespace XNA {
+namespace Content {
+
+using std::to_string;
+
+MemoryBudget::MemoryBudget(const uint_fast64_t limit)
+:
+	limit(limit),
+	current(0),
+	peak(0)
+{
+}
+
+void MemoryBudget::allocate(const uint_fast64_t bytes, const std::string& what)
+{
+	if(bytes > this->limit - this->current)
+	{
+		throw memory_error(what + " of " + to_string(bytes) + " bytes is over the memory limit (" + to_string(this->current) + " of " + to_string(this->limit) + " bytes in use)");
+	}
+	this->current += bytes;
+	this->peak = std::max(this->peak, this->current);
+}
+
+void MemoryBudget::release(const uint_fast64_t bytes)
+{
+	this->current -= std::min(bytes, this->current);
+}
+
+uint_fast64_t MemoryBudget::get_current() const
+{
+	return this->current;
+}
+
+uint_fast64_t MemoryBudget::get_peak() const
+{
+	return this->peak;
+}
+
+ContentReader::ContentReader(std::shared_ptr<const uint8_t> buffer, const uint_fast64_t size, const ReadOptions& options)
+:
+	ContentReader(std::move(buffer), size, options, MemoryBudget(options.max_total_bytes))
+{
+}
+
+ContentReader::ContentReader(std::shared_ptr<const uint8_t> buffer, const uint_fast64_t size, const ReadOptions& options, const MemoryBudget& budget)
+:
+	buffer(std::move(buffer)),
+	size(size),
+	position(0),
+	available(size),
+	options(options),
+	budget(budget),
+	object_count(0),
+	big_endian(false),
+	unresolved_shared_resources(0)
+{
+}
+
+ContentReader::ContentReader(std::shared_ptr<const uint8_t> buffer, const uint_fast64_t size, const ReadOptions& options, const MemoryBudget& budget, std::function<uint_fast64_t(uint_fast64_t end)> fill)
+:
+	ContentReader(std::move(buffer), size, options, budget)
+{
+	this->available = 0;
+	this->fill = std::move(fill);
+}
+
+uint_fast64_t ContentReader::GetSize() const
+{
+	return this->size;
+}
+
+uint_fast64_t ContentReader::GetPosition() const
+{
+	return this->position;
+}
+
+uint_fast64_t ContentReader::GetRemaining() const
+{
+	return this->size - this->position;
+}
+
+const ReadOptions& ContentReader::GetOptions() const
+{
+	return this->options;
+}
+
+MemoryBudget& ContentReader::GetBudget()
+{
+	return this->budget;
+}
+
+void ContentReader::SetBigEndian(const bool big_endian)
+{
+	this->big_endian = big_endian;
+}
+
+bool ContentReader::IsBigEndian() const
+{
+	return this->big_endian;
+}
+
+void ContentReader::require(const uint_fast64_t length)
+{
+	if(length > this->size - this->position)
+	{
+		throw xna_error("ContentReader: read of " + to_string(length) + " bytes at position " + to_string(this->position) + " is past the end (" + to_string(this->size) + ")");
+	}
+	if(this->position + length > this->available)
+	{
+		this->available = this->fill(this->position + length);
+	}
+}
+
+void ContentReader::Skip(const uint_fast64_t length)
+{
+	if(length > this->size - this->position)
+	{
+		throw xna_error("ContentReader: skip of " + to_string(length) + " bytes at position " + to_string(this->position) + " is past the end (" + to_string(this->size) + ")");
+	}
+	this->position += length;
+}
+
+uint8_t ContentReader::ReadUInt8()
+{
+	this->require(1);
+	return this->buffer.get()[this->position++];
+}
+
+int8_t ContentReader::ReadInt8()
+{
+	return static_cast<int8_t>(this->ReadUInt8());
+}
+
+uint16_t ContentReader::ReadUInt16()
+{
+	const uint8_t* p = this->ReadView(2);
+	if(this->big_endian)
+	{
+		return static_cast<uint16_t>((p[0] << 8) | p[1]);
+	}
+	return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+int16_t ContentReader::ReadInt16()
+{
+	return static_cast<int16_t>(this->ReadUInt16());
+}
+
+uint32_t ContentReader::ReadUInt32()
+{
+	const uint8_t* p = this->ReadView(4);
+	if(this->big_endian)
+	{
+		return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+	}
+	return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+int32_t ContentReader::ReadInt32()
+{
+	return static_cast<int32_t>(this->ReadUInt32());
+}
+
+uint64_t ContentReader::ReadUInt64()
+{
+	const uint64_t first = this->ReadUInt32();
+	const uint64_t second = this->ReadUInt32();
+	return this->big_endian ? ((first << 32) | second) : (first | (second << 32));
+}
+
+uint_fast64_t ContentReader::Read7BitEncodedInt()
+{
+	uint_fast64_t value = 0;
+	for(uint_fast32_t shift = 0; shift < 64; shift += 7)
+	{
+		const uint8_t b = this->ReadUInt8();
+		value |= static_cast<uint_fast64_t>(b & 0x7F) << shift;
+		if((b & 0x80) == 0)
+		{
+			return value;
+		}
+	}
+	throw xna_error("ContentReader: 7-bit encoded int is too long");
+}
+
+std::string ContentReader::ReadString(const uint_fast64_t length)
+{
+	const uint8_t* p = this->ReadView(length);
+	return std::string(reinterpret_cast<const char*>(p), length);
+}
+
+std::string ContentReader::ReadStringMS()
+{
+	return this->ReadString(this->Read7BitEncodedInt());
+}
+
+std::vector<uint8_t> ContentReader::ReadBytes(const uint_fast64_t length)
+{
+	const uint8_t* p = this->ReadView(length);
+	this->budget.allocate(length, "copy of content data");
+	Stats::add_allocation(length);
+	return std::vector<uint8_t>(p, p + length);
+}
+
+float ContentReader::ReadFloat()
+{
+	const uint32_t bits = this->ReadUInt32();
+	float f;
+	std::memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+bool ContentReader::ReadBoolean()
+{
+	return this->ReadUInt8() != 0;
+}
+
+char32_t ContentReader::ReadChar()
+{
+	const uint8_t lead = this->ReadUInt8();
+	if(lead < 0x80)
+	{
+		return lead;
+	}
+	uint_fast32_t continuation;
+	char32_t c;
+	if((lead & 0xE0) == 0xC0)
+	{
+		continuation = 1;
+		c = lead & 0x1F;
+	}
+	else if((lead & 0xF0) == 0xE0)
+	{
+		continuation = 2;
+		c = lead & 0x0F;
+	}
+	else if((lead & 0xF8) == 0xF0)
+	{
+		continuation = 3;
+		c = lead & 0x07;
+	}
+	else
+	{
+		throw xna_error("ContentReader: invalid UTF-8 lead byte at position " + to_string(this->position - 1));
+	}
+	for(uint_fast32_t i = 0; i < continuation; ++i)
+	{
+		const uint8_t b = this->ReadUInt8();
+		if((b & 0xC0) != 0x80)
+		{
+			throw xna_error("ContentReader: invalid UTF-8 continuation byte at position " + to_string(this->position - 1));
+		}
+		c = (c << 6) | (b & 0x3F);
+	}
+	return c;
+}
+
+const uint8_t* ContentReader::ReadView(const uint_fast64_t length)
+{
+	this->require(length);
+	const uint8_t* p = this->buffer.get() + this->position;
+	this->position += length;
+	return p;
+}
+
+std::shared_ptr<const uint8_t> ContentReader::ReadShared(const uint_fast64_t length)
+{
+	const uint8_t* p = this->ReadView(length);
+	return std::shared_ptr<const uint8_t>(this->buffer, p);
+}
+
+std::shared_ptr<const uint8_t> ContentReader::ReadSwapped(const uint_fast64_t length, const uint_fast32_t unit)
+{
+	if(!this->big_endian || unit <= 1)
+	{
+		return this->ReadShared(length);
+	}
+	if(length % unit != 0)
+	{
+		throw xna_error("ContentReader: " + to_string(length) + " bytes are not a whole number of " + to_string(unit) + "-byte values");
+	}
+	const uint8_t* p = this->ReadView(length);
+	this->budget.allocate(length, "byte-swapped copy of content data");
+	Stats::add_allocation(length);
+	std::shared_ptr<uint8_t> copy(new uint8_t[length], std::default_delete<uint8_t[]>());
+	std::memcpy(copy.get(), p, length);
+	byte_swap(copy.get(), length, unit);
+	return copy;
+}
+
+void ContentReader::SetTypeReaders(const std::vector<std::string>& qualified_names)
+{
+	this->type_reader_names.clear();
+	for(const std::string& name : qualified_names)
+	{
+		this->type_reader_names.push_back(strip_assembly_names(name));
+	}
+}
+
+std::string ContentReader::ReadTypeReaderName()
+{
+	// perhaps 64 bits is overkill, but conservative guesses tend to bite someone in the ass in the future
+	const uint_fast64_t type_id = this->Read7BitEncodedInt();
+	if(type_id == 0)
+	{
+		return "";
+	}
+	if(type_id > this->type_reader_names.size())
+	{
+		throw xna_error("type id is too high (" + to_string(type_id) + " > " + to_string(this->type_reader_names.size()) + ")");
+	}
+	return this->type_reader_names[type_id - 1];
+}
+
+std::shared_ptr<ContentBase> ContentReader::ReadObject()
+{
+	const std::string type_reader_name = this->ReadTypeReaderName();
+	if(type_reader_name.empty())
+	{
+		return nullptr;
+	}
+	if(++this->object_count > this->options.max_objects)
+	{
+		throw xna_error("more than " + to_string(this->options.max_objects) + " objects");
+	}
+	Stats::add(Stats::Counter::objects);
+	return ContentBase::Read(*this, type_reader_name);
+}
+
+std::string ContentReader::ReadExternalReference()
+{
+	return this->ReadStringMS();
+}
+
+uint_fast64_t ContentReader::ReadSharedResource()
+{
+	const uint_fast64_t id = this->Read7BitEncodedInt();
+	if(id != 0)
+	{
+		++this->unresolved_shared_resources;
+	}
+	return id;
+}
+
+void ContentReader::AddSharedResourceFixup(std::function<void(const std::vector<std::shared_ptr<ContentBase>>&)> fixup)
+{
+	this->shared_resource_fixups.push_back(std::move(fixup));
+}
+
+void ContentReader::ResolveSharedResources(const std::vector<std::shared_ptr<ContentBase>>& shared_resources)
+{
+	for(const auto& fixup : this->shared_resource_fixups)
+	{
+		fixup(shared_resources);
+	}
+	this->shared_resource_fixups.clear();
+	this->unresolved_shared_resources = 0;
+}
+
+bool ContentReader::HasUnresolvedSharedResources() const
+{
+	return this->unresolved_shared_resources != 0;
+}
+
+std::string strip_assembly_names(const std::string& qualified_name)
+{
+	// generic arguments are in [[name, assembly],[name, assembly]]: odd bracket depths hold the argument list, even depths an argument
+	std::string name;
+	uint_fast32_t depth = 0;
+	for(std::string::size_type i = 0; i < qualified_name.size(); ++i)
+	{
+		const char c = qualified_name[i];
+		if(c == ',' && depth % 2 == 0)
+		{
+			if(depth == 0)
+			{
+				break;
+			}
+			// skip the assembly name up to the bracket that closes this argument
+			const uint_fast32_t argument_depth = depth;
+			for(; i + 1 < qualified_name.size(); ++i)
+			{
+				const char n = qualified_name[i + 1];
+				if(n == '[')
+				{
+					++depth;
+				}
+				else if(n == ']')
+				{
+					if(depth == argument_depth)
+					{
+						break;
+					}
+					--depth;
+				}
+			}
+			continue;
+		}
+		if(c == '[')
+		{
+			++depth;
+		}
+		else if(c == ']' && depth != 0)
+		{
+			--depth;
+		}
+		name += c;
+	}
+	return name;
+}
+
+} // namespace Content
+} // namespace XNA
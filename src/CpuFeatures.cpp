@@ -0,0 +1,84 @@
+#include "CpuFeatures.hpp"
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace XNA {
+namespace CPU {
+
+namespace {
+
+struct Features
+{
+	bool ssse3 = false;
+	bool sse41 = false;
+	bool avx2 = false;
+	bool f16c = false;
+
+	Features()
+	{
+		#if defined(__x86_64__) || defined(__i386__)
+		unsigned int eax, ebx, ecx, edx;
+		if(__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0)
+		{
+			return;
+		}
+		this->ssse3 = (ecx & bit_SSSE3) != 0;
+		this->sse41 = (ecx & bit_SSE4_1) != 0;
+
+		// AVX state must be enabled by the OS (OSXSAVE + XCR0 bits 1 and 2)
+		const bool osxsave = (ecx & bit_OSXSAVE) != 0;
+		const bool avx = (ecx & bit_AVX) != 0;
+		if(!osxsave || !avx)
+		{
+			return;
+		}
+		uint32_t xcr0_lo, xcr0_hi;
+		__asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+		if((xcr0_lo & 0x6) != 0x6)
+		{
+			return;
+		}
+		this->f16c = (ecx & bit_F16C) != 0;
+
+		if(__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) != 0)
+		{
+			this->avx2 = (ebx & bit_AVX2) != 0;
+		}
+		#endif
+	}
+};
+
+const Features& features()
+{
+	static const Features f;
+	return f;
+}
+
+} // namespace
+
+bool has_ssse3()
+{
+	return features().ssse3;
+}
+
+bool has_sse41()
+{
+	return features().sse41;
+}
+
+bool has_avx2()
+{
+	return features().avx2;
+}
+
+bool has_f16c()
+{
+	return features().f16c;
+}
+
+} // namespace CPU
+} // namespace XNA
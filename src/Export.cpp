@@ -0,0 +1,400 @@
+#include "Export.hpp"
+
+#include <algorithm>
+#include <array>
+#include <BinaryReader.hpp>
+#include <cstring>
+#include <memory>
+
+#include "AdpcmDecoder.hpp"
+#include "Stats.hpp"
+#include "SurfaceConvert.hpp"
+#include "XNB.hpp"
+#include "xna_exception.hpp"
+
+namespace XNA {
+namespace Export {
+
+using std::to_string;
+
+namespace {
+
+// little-endian header fields, gathered so that the sink gets them in one write
+class HeaderWriter
+{
+	public:
+		void UInt16(const uint_fast32_t v)
+		{
+			this->data.push_back(static_cast<uint8_t>(v));
+			this->data.push_back(static_cast<uint8_t>(v >> 8));
+		}
+
+		void UInt32(const uint_fast32_t v)
+		{
+			this->UInt16(v & 0xFFFF);
+			this->UInt16(v >> 16);
+		}
+
+		void Chars(const char* s)
+		{
+			this->data.insert(this->data.end(), s, s + std::strlen(s));
+		}
+
+		void Bytes(const std::vector<uint8_t>& bytes)
+		{
+			this->data.insert(this->data.end(), bytes.begin(), bytes.end());
+		}
+
+		void flush(OutputSink& sink)
+		{
+			sink.write(this->data.data(), this->data.size());
+			this->data.clear();
+		}
+
+	private:
+		std::vector<uint8_t> data;
+};
+
+uint32_t four_cc(const char* s)
+{
+	return static_cast<uint32_t>(s[0]) | (static_cast<uint32_t>(s[1]) << 8) | (static_cast<uint32_t>(s[2]) << 16) | (static_cast<uint32_t>(s[3]) << 24);
+}
+
+// DDS_PIXELFORMAT flags
+const uint32_t DDPF_ALPHAPIXELS = 0x1;
+const uint32_t DDPF_ALPHA = 0x2;
+const uint32_t DDPF_FOURCC = 0x4;
+const uint32_t DDPF_RGB = 0x40;
+
+struct DdsPixelFormat
+{
+	uint32_t flags;
+	uint32_t four_cc;
+	uint32_t bit_count;
+	std::array<uint32_t, 4> masks; // R, G, B, A
+	uint32_t dxgi_format; // for the DX10 header, if four_cc is "DX10"
+};
+
+// see https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dx-graphics-dds-pguide
+DdsPixelFormat dds_pixel_format(const Content::Texture2D_SurfaceFormat format)
+{
+	using F = Content::Texture2D_SurfaceFormat;
+	const uint32_t dx10 = four_cc("DX10");
+	switch(format)
+	{
+		case F::DXT1:				return { DDPF_FOURCC, four_cc("DXT1"), 0, {{0, 0, 0, 0}}, 0 };
+		case F::DXT3:				return { DDPF_FOURCC, four_cc("DXT3"), 0, {{0, 0, 0, 0}}, 0 };
+		case F::DXT5:				return { DDPF_FOURCC, four_cc("DXT5"), 0, {{0, 0, 0, 0}}, 0 };
+		case F::RGBA8888:			return { DDPF_RGB | DDPF_ALPHAPIXELS, 0, 32, {{0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000}}, 0 };
+		case F::BGR565:				return { DDPF_RGB, 0, 16, {{0xF800, 0x07E0, 0x001F, 0}}, 0 };
+		case F::BGRA5551:			return { DDPF_RGB | DDPF_ALPHAPIXELS, 0, 16, {{0x7C00, 0x03E0, 0x001F, 0x8000}}, 0 };
+		case F::BGRA4444:			return { DDPF_RGB | DDPF_ALPHAPIXELS, 0, 16, {{0x0F00, 0x00F0, 0x000F, 0xF000}}, 0 };
+		case F::Alpha8:				return { DDPF_ALPHA, 0, 8, {{0, 0, 0, 0xFF}}, 0 };
+		// DXGI_FORMAT values
+		case F::NormalizedByte2:	return { DDPF_FOURCC, dx10, 0, {{0, 0, 0, 0}}, 51 };	// R8G8_SNORM
+		case F::NormalizedByte4:	return { DDPF_FOURCC, dx10, 0, {{0, 0, 0, 0}}, 31 };	// R8G8B8A8_SNORM
+		case F::RGBA1010102:		return { DDPF_FOURCC, dx10, 0, {{0, 0, 0, 0}}, 24 };	// R10G10B10A2_UNORM
+		case F::RG32:				return { DDPF_FOURCC, dx10, 0, {{0, 0, 0, 0}}, 35 };	// R16G16_UNORM
+		case F::RGBA64:				return { DDPF_FOURCC, dx10, 0, {{0, 0, 0, 0}}, 11 };	// R16G16B16A16_UNORM
+		case F::Single:				return { DDPF_FOURCC, dx10, 0, {{0, 0, 0, 0}}, 41 };	// R32_FLOAT
+		case F::Vector2:			return { DDPF_FOURCC, dx10, 0, {{0, 0, 0, 0}}, 16 };	// R32G32_FLOAT
+		case F::Vector4:			return { DDPF_FOURCC, dx10, 0, {{0, 0, 0, 0}}, 2 };		// R32G32B32A32_FLOAT
+		case F::HalfSingle:			return { DDPF_FOURCC, dx10, 0, {{0, 0, 0, 0}}, 54 };	// R16_FLOAT
+		case F::HalfVector2:		return { DDPF_FOURCC, dx10, 0, {{0, 0, 0, 0}}, 34 };	// R16G16_FLOAT
+		case F::HalfVector4:
+		case F::HdrBlendable:		return { DDPF_FOURCC, dx10, 0, {{0, 0, 0, 0}}, 10 };	// R16G16B16A16_FLOAT
+	}
+	throw xna_error("no DDS pixel format for surface format " + Content::to_string(format));
+}
+
+} // namespace
+
+std::string to_string(const ImageFormat format)
+{
+	switch(format)
+	{
+		case ImageFormat::png:	return "png";
+		case ImageFormat::qoi:	return "qoi";
+		case ImageFormat::tga:	return "tga";
+		case ImageFormat::pam:	return "pam";
+		case ImageFormat::dds:	return "dds";
+	}
+	throw xna_error("unknown image format " + to_string(static_cast<int>(format)));
+}
+
+ImageFormat image_format_from_string(const std::string& name)
+{
+	for(const ImageFormat format : { ImageFormat::png, ImageFormat::qoi, ImageFormat::tga, ImageFormat::pam, ImageFormat::dds })
+	{
+		if(name == to_string(format))
+		{
+			return format;
+		}
+	}
+	throw xna_error("unknown image format: " + name);
+}
+
+void write_png(const Content::Texture2D& texture, const uint32_t mip, OutputSink& sink, const PngOptions& options)
+{
+	write_image(texture, mip, ImageFormat::png, sink, options);
+}
+
+void write_image(const Content::Texture2D& texture, const uint32_t mip, const ImageFormat format, OutputSink& sink, const PngOptions& png_options)
+{
+	if(format == ImageFormat::dds)
+	{
+		throw xna_error("write_image cannot write DDS; use write_dds");
+	}
+	const Stats::Timer timer(Stats::Stage::export_);
+	const std::vector<uint8_t>& data = texture.get_mip_data(mip);
+	const std::pair<uint32_t, uint32_t> size = texture.get_mip_size(mip);
+	// RGBA8888 mips are already what the writers take, so only the other formats are converted
+	std::vector<uint8_t> converted;
+	const uint8_t* pixels = data.data();
+	if(texture.get_surface_format() != Content::Texture2D_SurfaceFormat::RGBA8888)
+	{
+		converted = Content::to_RGBA8(texture.get_surface_format(), data);
+		pixels = converted.data();
+	}
+	switch(format)
+	{
+		case ImageFormat::png:	write_png_RGBA(sink, pixels, size.first, size.second, png_options); break;
+		case ImageFormat::qoi:	write_qoi_RGBA(sink, pixels, size.first, size.second); break;
+		case ImageFormat::tga:	write_tga_RGBA(sink, pixels, size.first, size.second); break;
+		case ImageFormat::pam:	write_pam_RGBA(sink, pixels, size.first, size.second); break;
+		case ImageFormat::dds:	break;
+	}
+}
+
+void write_dds(const Content::Texture2D& texture, OutputSink& sink)
+{
+	const Stats::Timer timer(Stats::Stage::export_);
+	const DdsPixelFormat format = dds_pixel_format(texture.get_surface_format());
+	const uint_fast32_t mip_count = texture.get_mip_count();
+	const std::pair<uint32_t, uint32_t> size = texture.get_mip_size(0);
+	const bool compressed = (format.flags == DDPF_FOURCC && format.dxgi_format == 0);
+
+	// DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT, then DDSD_LINEARSIZE or DDSD_PITCH and DDSD_MIPMAPCOUNT
+	uint32_t flags = 0x1 | 0x2 | 0x4 | 0x1000;
+	flags |= compressed ? 0x80000 : 0x8;
+	if(mip_count > 1)
+	{
+		flags |= 0x20000;
+	}
+	const uint_fast64_t top_size = texture.get_mip_data(0).size();
+	const uint_fast64_t pitch_or_linear_size = compressed ? top_size : top_size / size.second;
+
+	HeaderWriter header;
+	header.Chars("DDS ");
+	header.UInt32(124);
+	header.UInt32(flags);
+	header.UInt32(size.second);
+	header.UInt32(size.first);
+	header.UInt32(static_cast<uint_fast32_t>(std::min<uint_fast64_t>(pitch_or_linear_size, UINT32_MAX)));
+	header.UInt32(0); // depth
+	header.UInt32(mip_count);
+	for(uint_fast32_t i = 0; i < 11; ++i)
+	{
+		header.UInt32(0); // reserved
+	}
+	header.UInt32(32);
+	header.UInt32(format.flags);
+	header.UInt32(format.four_cc);
+	header.UInt32(format.bit_count);
+	for(const uint32_t mask : format.masks)
+	{
+		header.UInt32(mask);
+	}
+	// DDSCAPS_TEXTURE, and DDSCAPS_COMPLEX | DDSCAPS_MIPMAP with mips
+	header.UInt32((mip_count > 1) ? 0x1000 | 0x8 | 0x400000 : 0x1000);
+	for(uint_fast32_t i = 0; i < 4; ++i)
+	{
+		header.UInt32(0); // caps2-4, reserved
+	}
+	if(format.dxgi_format != 0)
+	{
+		header.UInt32(format.dxgi_format);
+		header.UInt32(3); // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+		header.UInt32(0); // misc flags
+		header.UInt32(1); // array size
+		header.UInt32(0); // misc flags 2
+	}
+	header.flush(sink);
+
+	for(uint_fast32_t i = 0; i < mip_count; ++i)
+	{
+		const std::vector<uint8_t>& mip = texture.get_mip_data(i);
+		sink.write(mip.data(), mip.size());
+	}
+}
+
+void write_wav(const Content::Sound& sound, OutputSink& sink, const bool decode_adpcm)
+{
+	const Stats::Timer timer(Stats::Stage::export_);
+	uint16_t format = static_cast<uint16_t>(sound.format);
+	uint16_t block_align = sound.block_align;
+	uint16_t bits_per_sample = sound.bits_per_sample;
+	uint32_t average_byte_rate = sound.average_byte_rate;
+	std::vector<uint8_t> extra_info = sound.extra_info;
+	const uint8_t* sound_data = sound.get_data();
+	const uint32_t sound_data_size = sound.get_data_size();
+	uint_fast64_t out_data_size = sound_data_size;
+
+	std::unique_ptr<AdpcmDecoder> decoder;
+	if(decode_adpcm && sound.format == Content::SoundFormat::ADPCM)
+	{
+		decoder.reset(new AdpcmDecoder(sound));
+		out_data_size = decoder->SamplesInStream(sound_data_size) * sound.channel_count * sizeof(int16_t);
+
+		format = static_cast<uint16_t>(Content::SoundFormat::PCM);
+		bits_per_sample = 16;
+		block_align = static_cast<uint16_t>(sound.channel_count * 2);
+		average_byte_rate = sound.sample_rate * block_align;
+		extra_info.clear();
+	}
+
+	// plain PCM uses the 16-byte PCMWAVEFORMAT; anything with extra info needs WAVEFORMATEX
+	const uint32_t fmt_size = extra_info.empty() ? 16 : static_cast<uint32_t>(18 + extra_info.size());
+	// RIFF chunks are word aligned
+	const uint_fast64_t data_padding = out_data_size % 2;
+	// smpl: 36-byte header and one 24-byte loop
+	const bool write_loop = (sound.loop_length != 0);
+	const uint32_t smpl_size = 36 + 24;
+	const uint_fast64_t file_size = 4 + (8 + fmt_size) + (8 + out_data_size + data_padding) + (write_loop ? 8 + smpl_size : 0);
+	if(file_size > UINT32_MAX)
+	{
+		throw xna_error("file size is too big (" + to_string(file_size) + " > " + to_string(UINT32_MAX) + ")");
+	}
+
+	HeaderWriter header;
+	header.Chars("RIFF");
+	header.UInt32(static_cast<uint32_t>(file_size));
+	header.Chars("WAVEfmt ");
+	header.UInt32(fmt_size);
+	header.UInt16(format);
+	header.UInt16(sound.channel_count);
+	header.UInt32(sound.sample_rate);
+	header.UInt32(average_byte_rate);
+	header.UInt16(block_align);
+	header.UInt16(bits_per_sample);
+	if(!extra_info.empty())
+	{
+		header.UInt16(static_cast<uint16_t>(extra_info.size()));
+		header.Bytes(extra_info);
+	}
+	header.Chars("data");
+	header.UInt32(static_cast<uint32_t>(out_data_size));
+	header.flush(sink);
+
+	if(decoder != nullptr)
+	{
+		// decode as many whole blocks as fit in 64 KiB at a time
+		const uint_fast32_t decoded_block_size = decoder->samples_per_block * block_align;
+		const uint_fast32_t blocks_per_chunk = std::max<uint_fast32_t>(1, (64 * 1024) / decoded_block_size);
+		std::vector<int16_t> samples(blocks_per_chunk * decoder->samples_per_block * sound.channel_count);
+		for(uint_fast64_t pos = 0; pos < sound_data_size;)
+		{
+			int16_t* dest = samples.data();
+			for(uint_fast32_t i = 0; i < blocks_per_chunk && pos < sound_data_size; ++i)
+			{
+				const uint_fast32_t block_size = static_cast<uint_fast32_t>(std::min<uint_fast64_t>(sound_data_size - pos, decoder->block_align));
+				if(decoder->SamplesInBlock(block_size) != 0)
+				{
+					dest += decoder->DecodeBlock(sound_data + pos, block_size, dest) * sound.channel_count;
+				}
+				pos += block_size;
+			}
+			sink.write(reinterpret_cast<const uint8_t*>(samples.data()), static_cast<size_t>(dest - samples.data()) * sizeof(int16_t));
+		}
+	}
+	else
+	{
+		// straight from the XNB body; no copy of it is made
+		sink.write(sound_data, sound_data_size);
+	}
+	if(data_padding != 0)
+	{
+		const uint8_t zero = 0;
+		sink.write(&zero, 1);
+	}
+
+	if(write_loop)
+	{
+		// see https://sites.google.com/site/musicgapi/technical-documents/wav-file-format#smpl
+		header.Chars("smpl");
+		header.UInt32(smpl_size);
+		header.UInt32(0); // manufacturer
+		header.UInt32(0); // product
+		header.UInt32((sound.sample_rate != 0) ? 1000000000u / sound.sample_rate : 0); // sample period (ns)
+		header.UInt32(60); // MIDI unity note (middle C)
+		header.UInt32(0); // MIDI pitch fraction
+		header.UInt32(0); // SMPTE format
+		header.UInt32(0); // SMPTE offset
+		header.UInt32(1); // loop count
+		header.UInt32(0); // sampler data size
+		header.UInt32(0); // cue point id
+		header.UInt32(0); // type: forward
+		header.UInt32(sound.loop_start);
+		header.UInt32(sound.loop_start + sound.loop_length - 1); // inclusive
+		header.UInt32(0); // fraction
+		header.UInt32(0); // play count: infinite
+		header.flush(sink);
+	}
+}
+
+std::string export_xnb(const uint8_t* data, const uint_fast64_t size, OutputSink& sink, const ExportOptions& options, const Content::ReadOptions& read_options)
+{
+	// BinaryReader owns what it reads, so this is the one copy of the input
+	std::unique_ptr<uint8_t[]> buffer(new uint8_t[size]);
+	std::memcpy(buffer.get(), data, size);
+	BinaryReader reader(std::move(buffer), size);
+
+	Content::ReadOptions xnb_options = read_options;
+	if(options.image_format != ImageFormat::dds && xnb_options.max_mip_count == UINT32_MAX)
+	{
+		// the other mips are not written, so they need not be read
+		xnb_options.primary_only = true;
+		xnb_options.max_mip_count = options.mip + 1;
+	}
+	XNB::XNB xnb(reader, xnb_options);
+	if(xnb.objects.empty() || xnb.objects[0] == nullptr)
+	{
+		throw xna_error("primary object is null");
+	}
+
+	const std::shared_ptr<Content::ContentBase>& content = xnb.objects[0];
+	const std::string type_reader_name = content->get_type_reader_name();
+	std::shared_ptr<Content::Texture2D> texture;
+	if(type_reader_name == "Microsoft.Xna.Framework.Content.Texture2DReader")
+	{
+		texture = std::static_pointer_cast<Content::Texture2D>(content);
+	}
+	else if(type_reader_name == "Microsoft.Xna.Framework.Content.SpriteFontReader")
+	{
+		texture = std::static_pointer_cast<Content::SpriteFont>(content)->texture;
+	}
+	else if(type_reader_name == "Microsoft.Xna.Framework.Content.SoundEffectReader")
+	{
+		write_wav(*std::static_pointer_cast<Content::Sound>(content), sink, options.decode_adpcm);
+		return "wav";
+	}
+	else
+	{
+		throw xna_error("cannot export " + type_reader_name);
+	}
+
+	if(options.unpremultiply && texture->get_surface_format() == Content::Texture2D_SurfaceFormat::RGBA8888)
+	{
+		texture->unpremultiply_alpha();
+	}
+	if(options.image_format == ImageFormat::dds)
+	{
+		write_dds(*texture, sink);
+		return "dds";
+	}
+	write_image(*texture, options.mip, options.image_format, sink, options.png);
+	return to_string(options.image_format);
+}
+
+} // namespace Export
+} // namespace XNA
@@ -0,0 +1,303 @@
+#include "Generic.hpp"
+
+#include <cstring>
+
+#include "Xbox360.hpp"
+#include "xna_exception.hpp"
+
+namespace XNA {
+namespace Content {
+
+using std::to_string;
+
+namespace {
+
+const std::string CONTENT_NAMESPACE = "Microsoft.Xna.Framework.Content.";
+
+// bulk reads copy the file layout as is, so these must have no padding
+static_assert(sizeof(Vector2) == 8 && sizeof(Vector3) == 12 && sizeof(Vector4) == 16, "vector types must be packed");
+static_assert(sizeof(Point) == 8 && sizeof(Rectangle) == 16 && sizeof(Color) == 4, "point, rectangle and color must be packed");
+static_assert(sizeof(Quaternion) == 16 && sizeof(Matrix) == 64, "quaternion and matrix must be packed");
+
+template <typename T> struct Tag
+{
+	using type = T;
+};
+
+// the size of the numbers a fixed-size type is made of, which big-endian (Xbox 360) content has byte-swapped
+template <typename T> struct SwapUnit
+{
+	static const uint_fast32_t size = sizeof(T);
+};
+template <> struct SwapUnit<Vector2>	{ static const uint_fast32_t size = 4; };
+template <> struct SwapUnit<Vector3>	{ static const uint_fast32_t size = 4; };
+template <> struct SwapUnit<Vector4>	{ static const uint_fast32_t size = 4; };
+template <> struct SwapUnit<Point>		{ static const uint_fast32_t size = 4; };
+template <> struct SwapUnit<Rectangle>	{ static const uint_fast32_t size = 4; };
+template <> struct SwapUnit<Quaternion>	{ static const uint_fast32_t size = 4; };
+template <> struct SwapUnit<Matrix>		{ static const uint_fast32_t size = 4; };
+// 4 bytes in RGBA order, written one at a time
+template <> struct SwapUnit<Color>		{ static const uint_fast32_t size = 1; };
+
+// how one element is stored; fixed-size types are stored as in memory on a little-endian host
+template <typename T> struct ValueIO
+{
+	static const bool bulk = true;
+
+	static T read(ContentReader& reader)
+	{
+		T v;
+		std::memcpy(&v, reader.ReadView(sizeof(T)), sizeof(T));
+		if(reader.IsBigEndian())
+		{
+			byte_swap(reinterpret_cast<uint8_t*>(&v), sizeof(T), SwapUnit<T>::size);
+		}
+		return v;
+	}
+};
+
+template <> struct ValueIO<bool>
+{
+	static const bool bulk = false;
+
+	static bool read(ContentReader& reader)
+	{
+		return reader.ReadBoolean();
+	}
+};
+
+// UTF-8, so 1 to 4 bytes
+template <> struct ValueIO<char32_t>
+{
+	static const bool bulk = false;
+
+	static char32_t read(ContentReader& reader)
+	{
+		return reader.ReadChar();
+	}
+};
+
+/*
+calls f(Tag<T>(), reader name) for the value type named by name, which is either a .NET type name
+(as in generic arguments) or the name of its type reader. returns nullptr for anything else.
+*/
+template <typename F> std::shared_ptr<ContentBase> with_value_type(const std::string& name, F f)
+{
+	auto is = [&name](const char* type_name, const char* reader_name)
+	{
+		return name == type_name || name == CONTENT_NAMESPACE + reader_name;
+	};
+	auto reader = [](const char* reader_name)
+	{
+		return CONTENT_NAMESPACE + reader_name;
+	};
+
+	if(is("System.Boolean", "BooleanReader"))					return f(Tag<bool>(), reader("BooleanReader"));
+	if(is("System.Byte", "ByteReader"))							return f(Tag<uint8_t>(), reader("ByteReader"));
+	if(is("System.SByte", "SByteReader"))						return f(Tag<int8_t>(), reader("SByteReader"));
+	if(is("System.Int16", "Int16Reader"))						return f(Tag<int16_t>(), reader("Int16Reader"));
+	if(is("System.UInt16", "UInt16Reader"))						return f(Tag<uint16_t>(), reader("UInt16Reader"));
+	if(is("System.Int32", "Int32Reader"))						return f(Tag<int32_t>(), reader("Int32Reader"));
+	if(is("System.UInt32", "UInt32Reader"))						return f(Tag<uint32_t>(), reader("UInt32Reader"));
+	if(is("System.Int64", "Int64Reader"))						return f(Tag<int64_t>(), reader("Int64Reader"));
+	if(is("System.UInt64", "UInt64Reader"))						return f(Tag<uint64_t>(), reader("UInt64Reader"));
+	if(is("System.Single", "SingleReader"))						return f(Tag<float>(), reader("SingleReader"));
+	if(is("System.Double", "DoubleReader"))						return f(Tag<double>(), reader("DoubleReader"));
+	if(is("System.Char", "CharReader"))							return f(Tag<char32_t>(), reader("CharReader"));
+	if(is("Microsoft.Xna.Framework.Vector2", "Vector2Reader"))		return f(Tag<Vector2>(), reader("Vector2Reader"));
+	if(is("Microsoft.Xna.Framework.Vector3", "Vector3Reader"))		return f(Tag<Vector3>(), reader("Vector3Reader"));
+	if(is("Microsoft.Xna.Framework.Vector4", "Vector4Reader"))		return f(Tag<Vector4>(), reader("Vector4Reader"));
+	if(is("Microsoft.Xna.Framework.Point", "PointReader"))			return f(Tag<Point>(), reader("PointReader"));
+	if(is("Microsoft.Xna.Framework.Rectangle", "RectangleReader"))	return f(Tag<Rectangle>(), reader("RectangleReader"));
+	if(is("Microsoft.Xna.Framework.Color", "ColorReader"))			return f(Tag<Color>(), reader("ColorReader"));
+	if(is("Microsoft.Xna.Framework.Quaternion", "QuaternionReader"))	return f(Tag<Quaternion>(), reader("QuaternionReader"));
+	if(is("Microsoft.Xna.Framework.Matrix", "MatrixReader"))		return f(Tag<Matrix>(), reader("MatrixReader"));
+	return nullptr;
+}
+
+template <typename T> ArrayView<T> read_array(ContentReader& reader, const uint32_t count)
+{
+	// checked before anything is allocated; variable-size elements take at least 1 byte
+	const uint_fast64_t min_size = static_cast<uint_fast64_t>(count) * (ValueIO<T>::bulk ? sizeof(T) : 1);
+	if(min_size > reader.GetRemaining())
+	{
+		throw xna_error("array of " + to_string(count) + " elements is larger than the remaining data");
+	}
+
+	if(ValueIO<T>::bulk)
+	{
+		// a byte-swapped copy is already held, but may not be aligned
+		const bool swapped = reader.IsBigEndian() && SwapUnit<T>::size > 1;
+		std::shared_ptr<const uint8_t> bytes = reader.ReadSwapped(min_size, SwapUnit<T>::size);
+		const bool view = reader.GetOptions().view_arrays || swapped;
+		if(!view || reinterpret_cast<uintptr_t>(bytes.get()) % alignof(T) != 0)
+		{
+			reader.GetBudget().allocate(min_size, "array");
+		}
+		return view_or_copy<T>(bytes, count, view);
+	}
+
+	reader.GetBudget().allocate(static_cast<uint_fast64_t>(count) * sizeof(T), "array");
+	Stats::add_allocation(static_cast<uint_fast64_t>(count) * sizeof(T));
+	std::shared_ptr<T> elements(new T[count], std::default_delete<T[]>());
+	for(uint32_t i = 0; i < count; ++i)
+	{
+		elements.get()[i] = ValueIO<T>::read(reader);
+	}
+	return ArrayView<T>(std::move(elements), count);
+}
+
+// an element of a collection: value types are stored inline, anything else is a nested object
+std::shared_ptr<ContentBase> read_element(ContentReader& reader, const std::string& type)
+{
+	std::shared_ptr<ContentBase> value = with_value_type(type, [&reader](auto tag, const std::string& reader_name) -> std::shared_ptr<ContentBase>
+	{
+		return std::make_shared<Value<typename decltype(tag)::type>>(reader, reader_name);
+	});
+	return (value != nullptr) ? value : reader.ReadObject();
+}
+
+// "Name`2[[A],[B]]" -> "Name`2", {"A", "B"}; false if the name has no generic arguments
+bool split_generic_name(const std::string& name, std::string& base, std::vector<std::string>& arguments)
+{
+	const std::string::size_type open = name.find('[');
+	if(open == std::string::npos || name.back() != ']')
+	{
+		return false;
+	}
+	base = name.substr(0, open);
+	arguments.clear();
+	uint_fast32_t depth = 0;
+	std::string::size_type start = 0;
+	for(std::string::size_type i = open + 1; i + 1 < name.size(); ++i)
+	{
+		if(name[i] == '[')
+		{
+			if(depth++ == 0)
+			{
+				start = i + 1;
+			}
+		}
+		else if(name[i] == ']')
+		{
+			if(depth == 0)
+			{
+				return false;
+			}
+			if(--depth == 0)
+			{
+				arguments.push_back(name.substr(start, i - start));
+			}
+		}
+	}
+	return depth == 0 && !arguments.empty();
+}
+
+} // namespace
+
+template <typename T> Value<T>::Value(ContentReader& reader, const std::string& type_reader_name)
+{
+	this->type_reader_name = type_reader_name;
+	this->value = ValueIO<T>::read(reader);
+}
+
+String::String(ContentReader& reader)
+{
+	this->type_reader_name = CONTENT_NAMESPACE + "StringReader";
+	this->value = reader.ReadStringMS();
+}
+
+template <typename T> ValueList<T>::ValueList(ContentReader& reader, const std::string& type_reader_name)
+{
+	this->type_reader_name = type_reader_name;
+	const uint32_t count = reader.ReadUInt32();
+	this->items = read_array<T>(reader, count);
+}
+
+ObjectList::ObjectList(ContentReader& reader, const std::string& type_reader_name, const std::string& element_type)
+:
+	element_type(element_type)
+{
+	this->type_reader_name = type_reader_name;
+	const uint32_t count = reader.ReadUInt32();
+	// every element has at least a type id
+	if(count > reader.GetRemaining())
+	{
+		throw xna_error("list of " + to_string(count) + " objects is larger than the remaining data");
+	}
+	this->items.reserve(count);
+	for(uint32_t i = 0; i < count; ++i)
+	{
+		this->items.push_back(reader.ReadObject());
+	}
+}
+
+Dictionary::Dictionary(ContentReader& reader, const std::string& type_reader_name, const std::string& key_type, const std::string& value_type)
+:
+	key_type(key_type),
+	value_type(value_type)
+{
+	this->type_reader_name = type_reader_name;
+	const uint32_t count = reader.ReadUInt32();
+	if(static_cast<uint_fast64_t>(count) * 2 > reader.GetRemaining())
+	{
+		throw xna_error("dictionary of " + to_string(count) + " entries is larger than the remaining data");
+	}
+	this->entries.reserve(count);
+	for(uint32_t i = 0; i < count; ++i)
+	{
+		std::shared_ptr<ContentBase> key = read_element(reader, key_type);
+		std::shared_ptr<ContentBase> value = read_element(reader, value_type);
+		this->entries.emplace_back(std::move(key), std::move(value));
+	}
+}
+
+std::shared_ptr<ContentBase> read_generic(ContentReader& reader, const std::string& type_reader_name)
+{
+	if(type_reader_name.compare(0, CONTENT_NAMESPACE.size(), CONTENT_NAMESPACE) != 0)
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<ContentBase> value = with_value_type(type_reader_name, [&reader](auto tag, const std::string& reader_name) -> std::shared_ptr<ContentBase>
+	{
+		return std::make_shared<Value<typename decltype(tag)::type>>(reader, reader_name);
+	});
+	if(value != nullptr)
+	{
+		return value;
+	}
+	if(type_reader_name == CONTENT_NAMESPACE + "StringReader")
+	{
+		return std::make_shared<String>(reader);
+	}
+
+	std::string base;
+	std::vector<std::string> arguments;
+	if(!split_generic_name(type_reader_name, base, arguments))
+	{
+		return nullptr;
+	}
+	if((base == CONTENT_NAMESPACE + "ListReader`1" || base == CONTENT_NAMESPACE + "ArrayReader`1") && arguments.size() == 1)
+	{
+		const std::string& element_type = arguments[0];
+		std::shared_ptr<ContentBase> list = with_value_type(element_type, [&reader, &type_reader_name](auto tag, const std::string&) -> std::shared_ptr<ContentBase>
+		{
+			return std::make_shared<ValueList<typename decltype(tag)::type>>(reader, type_reader_name);
+		});
+		if(list != nullptr)
+		{
+			return list;
+		}
+		// not a known value type, so assume a reference type (XNA writes a type id before each)
+		return std::make_shared<ObjectList>(reader, type_reader_name, element_type);
+	}
+	if(base == CONTENT_NAMESPACE + "DictionaryReader`2" && arguments.size() == 2)
+	{
+		return std::make_shared<Dictionary>(reader, type_reader_name, arguments[0], arguments[1]);
+	}
+	return nullptr;
+}
+
+} // namespace Content
+} // namespace XNA
@@ -0,0 +1,243 @@
+#include "ImageWriter.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "xna_exception.hpp"
+
+namespace XNA {
+namespace Export {
+
+using std::to_string;
+
+namespace {
+
+// output is gathered in chunks of this size, so that the sink is not called per pixel
+const size_t CHUNK_SIZE = 64 * 1024;
+
+class ChunkWriter
+{
+	public:
+		explicit ChunkWriter(OutputSink& sink)
+		:
+			sink(sink),
+			data(CHUNK_SIZE),
+			position(0)
+		{
+		}
+
+		// room for at least n more bytes at out()
+		void reserve(const size_t n)
+		{
+			if(this->position + n > this->data.size())
+			{
+				this->flush();
+			}
+		}
+
+		size_t room() const
+		{
+			return this->data.size() - this->position;
+		}
+
+		uint8_t* out()
+		{
+			return this->data.data() + this->position;
+		}
+
+		void advance(const size_t n)
+		{
+			this->position += n;
+		}
+
+		void flush()
+		{
+			this->sink.write(this->data.data(), this->position);
+			this->position = 0;
+		}
+
+	private:
+		OutputSink& sink;
+		std::vector<uint8_t> data;
+		size_t position;
+};
+
+void put_be32(uint8_t* p, const uint32_t v)
+{
+	p[0] = static_cast<uint8_t>(v >> 24);
+	p[1] = static_cast<uint8_t>(v >> 16);
+	p[2] = static_cast<uint8_t>(v >> 8);
+	p[3] = static_cast<uint8_t>(v);
+}
+
+// QOI ops
+const uint8_t QOI_OP_INDEX = 0x00;
+const uint8_t QOI_OP_DIFF = 0x40;
+const uint8_t QOI_OP_LUMA = 0x80;
+const uint8_t QOI_OP_RUN = 0xC0;
+const uint8_t QOI_OP_RGB = 0xFE;
+const uint8_t QOI_OP_RGBA = 0xFF;
+
+inline uint_fast32_t qoi_hash(const uint8_t* px)
+{
+	return (px[0] * 3u + px[1] * 5u + px[2] * 7u + px[3] * 11u) % 64;
+}
+
+} // namespace
+
+void write_qoi_RGBA(OutputSink& sink, const uint8_t* buf, const uint32_t width, const uint32_t height)
+{
+	ChunkWriter writer(sink);
+	uint8_t* out = writer.out();
+	std::memcpy(out, "qoif", 4);
+	put_be32(out + 4, width);
+	put_be32(out + 8, height);
+	out[12] = 4; // channels
+	out[13] = 0; // sRGB with linear alpha
+	writer.advance(14);
+
+	std::array<uint32_t, 64> index;
+	index.fill(0);
+	uint8_t prev[4] = { 0, 0, 0, 255 };
+	uint32_t prev_value;
+	std::memcpy(&prev_value, prev, 4);
+	uint_fast32_t run = 0;
+
+	const uint_fast64_t pixels = static_cast<uint_fast64_t>(width) * height;
+	for(uint_fast64_t i = 0; i < pixels; ++i)
+	{
+		const uint8_t* px = buf + 4 * i;
+		uint32_t value;
+		std::memcpy(&value, px, 4);
+		if(value == prev_value)
+		{
+			if(++run == 62)
+			{
+				writer.reserve(1);
+				*writer.out() = static_cast<uint8_t>(QOI_OP_RUN | (run - 1));
+				writer.advance(1);
+				run = 0;
+			}
+			continue;
+		}
+
+		// a run, then at most 5 bytes for the pixel
+		writer.reserve(6);
+		out = writer.out();
+		if(run != 0)
+		{
+			*out++ = static_cast<uint8_t>(QOI_OP_RUN | (run - 1));
+			run = 0;
+		}
+
+		const uint_fast32_t hash = qoi_hash(px);
+		if(index[hash] == value)
+		{
+			*out++ = static_cast<uint8_t>(QOI_OP_INDEX | hash);
+		}
+		else
+		{
+			index[hash] = value;
+			if(px[3] == prev[3])
+			{
+				const int vr = static_cast<int8_t>(px[0] - prev[0]);
+				const int vg = static_cast<int8_t>(px[1] - prev[1]);
+				const int vb = static_cast<int8_t>(px[2] - prev[2]);
+				const int vg_r = vr - vg;
+				const int vg_b = vb - vg;
+				if(vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 && vb >= -2 && vb <= 1)
+				{
+					*out++ = static_cast<uint8_t>(QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+				}
+				else if(vg_r >= -8 && vg_r <= 7 && vg >= -32 && vg <= 31 && vg_b >= -8 && vg_b <= 7)
+				{
+					*out++ = static_cast<uint8_t>(QOI_OP_LUMA | (vg + 32));
+					*out++ = static_cast<uint8_t>(((vg_r + 8) << 4) | (vg_b + 8));
+				}
+				else
+				{
+					*out++ = QOI_OP_RGB;
+					*out++ = px[0];
+					*out++ = px[1];
+					*out++ = px[2];
+				}
+			}
+			else
+			{
+				*out++ = QOI_OP_RGBA;
+				std::memcpy(out, px, 4);
+				out += 4;
+			}
+		}
+		writer.advance(static_cast<size_t>(out - writer.out()));
+		std::memcpy(prev, px, 4);
+		prev_value = value;
+	}
+
+	// the last run, then the end marker
+	writer.reserve(9);
+	out = writer.out();
+	if(run != 0)
+	{
+		*out++ = static_cast<uint8_t>(QOI_OP_RUN | (run - 1));
+	}
+	static const uint8_t end_marker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	std::memcpy(out, end_marker, 8);
+	out += 8;
+	writer.advance(static_cast<size_t>(out - writer.out()));
+	writer.flush();
+}
+
+void write_tga_RGBA(OutputSink& sink, const uint8_t* buf, const uint32_t width, const uint32_t height)
+{
+	if(width > 0xFFFF || height > 0xFFFF)
+	{
+		throw xna_error("image of " + to_string(width) + "x" + to_string(height) + " is too big for TGA (65535x65535)");
+	}
+
+	ChunkWriter writer(sink);
+	uint8_t* out = writer.out();
+	std::memset(out, 0, 18);
+	out[2] = 2; // uncompressed true-color
+	out[12] = static_cast<uint8_t>(width);
+	out[13] = static_cast<uint8_t>(width >> 8);
+	out[14] = static_cast<uint8_t>(height);
+	out[15] = static_cast<uint8_t>(height >> 8);
+	out[16] = 32; // bits per pixel
+	out[17] = 0x20 | 8; // rows from the top, 8 bits of alpha
+	writer.advance(18);
+
+	// TGA pixels are BGRA: R and B are swapped a chunk at a time
+	const uint_fast64_t pixels = static_cast<uint_fast64_t>(width) * height;
+	for(uint_fast64_t i = 0; i < pixels;)
+	{
+		writer.reserve(4);
+		const size_t count = static_cast<size_t>(std::min<uint_fast64_t>(pixels - i, writer.room() / 4));
+		const uint8_t* in = buf + 4 * i;
+		out = writer.out();
+		for(size_t j = 0; j < count; ++j)
+		{
+			out[4 * j + 0] = in[4 * j + 2];
+			out[4 * j + 1] = in[4 * j + 1];
+			out[4 * j + 2] = in[4 * j + 0];
+			out[4 * j + 3] = in[4 * j + 3];
+		}
+		writer.advance(4 * count);
+		i += count;
+	}
+	writer.flush();
+}
+
+void write_pam_RGBA(OutputSink& sink, const uint8_t* buf, const uint32_t width, const uint32_t height)
+{
+	const std::string header = "P7\nWIDTH " + to_string(width) + "\nHEIGHT " + to_string(height) + "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+	sink.write(reinterpret_cast<const uint8_t*>(header.data()), header.size());
+	// no copy of the pixels is made
+	sink.write(buf, 4 * static_cast<size_t>(width) * height);
+}
+
+} // namespace Export
+} // namespace XNA
@@ -0,0 +1,151 @@
+#include "Lz4Decoder.hpp"
+
+#include <cstring>
+#include <string>
+
+#include "Stats.hpp"
+#include "xna_exception.hpp"
+
+namespace {
+
+const uint_fast32_t MIN_MATCH = 4;
+const uint_fast32_t WIDE = 16;
+
+// the bytes that extend a length field of 15, each adding up to 255
+uint_fast64_t read_length(const uint8_t* in, const uint8_t*& ip, const uint8_t* const iend)
+{
+	uint_fast64_t length = 0;
+	uint8_t b;
+	do
+	{
+		if(ip == iend)
+		{
+			throw lz4_error("Lz4Decoder::Decompress: truncated length", static_cast<uint_fast64_t>(ip - in));
+		}
+		b = *ip++;
+		length += b;
+	}
+	while(b == 255);
+	return length;
+}
+
+} // namespace
+
+void Lz4Decoder::Decompress(const uint8_t* in, const uint_fast64_t in_len, uint8_t* out, const uint_fast64_t out_len)
+{
+	const XNA::Stats::Timer timer(XNA::Stats::Stage::lz4_decode);
+	const uint8_t* ip = in;
+	const uint8_t* const iend = in + in_len;
+	uint8_t* op = out;
+	uint8_t* const oend = out + out_len;
+
+	while(true)
+	{
+		const uint_fast64_t sequence_position = static_cast<uint_fast64_t>(ip - in);
+		if(ip == iend)
+		{
+			throw lz4_error("Lz4Decoder::Decompress: truncated sequence", sequence_position);
+		}
+		const uint8_t token = *ip++;
+
+		uint_fast64_t literal_length = token >> 4;
+		if(literal_length == 15)
+		{
+			literal_length += read_length(in, ip, iend);
+		}
+		if(literal_length > static_cast<uint_fast64_t>(iend - ip))
+		{
+			throw lz4_error("Lz4Decoder::Decompress: literals are past the end of the input", sequence_position);
+		}
+		if(literal_length > static_cast<uint_fast64_t>(oend - op))
+		{
+			throw lz4_error("Lz4Decoder::Decompress: literals are past the end of the output", sequence_position);
+		}
+		if(literal_length <= WIDE && iend - ip >= static_cast<std::ptrdiff_t>(WIDE) && oend - op >= static_cast<std::ptrdiff_t>(WIDE))
+		{
+			// the bytes past the literals are overwritten by what follows them
+			std::memcpy(op, ip, WIDE);
+		}
+		else if(literal_length != 0)
+		{
+			std::memcpy(op, ip, literal_length);
+		}
+		ip += literal_length;
+		op += literal_length;
+
+		// the last sequence has only literals
+		if(ip == iend)
+		{
+			break;
+		}
+
+		if(iend - ip < 2)
+		{
+			throw lz4_error("Lz4Decoder::Decompress: truncated match offset", sequence_position);
+		}
+		const uint_fast64_t offset = static_cast<uint_fast64_t>(ip[0] | (ip[1] << 8));
+		ip += 2;
+		if(offset == 0 || offset > static_cast<uint_fast64_t>(op - out))
+		{
+			throw lz4_error("Lz4Decoder::Decompress: match offset " + std::to_string(offset) + " is outside the output", sequence_position);
+		}
+
+		uint_fast64_t match_length = token & 0x0F;
+		if(match_length == 15)
+		{
+			match_length += read_length(in, ip, iend);
+		}
+		match_length += MIN_MATCH;
+		if(match_length > static_cast<uint_fast64_t>(oend - op))
+		{
+			throw lz4_error("Lz4Decoder::Decompress: match is past the end of the output", sequence_position);
+		}
+
+		const uint8_t* match = op - offset;
+		if(match_length + WIDE > static_cast<uint_fast64_t>(oend - op))
+		{
+			// no room to copy past the end of the match
+			for(uint_fast64_t i = 0; i < match_length; ++i)
+			{
+				op[i] = match[i];
+			}
+		}
+		else if(offset >= WIDE)
+		{
+			// each chunk only reads bytes before the ones it writes, which are already final
+			for(uint_fast64_t i = 0; i < match_length; i += WIDE)
+			{
+				std::memcpy(op + i, match + i, WIDE);
+			}
+		}
+		else
+		{
+			/*
+			a short offset repeats its last offset bytes: once a whole number of repeats (period) of at least WIDE
+			bytes is written, the rest is copied from period bytes back
+			*/
+			const uint_fast64_t period = ((WIDE + offset - 1) / offset) * offset;
+			uint_fast64_t i = 0;
+			for(; i < period && i < match_length; ++i)
+			{
+				op[i] = match[i];
+			}
+			for(; i < match_length; i += WIDE)
+			{
+				std::memcpy(op + i, op + i - period, WIDE);
+			}
+		}
+		op += match_length;
+	}
+
+	if(op != oend)
+	{
+		throw lz4_error("Lz4Decoder::Decompress: decoded " + std::to_string(op - out) + " bytes, not the decompressed size (" + std::to_string(out_len) + ")", in_len);
+	}
+}
+
+uint_fast64_t Lz4Decoder::MaxDecompressedSize(const uint_fast64_t in_len)
+{
+	// a match costs at least a token and an offset, and every further byte of length code adds at most 255
+	return in_len * 255;
+}
@@ -0,0 +1,109 @@
+#include "Lz4Encoder.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xna_exception.hpp"
+
+namespace {
+
+const uint_fast32_t HASH_BITS = 16;
+const uint_fast32_t MIN_MATCH = 4;
+const uint_fast64_t MAX_OFFSET = 0xFFFF;
+// the format requires the last 5 bytes to be literals, and the last match to start at least 12 bytes before the end
+const uint_fast64_t LAST_LITERALS = 5;
+const uint_fast64_t MATCH_LIMIT = 12;
+
+uint32_t read32(const uint8_t* p)
+{
+	uint32_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+uint_fast32_t hash(const uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void write_length(std::vector<uint8_t>& out, uint_fast64_t length)
+{
+	for(; length >= 255; length -= 255)
+	{
+		out.push_back(255);
+	}
+	out.push_back(static_cast<uint8_t>(length));
+}
+
+// literals followed by a match; match_length 0 for the last sequence, which has none
+void write_sequence(std::vector<uint8_t>& out, const uint8_t* literals, const uint_fast64_t literal_length, const uint_fast64_t offset, const uint_fast64_t match_length)
+{
+	const uint_fast64_t match_code = (match_length == 0) ? 0 : match_length - MIN_MATCH;
+	out.push_back(static_cast<uint8_t>((std::min<uint_fast64_t>(literal_length, 15) << 4) | std::min<uint_fast64_t>(match_code, 15)));
+	if(literal_length >= 15)
+	{
+		write_length(out, literal_length - 15);
+	}
+	out.insert(out.end(), literals, literals + literal_length);
+	if(match_length == 0)
+	{
+		return;
+	}
+	out.push_back(static_cast<uint8_t>(offset & 0xFF));
+	out.push_back(static_cast<uint8_t>(offset >> 8));
+	if(match_code >= 15)
+	{
+		write_length(out, match_code - 15);
+	}
+}
+
+} // namespace
+
+Lz4Encoder::Lz4Encoder()
+:
+	table(1 << HASH_BITS)
+{
+}
+
+std::vector<uint8_t> Lz4Encoder::Compress(const uint8_t* data, const uint_fast64_t size)
+{
+	if(size > UINT32_MAX)
+	{
+		throw xna_error("Lz4Encoder::Compress: data is too large (" + std::to_string(size) + ")");
+	}
+	std::fill(this->table.begin(), this->table.end(), 0);
+	std::vector<uint8_t> out;
+	out.reserve(size + size / 255 + 16);
+
+	uint_fast64_t anchor = 0;
+	if(size > MATCH_LIMIT)
+	{
+		const uint_fast64_t limit = size - MATCH_LIMIT;
+		const uint_fast64_t match_end_limit = size - LAST_LITERALS;
+		uint_fast64_t pos = 0;
+		while(pos < limit)
+		{
+			const uint32_t prefix = read32(data + pos);
+			uint32_t& slot = this->table[hash(prefix)];
+			const uint_fast64_t candidate = slot;
+			slot = static_cast<uint32_t>(pos);
+			if(candidate >= pos || pos - candidate > MAX_OFFSET || read32(data + candidate) != prefix)
+			{
+				// skip faster through data that does not match
+				pos += 1 + ((pos - anchor) >> 6);
+				continue;
+			}
+
+			uint_fast64_t length = MIN_MATCH;
+			while(pos + length < match_end_limit && data[candidate + length] == data[pos + length])
+			{
+				++length;
+			}
+			write_sequence(out, data + anchor, pos - anchor, pos - candidate, length);
+			pos += length;
+			anchor = pos;
+		}
+	}
+	write_sequence(out, data + anchor, size - anchor, 0, 0);
+	return out;
+}
@@ -46,9 +46,13 @@
 
 #include "LzxDecoder.hpp"
 
-#include <algorithm>	// std::copy_n, std::fill_n
+#include <algorithm>	// std::any_of, std::copy, std::copy_n, std::count, std::fill_n
+#include <cinttypes>
+#include <cstdio>
+#include <functional>
 #include <string>
 
+#include "Stats.hpp"
 #include "xna_exception.hpp"
 
 LzxDecoder::LzxDecoder(const uint_fast16_t window_bits)
@@ -62,9 +66,8 @@ LzxDecoder::LzxDecoder(const uint_fast16_t window_bits)
 	this->state.window_size = 1 << window_bits;
 
 	// let's initialize our state
+	XNA::Stats::add_allocation(this->state.window_size);
 	this->state.window = new uint8_t[this->state.window_size];
-	std::fill_n(this->state.window, this->state.window_size, 0xDC);
-	this->state.window_posn = 0;
 
 	// initialize tables
 	for(uint_fast32_t i = 0, j = 0; i <= 50; i += 2)
@@ -96,16 +99,28 @@ LzxDecoder::LzxDecoder(const uint_fast16_t window_bits)
 		posn_slots = window_bits * 2;
 	}
 
+	this->state.main_elements = static_cast<uint16_t>(NUM_CHARS + (posn_slots * 8));
+	this->Reset();
+}
+
+void LzxDecoder::Reset()
+{
+	std::fill_n(this->state.window, this->state.window_size, 0xDC);
+	this->state.window_posn = 0;
+
 	// reset state
 	this->state.R0 = this->state.R1 = this->state.R2 = 1;
-	this->state.main_elements = static_cast<uint16_t>(NUM_CHARS + (posn_slots * 8));
 	this->state.header_read = false;
+	this->state.block_length = 0;
 	this->state.block_remaining = 0;
 	this->state.block_type = BLOCKTYPE::INVALID;
+	this->analysis = nullptr;
 
 	// initialize tables to 0 (because deltas will be applied to them)
 	this->state.MAINTREE_len.fill(0);
 	this->state.LENGTH_len.fill(0);
+	// not read until the first aligned block, but saved by SaveCheckpoint before it
+	this->state.ALIGNED_len.fill(0);
 }
 
 LzxDecoder::~LzxDecoder()
@@ -143,6 +158,8 @@ void copy_n_safe(uint8_t* buf, uint_fast32_t len, uint_fast32_t src, uint_fast32
 
 void LzxDecoder::Decompress(const uint8_t* inBuf, const uint_fast32_t inLen, uint8_t* outBuf, const uint_fast32_t outLen)
 {
+	const XNA::Stats::Timer timer(XNA::Stats::Stage::lzx_decode);
+	XNA::Stats::add(XNA::Stats::Counter::lzx_frames);
 	BitBuffer bitbuf(inBuf, inLen);
 
 	uint_fast32_t window_posn = this->state.window_posn;
@@ -169,6 +186,7 @@ void LzxDecoder::Decompress(const uint8_t* inBuf, const uint_fast32_t inLen, uin
 		// last block finished, new block expected
 		if(this->state.block_remaining == 0)
 		{
+			const uint_fast64_t header_start = bitbuf.inpos * uint_fast64_t(8) - bitbuf.bitsleft;
 			this->state.block_type = static_cast<BLOCKTYPE>(bitbuf.ReadBits(3));
 
 			const uint32_t hi = bitbuf.ReadBits(16);
@@ -179,6 +197,7 @@ void LzxDecoder::Decompress(const uint8_t* inBuf, const uint_fast32_t inLen, uin
 			{
 				case BLOCKTYPE::ALIGNED:
 				{
+					XNA::Stats::add(XNA::Stats::Counter::lzx_aligned_blocks);
 					for(uint_fast32_t i = 0; i < 8; ++i)
 					{
 						this->state.ALIGNED_len[i] = static_cast<uint8_t>(bitbuf.ReadBits(3));
@@ -192,6 +211,11 @@ void LzxDecoder::Decompress(const uint8_t* inBuf, const uint_fast32_t inLen, uin
 
 				case BLOCKTYPE::VERBATIM:
 				{
+					// also reached by aligned blocks
+					if(this->state.block_type == BLOCKTYPE::VERBATIM)
+					{
+						XNA::Stats::add(XNA::Stats::Counter::lzx_verbatim_blocks);
+					}
 					this->ReadLengths(this->state.MAINTREE_len.data(), 0, 256, bitbuf);
 					this->ReadLengths(this->state.MAINTREE_len.data(), 256, this->state.main_elements, bitbuf);
 					this->MakeDecodeTable(MAINTREE_MAXSYMBOLS, MAINTREE_TABLEBITS, this->state.MAINTREE_len.data(), this->state.MAINTREE_table.data());
@@ -203,6 +227,7 @@ void LzxDecoder::Decompress(const uint8_t* inBuf, const uint_fast32_t inLen, uin
 
 				case BLOCKTYPE::UNCOMPRESSED:
 				{
+					XNA::Stats::add(XNA::Stats::Counter::lzx_uncompressed_blocks);
 					if(bitbuf.bitsleft == 0)
 					{
 						bitbuf.EnsureBits(16);
@@ -219,6 +244,10 @@ void LzxDecoder::Decompress(const uint8_t* inBuf, const uint_fast32_t inLen, uin
 					throw lzx_error("LzxDecoder::Decompress: invalid state block type:  " + to_string(this->state.block_type));
 				}
 			}
+			if(this->analysis != nullptr)
+			{
+				this->AnalyzeTrees(bitbuf.inpos * uint_fast64_t(8) - bitbuf.bitsleft - header_start);
+			}
 		}
 
 		// buffer exhaustion check
@@ -280,7 +309,8 @@ void LzxDecoder::Decompress(const uint8_t* inBuf, const uint_fast32_t inLen, uin
 						}
 						match_length += MIN_MATCH;
 
-						uint_fast32_t match_offset = main_element >> 3;
+						const uint_fast32_t slot = main_element >> 3;
+						uint_fast32_t match_offset = slot;
 
 						if(match_offset > 2)
 						{
@@ -308,6 +338,10 @@ void LzxDecoder::Decompress(const uint8_t* inBuf, const uint_fast32_t inLen, uin
 							R2 = R0;
 							R0 = match_offset;
 						}
+						if(this->analysis != nullptr)
+						{
+							this->AnalyzeMatch(match_length, match_offset, slot);
+						}
 
 						uint_fast32_t runsrc;
 						uint_fast32_t rundest = window_posn;
@@ -443,10 +477,212 @@ void LzxDecoder::Decompress(const uint8_t* inBuf, const uint_fast32_t inLen, uin
 	this->state.R0 = R0;
 	this->state.R1 = R1;
 	this->state.R2 = R2;
+
+	if(this->analysis != nullptr)
+	{
+		++this->analysis->frames;
+		this->analysis->compressed_bytes += inLen;
+		this->analysis->decompressed_bytes += outLen;
+	}
+}
+
+void LzxDecoder::SaveCheckpoint(LzxCheckpoint& checkpoint) const
+{
+	checkpoint.window.assign(this->state.window, this->state.window + this->state.window_size);
+	checkpoint.window_position = static_cast<uint32_t>(this->state.window_posn);
+	checkpoint.R = {{static_cast<uint32_t>(this->state.R0), static_cast<uint32_t>(this->state.R1), static_cast<uint32_t>(this->state.R2)}};
+	checkpoint.header_read = this->state.header_read;
+	checkpoint.block_type = static_cast<uint8_t>(this->state.block_type);
+	checkpoint.block_length = this->state.block_length;
+	checkpoint.block_remaining = this->state.block_remaining;
+	checkpoint.main_tree_lengths = this->state.MAINTREE_len;
+	checkpoint.length_tree_lengths = this->state.LENGTH_len;
+	checkpoint.aligned_tree_lengths = this->state.ALIGNED_len;
+}
+
+void LzxDecoder::RestoreCheckpoint(const LzxCheckpoint& checkpoint)
+{
+	// checkpoints may come from a file, so anything that decoding relies on is checked
+	if(checkpoint.window.size() != this->state.window_size)
+	{
+		throw lzx_error("LzxDecoder::RestoreCheckpoint: window size " + std::to_string(checkpoint.window.size()) + " should be " + std::to_string(this->state.window_size));
+	}
+	// the position is masked at the start of the next run, so it can be at the end
+	if(checkpoint.window_position > this->state.window_size)
+	{
+		throw lzx_error("LzxDecoder::RestoreCheckpoint: window position is past the window");
+	}
+	// matches copy from window_posn - R, so an offset must point into the window
+	if(std::any_of(checkpoint.R.begin(), checkpoint.R.end(), [this](const uint32_t R) { return R == 0 || R > this->state.window_size; }))
+	{
+		throw lzx_error("LzxDecoder::RestoreCheckpoint: invalid repeated offset");
+	}
+	if(checkpoint.block_type > static_cast<uint8_t>(BLOCKTYPE::UNCOMPRESSED) || checkpoint.block_remaining > checkpoint.block_length
+	|| (checkpoint.block_remaining != 0 && checkpoint.block_type == static_cast<uint8_t>(BLOCKTYPE::INVALID)))
+	{
+		throw lzx_error("LzxDecoder::RestoreCheckpoint: invalid block");
+	}
+	auto check_lengths = [](const uint8_t* lengths, const std::size_t count, const uint8_t max)
+	{
+		if(std::any_of(lengths, lengths + count, [max](const uint8_t length) { return length > max; }))
+		{
+			throw lzx_error("LzxDecoder::RestoreCheckpoint: invalid code length");
+		}
+	};
+	check_lengths(checkpoint.main_tree_lengths.data(), checkpoint.main_tree_lengths.size(), 16);
+	check_lengths(checkpoint.length_tree_lengths.data(), checkpoint.length_tree_lengths.size(), 16);
+	check_lengths(checkpoint.aligned_tree_lengths.data(), checkpoint.aligned_tree_lengths.size(), 7);
+
+	std::copy(checkpoint.window.begin(), checkpoint.window.end(), this->state.window);
+	this->state.window_posn = checkpoint.window_position;
+	this->state.R0 = checkpoint.R[0];
+	this->state.R1 = checkpoint.R[1];
+	this->state.R2 = checkpoint.R[2];
+	this->state.header_read = checkpoint.header_read;
+	this->state.block_type = static_cast<BLOCKTYPE>(checkpoint.block_type);
+	this->state.block_length = checkpoint.block_length;
+	this->state.block_remaining = checkpoint.block_remaining;
+	this->state.MAINTREE_len = checkpoint.main_tree_lengths;
+	this->state.LENGTH_len = checkpoint.length_tree_lengths;
+	this->state.ALIGNED_len = checkpoint.aligned_tree_lengths;
+
+	// the tables are not saved: a block that continues into the next frame has them rebuilt from its lengths
+	if(this->state.block_remaining != 0 && this->state.block_type != BLOCKTYPE::UNCOMPRESSED)
+	{
+		if(this->state.block_type == BLOCKTYPE::ALIGNED)
+		{
+			this->MakeDecodeTable(ALIGNED_MAXSYMBOLS, ALIGNED_TABLEBITS, this->state.ALIGNED_len.data(), this->state.ALIGNED_table.data());
+		}
+		this->MakeDecodeTable(MAINTREE_MAXSYMBOLS, MAINTREE_TABLEBITS, this->state.MAINTREE_len.data(), this->state.MAINTREE_table.data());
+		this->MakeDecodeTable(LENGTH_MAXSYMBOLS, LENGTH_TABLEBITS, this->state.LENGTH_len.data(), this->state.LENGTH_table.data());
+	}
+}
+
+void LzxDecoder::SetAnalysis(LzxAnalysis* analysis)
+{
+	this->analysis = analysis;
+}
+
+void LzxDecoder::AnalyzeTrees(const uint_fast64_t bits)
+{
+	LzxAnalysis& a = *this->analysis;
+	++a.blocks[static_cast<size_t>(this->state.block_type)];
+	if(this->state.block_type == BLOCKTYPE::UNCOMPRESSED)
+	{
+		a.uncompressed_block_bytes += this->state.block_length;
+		return;
+	}
+	auto used = [](const uint8_t* lengths, const size_t count)
+	{
+		return static_cast<uint64_t>(count - static_cast<size_t>(std::count(lengths, lengths + count, 0)));
+	};
+	a.main_tree_symbols += used(this->state.MAINTREE_len.data(), this->state.main_elements);
+	a.length_tree_symbols += used(this->state.LENGTH_len.data(), NUM_SECONDARY_LENGTHS);
+	if(this->state.block_type == BLOCKTYPE::ALIGNED)
+	{
+		a.aligned_tree_symbols += used(this->state.ALIGNED_len.data(), ALIGNED_MAXSYMBOLS);
+	}
+	a.tree_bits += bits;
+}
+
+namespace {
+
+// 0 for 0, which corrupt data can give as an offset
+size_t floor_log2(const uint_fast32_t x)
+{
+	return static_cast<size_t>(31 - __builtin_clz(static_cast<uint32_t>(x) | 1));
+}
+
+} // namespace
+
+void LzxDecoder::AnalyzeMatch(const uint_fast32_t match_length, const uint_fast32_t match_offset, const uint_fast32_t slot)
+{
+	LzxAnalysis& a = *this->analysis;
+	++a.matches;
+	a.match_bytes += match_length;
+	if(slot < 3)
+	{
+		++a.repeat_offsets[slot];
+	}
+	++a.match_lengths[std::min(floor_log2(match_length), a.match_lengths.size() - 1)];
+	++a.match_offsets[std::min(floor_log2(match_offset), a.match_offsets.size() - 1)];
+}
+
+void LzxAnalysis::merge(const LzxAnalysis& other)
+{
+	this->frames += other.frames;
+	this->compressed_bytes += other.compressed_bytes;
+	this->decompressed_bytes += other.decompressed_bytes;
+	for(size_t i = 0; i < this->blocks.size(); ++i)
+	{
+		this->blocks[i] += other.blocks[i];
+	}
+	this->uncompressed_block_bytes += other.uncompressed_block_bytes;
+	this->main_tree_symbols += other.main_tree_symbols;
+	this->length_tree_symbols += other.length_tree_symbols;
+	this->aligned_tree_symbols += other.aligned_tree_symbols;
+	this->tree_bits += other.tree_bits;
+	this->matches += other.matches;
+	this->match_bytes += other.match_bytes;
+	for(size_t i = 0; i < this->repeat_offsets.size(); ++i)
+	{
+		this->repeat_offsets[i] += other.repeat_offsets[i];
+	}
+	for(size_t i = 0; i < this->match_lengths.size(); ++i)
+	{
+		this->match_lengths[i] += other.match_lengths[i];
+	}
+	for(size_t i = 0; i < this->match_offsets.size(); ++i)
+	{
+		this->match_offsets[i] += other.match_offsets[i];
+	}
+}
+
+void LzxAnalysis::print(std::ostream& out) const
+{
+	auto percent = [](const uint64_t part, const uint64_t whole)
+	{
+		return (whole == 0) ? 0.0 : 100.0 * static_cast<double>(part) / static_cast<double>(whole);
+	};
+	char line[128];
+	std::snprintf(line, sizeof(line), "  frames %" PRIu64 ", %" PRIu64 " -> %" PRIu64 " bytes (%.1f%%)\n", this->frames, this->compressed_bytes, this->decompressed_bytes, percent(this->compressed_bytes, this->decompressed_bytes));
+	out << line;
+	std::snprintf(line, sizeof(line), "  blocks: %" PRIu64 " verbatim, %" PRIu64 " aligned, %" PRIu64 " uncompressed (%" PRIu64 " bytes)\n", this->blocks[1], this->blocks[2], this->blocks[3], this->uncompressed_block_bytes);
+	out << line;
+	const uint64_t coded_blocks = std::max<uint64_t>(1, this->blocks[1] + this->blocks[2]);
+	std::snprintf(line, sizeof(line), "  trees per block: %.1f main, %.1f length, %.1f aligned symbols, %.0f header bits\n",
+		static_cast<double>(this->main_tree_symbols) / static_cast<double>(coded_blocks),
+		static_cast<double>(this->length_tree_symbols) / static_cast<double>(coded_blocks),
+		static_cast<double>(this->aligned_tree_symbols) / static_cast<double>(std::max<uint64_t>(1, this->blocks[2])),
+		static_cast<double>(this->tree_bits) / static_cast<double>(coded_blocks));
+	out << line;
+	std::snprintf(line, sizeof(line), "  literals %" PRIu64 ", matches %" PRIu64 " (%" PRIu64 " bytes, %.1f%% of output)\n", this->literals(), this->matches, this->match_bytes, percent(this->match_bytes, this->decompressed_bytes));
+	out << line;
+	std::snprintf(line, sizeof(line), "  repeat offsets: R0 %" PRIu64 ", R1 %" PRIu64 ", R2 %" PRIu64 " (%.1f%% of matches)\n", this->repeat_offsets[0], this->repeat_offsets[1], this->repeat_offsets[2], percent(this->repeat_offsets[0] + this->repeat_offsets[1] + this->repeat_offsets[2], this->matches));
+	out << line;
+	auto histogram = [&out, &line, &percent](const char* name, const uint64_t* counts, const size_t size, const uint64_t total, const uint64_t last)
+	{
+		out << "  " << name << ":\n";
+		for(size_t i = 0; i < size; ++i)
+		{
+			if(counts[i] == 0)
+			{
+				continue;
+			}
+			const uint64_t low = uint64_t(1) << i;
+			const uint64_t high = (i + 1 == size) ? last : (low << 1) - 1;
+			std::snprintf(line, sizeof(line), "    %8" PRIu64 "-%-8" PRIu64 " %12" PRIu64 " %5.1f%%\n", low, high, counts[i], percent(counts[i], total));
+			out << line;
+		}
+	};
+	histogram("match lengths", this->match_lengths.data(), this->match_lengths.size(), this->matches, MAX_MATCH);
+	histogram("match offsets", this->match_offsets.data(), this->match_offsets.size(), this->matches, uint64_t(1) << (this->match_offsets.size() - 1));
 }
 
 void LzxDecoder::MakeDecodeTable(uint16_t nsyms, uint8_t nbits, uint8_t* length, uint16_t* table)
 {
+	const XNA::Stats::Timer timer(XNA::Stats::Stage::decode_table);
+	XNA::Stats::add(XNA::Stats::Counter::decode_tables);
 	uint_fast32_t leaf;
 	uint8_t bit_num = 1;
 	uint_fast32_t pos		= 0; // the current position in the decode table
@@ -0,0 +1,442 @@
+#include "LzxEncoder.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <string>
+#include <utility>
+
+#include "xna_exception.hpp"
+
+namespace {
+
+const uint_fast32_t HASH_BITS = 16;
+// how many earlier positions with the same hash are tried; more compresses better and slower
+const uint_fast32_t MAX_CHAIN = 32;
+const uint_fast32_t MIN_ENCODED_MATCH = 3;
+const uint8_t MAX_CODE_LENGTH = 16;
+const uint8_t MAX_PRETREE_CODE_LENGTH = 15; // stored in 4 bits
+
+// LZX bits are packed most significant first into little-endian 16-bit words (see BitBuffer)
+class BitWriter
+{
+	public:
+		explicit BitWriter(std::vector<uint8_t>& out)
+		:
+			out(out),
+			pending(0),
+			pending_bits(0)
+		{
+		}
+
+		void Write(const uint32_t value, const uint_fast8_t bits)
+		{
+			this->pending = (this->pending << bits) | value;
+			this->pending_bits += bits;
+			while(this->pending_bits >= 16)
+			{
+				this->pending_bits -= 16;
+				const uint16_t word = static_cast<uint16_t>(this->pending >> this->pending_bits);
+				this->out.push_back(static_cast<uint8_t>(word & 0xFF));
+				this->out.push_back(static_cast<uint8_t>(word >> 8));
+			}
+			this->pending &= (uint64_t(1) << this->pending_bits) - 1;
+		}
+
+		void Flush()
+		{
+			if(this->pending_bits != 0)
+			{
+				this->Write(0, static_cast<uint_fast8_t>(16 - this->pending_bits));
+			}
+		}
+
+	private:
+		std::vector<uint8_t>& out;
+		uint64_t pending;
+		uint_fast8_t pending_bits;
+};
+
+// Huffman code lengths of at most max_length bits; a code with any symbols has at least 2, so that LzxDecoder accepts its table
+void build_lengths(const uint32_t* frequencies, const uint_fast32_t count, const uint8_t max_length, uint8_t* lengths)
+{
+	std::vector<uint32_t> f(frequencies, frequencies + count);
+	std::fill_n(lengths, count, 0);
+	uint_fast32_t used = static_cast<uint_fast32_t>(std::count_if(f.begin(), f.end(), [](const uint32_t n) { return n != 0; }));
+	if(used == 0)
+	{
+		return;
+	}
+	for(uint_fast32_t i = 0; used < 2 && i < count; ++i)
+	{
+		if(f[i] == 0)
+		{
+			f[i] = 1;
+			++used;
+		}
+	}
+
+	struct Node
+	{
+		int_fast32_t left; // -1 for a leaf
+		int_fast32_t right; // the symbol of a leaf
+	};
+	using Item = std::pair<uint64_t, uint_fast32_t>;
+	while(true)
+	{
+		std::vector<Node> nodes;
+		std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+		for(uint_fast32_t i = 0; i < count; ++i)
+		{
+			if(f[i] != 0)
+			{
+				nodes.push_back({-1, static_cast<int_fast32_t>(i)});
+				queue.emplace(f[i], nodes.size() - 1);
+			}
+		}
+		while(queue.size() > 1)
+		{
+			const Item a = queue.top();
+			queue.pop();
+			const Item b = queue.top();
+			queue.pop();
+			nodes.push_back({static_cast<int_fast32_t>(a.second), static_cast<int_fast32_t>(b.second)});
+			queue.emplace(a.first + b.first, nodes.size() - 1);
+		}
+
+		uint_fast32_t longest = 0;
+		std::vector<std::pair<uint_fast32_t, uint_fast32_t>> stack = {{queue.top().second, 0}};
+		while(!stack.empty())
+		{
+			const std::pair<uint_fast32_t, uint_fast32_t> node = stack.back();
+			stack.pop_back();
+			const Node& n = nodes[node.first];
+			if(n.left < 0)
+			{
+				lengths[n.right] = static_cast<uint8_t>(node.second);
+				longest = std::max(longest, node.second);
+			}
+			else
+			{
+				stack.emplace_back(n.left, node.second + 1);
+				stack.emplace_back(n.right, node.second + 1);
+			}
+		}
+		if(longest <= max_length)
+		{
+			return;
+		}
+		// flatten the distribution until the tree is shallow enough
+		for(uint32_t& n : f)
+		{
+			if(n != 0)
+			{
+				n = (n + 1) / 2;
+			}
+		}
+	}
+}
+
+// canonical codes, assigned in the order LzxDecoder::MakeDecodeTable expects
+void make_codes(const uint8_t* lengths, const uint_fast32_t count, uint32_t* codes)
+{
+	uint32_t code = 0;
+	for(uint8_t bits = 1; bits <= MAX_CODE_LENGTH; ++bits)
+	{
+		for(uint_fast32_t i = 0; i < count; ++i)
+		{
+			if(lengths[i] == bits)
+			{
+				codes[i] = code++;
+			}
+		}
+		code <<= 1;
+	}
+}
+
+// the inverse of LzxDecoder::ReadLengths: a pretree, then the lengths as deltas from the previous ones and runs of zeros
+void write_lengths(const uint8_t* old_lengths, const uint8_t* new_lengths, const uint_fast32_t first, const uint_fast32_t last, BitWriter& writer)
+{
+	struct PretreeCode
+	{
+		uint8_t symbol;
+		uint8_t extra_bit_count;
+		uint8_t extra_bits;
+	};
+	std::vector<PretreeCode> codes;
+	for(uint_fast32_t i = first; i < last; )
+	{
+		if(new_lengths[i] == 0)
+		{
+			uint_fast32_t run = 1;
+			while(i + run < last && run < 51 && new_lengths[i + run] == 0)
+			{
+				++run;
+			}
+			if(run >= 20)
+			{
+				codes.push_back({18, 5, static_cast<uint8_t>(run - 20)});
+				i += run;
+				continue;
+			}
+			if(run >= 4)
+			{
+				codes.push_back({17, 4, static_cast<uint8_t>(run - 4)});
+				i += run;
+				continue;
+			}
+		}
+		codes.push_back({static_cast<uint8_t>((old_lengths[i] + 17 - new_lengths[i]) % 17), 0, 0});
+		++i;
+	}
+
+	uint32_t frequencies[PRETREE_MAXSYMBOLS] = {};
+	for(const PretreeCode& code : codes)
+	{
+		++frequencies[code.symbol];
+	}
+	uint8_t lengths[PRETREE_MAXSYMBOLS];
+	build_lengths(frequencies, PRETREE_MAXSYMBOLS, MAX_PRETREE_CODE_LENGTH, lengths);
+	uint32_t pretree[PRETREE_MAXSYMBOLS] = {};
+	make_codes(lengths, PRETREE_MAXSYMBOLS, pretree);
+
+	for(const uint8_t length : lengths)
+	{
+		writer.Write(length, 4);
+	}
+	for(const PretreeCode& code : codes)
+	{
+		writer.Write(pretree[code.symbol], lengths[code.symbol]);
+		writer.Write(code.extra_bits, code.extra_bit_count);
+	}
+}
+
+uint_fast32_t match_length(const uint8_t* a, const uint8_t* b, const uint_fast32_t max_length)
+{
+	uint_fast32_t length = 0;
+	while(length + 8 <= max_length)
+	{
+		uint64_t x, y;
+		std::memcpy(&x, a + length, 8);
+		std::memcpy(&y, b + length, 8);
+		if(x != y)
+		{
+			// the first differing byte is the lowest on a little-endian host
+			return length + static_cast<uint_fast32_t>(__builtin_ctzll(x ^ y) / 8);
+		}
+		length += 8;
+	}
+	while(length < max_length && a[length] == b[length])
+	{
+		++length;
+	}
+	return length;
+}
+
+uint_fast32_t hash3(const uint8_t* p)
+{
+	const uint32_t v = (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+	return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+} // namespace
+
+LzxEncoder::LzxEncoder(const uint_fast16_t window_bits)
+{
+	if(window_bits < 15 || window_bits > 21)
+	{
+		throw lzx_error("LzxEncoder: unsupported window size exponent: " + std::to_string(window_bits));
+	}
+	this->window_size = 1 << window_bits;
+
+	// as in LzxDecoder
+	for(uint_fast32_t i = 0, j = 0; i <= 50; i += 2)
+	{
+		this->extra_bits[i] = this->extra_bits[i + 1] = static_cast<uint8_t>(j);
+		if((i != 0) && (j < 17))
+		{
+			++j;
+		}
+	}
+	for(uint_fast32_t i = 0, j = 0; i <= 50; ++i)
+	{
+		this->position_base[i] = static_cast<uint32_t>(j);
+		j += 1 << this->extra_bits[i];
+	}
+	const uint_fast32_t posn_slots = (window_bits == 20) ? 42 : (window_bits == 21) ? 50 : window_bits * 2;
+	this->main_elements = static_cast<uint16_t>(NUM_CHARS + (posn_slots * 8));
+}
+
+void LzxEncoder::Compress(const uint8_t* data, const uint_fast64_t size, const std::function<void(const std::vector<uint8_t>& block, uint_fast32_t frame_size)>& write_frame)
+{
+	this->R0 = this->R1 = this->R2 = 1;
+	this->head.assign(uint_fast32_t(1) << HASH_BITS, -1);
+	this->prev.assign(this->window_size, -1);
+	this->MAINTREE_len.fill(0);
+	this->LENGTH_len.fill(0);
+
+	std::vector<uint8_t> block;
+	for(uint_fast64_t begin = 0; begin < size; begin += FRAME_SIZE)
+	{
+		const uint_fast64_t end = std::min<uint_fast64_t>(begin + FRAME_SIZE, size);
+		this->tokens.clear();
+		this->Parse(data, size, begin, end);
+		block.clear();
+		this->WriteBlock(static_cast<uint_fast32_t>(end - begin), begin == 0, block);
+		write_frame(block, static_cast<uint_fast32_t>(end - begin));
+	}
+}
+
+void LzxEncoder::Insert(const uint8_t* data, const uint_fast64_t size, const uint_fast64_t pos)
+{
+	if(pos + 3 > size)
+	{
+		return;
+	}
+	const uint_fast32_t h = hash3(data + pos);
+	this->prev[pos & (this->window_size - 1)] = this->head[h];
+	this->head[h] = static_cast<int_fast64_t>(pos);
+}
+
+// greedy parse of one frame; matches end in the frame, since a block may not be overrun
+void LzxEncoder::Parse(const uint8_t* data, const uint_fast64_t size, const uint_fast64_t begin, const uint_fast64_t end)
+{
+	const uint_fast64_t max_offset = this->window_size - 3;
+	const uint32_t* position_base = this->position_base.data();
+	const uint32_t* position_base_end = position_base + (this->main_elements - NUM_CHARS) / 8;
+
+	for(uint_fast64_t pos = begin; pos < end; )
+	{
+		const uint_fast32_t max_length = static_cast<uint_fast32_t>(std::min<uint_fast64_t>(end - pos, MAX_MATCH));
+		uint_fast32_t best_length = 0;
+		uint_fast64_t best_offset = 0;
+		int_fast32_t repeat = -1;
+		if(max_length >= MIN_ENCODED_MATCH)
+		{
+			// a repeated offset costs no offset bits, so it wins ties
+			const uint_fast32_t repeats[3] = {this->R0, this->R1, this->R2};
+			for(int_fast32_t r = 0; r < 3; ++r)
+			{
+				if(repeats[r] <= pos)
+				{
+					const uint_fast32_t length = match_length(data + pos, data + pos - repeats[r], max_length);
+					if(length > best_length)
+					{
+						best_length = length;
+						best_offset = repeats[r];
+						repeat = r;
+					}
+				}
+			}
+			uint_fast32_t chain = MAX_CHAIN;
+			for(int_fast64_t c = this->head[hash3(data + pos)]; c >= 0 && chain != 0 && best_length < max_length; c = this->prev[static_cast<uint_fast64_t>(c) & (this->window_size - 1)], --chain)
+			{
+				const uint_fast64_t offset = pos - static_cast<uint_fast64_t>(c);
+				if(offset > max_offset)
+				{
+					break;
+				}
+				const uint_fast32_t length = match_length(data + pos, data + c, max_length);
+				if(length > best_length)
+				{
+					best_length = length;
+					best_offset = offset;
+					repeat = -1;
+				}
+			}
+		}
+
+		if(best_length < MIN_ENCODED_MATCH)
+		{
+			this->tokens.push_back({data[pos], -1, 0, 0});
+			this->Insert(data, size, pos);
+			++pos;
+			continue;
+		}
+
+		Token token;
+		const uint_fast32_t length_header = std::min<uint_fast32_t>(best_length - MIN_MATCH, NUM_PRIMARY_LENGTHS);
+		token.length_footer = static_cast<int16_t>((length_header == NUM_PRIMARY_LENGTHS) ? best_length - MIN_MATCH - NUM_PRIMARY_LENGTHS : -1);
+		uint_fast32_t slot;
+		if(repeat >= 0)
+		{
+			slot = static_cast<uint_fast32_t>(repeat);
+			token.extra_bit_count = 0;
+			token.extra_bits = 0;
+			if(repeat == 1)
+			{
+				std::swap(this->R0, this->R1);
+			}
+			else if(repeat == 2)
+			{
+				std::swap(this->R0, this->R2);
+			}
+		}
+		else
+		{
+			const uint32_t formatted_offset = static_cast<uint32_t>(best_offset + 2);
+			slot = static_cast<uint_fast32_t>(std::upper_bound(position_base, position_base_end, formatted_offset) - position_base - 1);
+			token.extra_bit_count = this->extra_bits[slot];
+			token.extra_bits = formatted_offset - this->position_base[slot];
+			this->R2 = this->R1;
+			this->R1 = this->R0;
+			this->R0 = static_cast<uint_fast32_t>(best_offset);
+		}
+		token.main_element = static_cast<uint16_t>(NUM_CHARS + (slot << 3) + length_header);
+		this->tokens.push_back(token);
+
+		for(uint_fast32_t i = 0; i < best_length; ++i)
+		{
+			this->Insert(data, size, pos + i);
+		}
+		pos += best_length;
+	}
+}
+
+void LzxEncoder::WriteBlock(const uint_fast32_t block_length, const bool first, std::vector<uint8_t>& out)
+{
+	std::array<uint32_t, MAINTREE_MAXSYMBOLS> main_frequencies = {};
+	std::array<uint32_t, LENGTH_MAXSYMBOLS> length_frequencies = {};
+	for(const Token& token : this->tokens)
+	{
+		++main_frequencies[token.main_element];
+		if(token.length_footer >= 0)
+		{
+			++length_frequencies[static_cast<uint_fast32_t>(token.length_footer)];
+		}
+	}
+	std::array<uint8_t, MAINTREE_MAXSYMBOLS> main_lengths = {};
+	std::array<uint8_t, LENGTH_MAXSYMBOLS> length_lengths = {};
+	build_lengths(main_frequencies.data(), this->main_elements, MAX_CODE_LENGTH, main_lengths.data());
+	build_lengths(length_frequencies.data(), NUM_SECONDARY_LENGTHS, MAX_CODE_LENGTH, length_lengths.data());
+	std::array<uint32_t, MAINTREE_MAXSYMBOLS> main_codes = {};
+	std::array<uint32_t, LENGTH_MAXSYMBOLS> length_codes = {};
+	make_codes(main_lengths.data(), this->main_elements, main_codes.data());
+	make_codes(length_lengths.data(), NUM_SECONDARY_LENGTHS, length_codes.data());
+
+	BitWriter writer(out);
+	if(first)
+	{
+		writer.Write(0, 1); // no Intel E8 translation
+	}
+	writer.Write(1, 3); // verbatim
+	writer.Write(static_cast<uint32_t>(block_length >> 8), 16);
+	writer.Write(static_cast<uint32_t>(block_length & 0xFF), 8);
+	write_lengths(this->MAINTREE_len.data(), main_lengths.data(), 0, NUM_CHARS, writer);
+	write_lengths(this->MAINTREE_len.data(), main_lengths.data(), NUM_CHARS, this->main_elements, writer);
+	write_lengths(this->LENGTH_len.data(), length_lengths.data(), 0, NUM_SECONDARY_LENGTHS, writer);
+	this->MAINTREE_len = main_lengths;
+	this->LENGTH_len = length_lengths;
+
+	for(const Token& token : this->tokens)
+	{
+		writer.Write(main_codes[token.main_element], main_lengths[token.main_element]);
+		if(token.length_footer >= 0)
+		{
+			const uint_fast32_t footer = static_cast<uint_fast32_t>(token.length_footer);
+			writer.Write(length_codes[footer], length_lengths[footer]);
+		}
+		writer.Write(token.extra_bits, token.extra_bit_count);
+	}
+	writer.Flush();
+}
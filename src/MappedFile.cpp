@@ -0,0 +1,67 @@
+#include "MappedFile.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "xna_exception.hpp"
+
+namespace XNA {
+
+MappedFile::MappedFile(const std::string& filename)
+:
+	mapping(nullptr),
+	length(0)
+{
+	const int fd = open(filename.c_str(), O_RDONLY);
+	if(fd == -1)
+	{
+		throw xna_error("error opening " + filename + ": " + std::strerror(errno));
+	}
+	struct stat st;
+	if(fstat(fd, &st) == -1)
+	{
+		const int e = errno;
+		close(fd);
+		throw xna_error("error reading size of " + filename + ": " + std::strerror(e));
+	}
+	this->length = static_cast<uint_fast64_t>(st.st_size);
+
+	// mmap does not accept a length of 0
+	if(this->length != 0)
+	{
+		void* p = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(p == MAP_FAILED)
+		{
+			const int e = errno;
+			close(fd);
+			throw xna_error("error mapping " + filename + ": " + std::strerror(e));
+		}
+		this->mapping = static_cast<const uint8_t*>(p);
+	}
+	// the mapping stays valid after the descriptor is closed
+	close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if(this->mapping != nullptr)
+	{
+		munmap(const_cast<uint8_t*>(this->mapping), this->length);
+	}
+}
+
+const uint8_t* MappedFile::data() const
+{
+	return this->mapping;
+}
+
+uint_fast64_t MappedFile::size() const
+{
+	return this->length;
+}
+
+} // namespace XNA
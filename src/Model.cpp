@@ -0,0 +1,450 @@
+#include "Model.hpp"
+
+#include <cstring>
+
+#include "Stats.hpp"
+#include "Xbox360.hpp"
+
+namespace XNA {
+namespace Content {
+
+using std::to_string;
+
+namespace {
+
+const std::string CONTENT_NAMESPACE = "Microsoft.Xna.Framework.Content.";
+
+/*
+the size of the numbers an element of format is made of, which are byte-swapped on their own in big-endian content;
+Color and Byte4 are one packed 32-bit value
+*/
+uint_fast32_t swap_unit(const VertexElementFormat format)
+{
+	switch(format)
+	{
+		case VertexElementFormat::Short2:
+		case VertexElementFormat::Short4:
+		case VertexElementFormat::NormalizedShort2:
+		case VertexElementFormat::NormalizedShort4:
+		case VertexElementFormat::HalfVector2:
+		case VertexElementFormat::HalfVector4:
+			return 2;
+		default:
+			return 4;
+	}
+}
+
+Vector3 read_vector3(ContentReader& reader)
+{
+	Vector3 v;
+	v.x = reader.ReadFloat();
+	v.y = reader.ReadFloat();
+	v.z = reader.ReadFloat();
+	return v;
+}
+
+Matrix read_matrix(ContentReader& reader)
+{
+	Matrix m;
+	for(uint_fast32_t row = 0; row < 4; ++row)
+	{
+		for(uint_fast32_t column = 0; column < 4; ++column)
+		{
+			m.m[row][column] = reader.ReadFloat();
+		}
+	}
+	return m;
+}
+
+// a nullable string written as a nested object; "" for null
+std::string read_string_object(ContentReader& reader)
+{
+	const std::shared_ptr<ContentBase> object = reader.ReadObject();
+	if(object == nullptr)
+	{
+		return "";
+	}
+	if(object->get_type_reader_name() != CONTENT_NAMESPACE + "StringReader")
+	{
+		throw xna_error("expected a string, got " + object->get_type_reader_name());
+	}
+	return std::static_pointer_cast<String>(object)->value;
+}
+
+// nullptr for id 0; type_reader_name is checked unless it is empty
+template <typename T> std::shared_ptr<T> find_shared_resource(const std::vector<std::shared_ptr<ContentBase>>& shared_resources, const uint_fast64_t id, const std::string& type_reader_name)
+{
+	if(id == 0)
+	{
+		return nullptr;
+	}
+	if(id > shared_resources.size())
+	{
+		throw xna_error("shared resource id is too high (" + to_string(id) + " > " + to_string(shared_resources.size()) + ")");
+	}
+	const std::shared_ptr<ContentBase>& resource = shared_resources[id - 1];
+	if(resource != nullptr && !type_reader_name.empty() && resource->get_type_reader_name() != type_reader_name)
+	{
+		throw xna_error("shared resource is a " + resource->get_type_reader_name() + ", not a " + type_reader_name);
+	}
+	return std::static_pointer_cast<T>(resource);
+}
+
+} // namespace
+
+std::string to_string(const VertexElementFormat f)
+{
+	switch(f)
+	{
+		case VertexElementFormat::Single:			return "Single";
+		case VertexElementFormat::Vector2:			return "Vector2";
+		case VertexElementFormat::Vector3:			return "Vector3";
+		case VertexElementFormat::Vector4:			return "Vector4";
+		case VertexElementFormat::Color:			return "Color";
+		case VertexElementFormat::Byte4:			return "Byte4";
+		case VertexElementFormat::Short2:			return "Short2";
+		case VertexElementFormat::Short4:			return "Short4";
+		case VertexElementFormat::NormalizedShort2:	return "NormalizedShort2";
+		case VertexElementFormat::NormalizedShort4:	return "NormalizedShort4";
+		case VertexElementFormat::HalfVector2:		return "HalfVector2";
+		case VertexElementFormat::HalfVector4:		return "HalfVector4";
+	}
+	return to_string(static_cast<int32_t>(f));
+}
+
+uint_fast32_t element_size(const VertexElementFormat f)
+{
+	switch(f)
+	{
+		case VertexElementFormat::Single:			return 4;
+		case VertexElementFormat::Vector2:			return 8;
+		case VertexElementFormat::Vector3:			return 12;
+		case VertexElementFormat::Vector4:			return 16;
+		case VertexElementFormat::Color:			return 4;
+		case VertexElementFormat::Byte4:			return 4;
+		case VertexElementFormat::Short2:			return 4;
+		case VertexElementFormat::Short4:			return 8;
+		case VertexElementFormat::NormalizedShort2:	return 4;
+		case VertexElementFormat::NormalizedShort4:	return 8;
+		case VertexElementFormat::HalfVector2:		return 4;
+		case VertexElementFormat::HalfVector4:		return 8;
+	}
+	throw xna_error("invalid vertex element format: " + to_string(f));
+}
+
+std::string to_string(const VertexElementUsage u)
+{
+	switch(u)
+	{
+		case VertexElementUsage::Position:			return "Position";
+		case VertexElementUsage::Color:				return "Color";
+		case VertexElementUsage::TextureCoordinate:	return "TextureCoordinate";
+		case VertexElementUsage::Normal:			return "Normal";
+		case VertexElementUsage::Binormal:			return "Binormal";
+		case VertexElementUsage::Tangent:			return "Tangent";
+		case VertexElementUsage::BlendIndices:		return "BlendIndices";
+		case VertexElementUsage::BlendWeight:		return "BlendWeight";
+		case VertexElementUsage::Depth:				return "Depth";
+		case VertexElementUsage::Fog:				return "Fog";
+		case VertexElementUsage::PointSize:			return "PointSize";
+		case VertexElementUsage::Sample:			return "Sample";
+		case VertexElementUsage::TessellateFactor:	return "TessellateFactor";
+	}
+	return to_string(static_cast<int32_t>(u));
+}
+
+VertexDeclaration::VertexDeclaration()
+:
+	stride(0)
+{
+	this->type_reader_name = CONTENT_NAMESPACE + "VertexDeclarationReader";
+}
+
+VertexDeclaration::VertexDeclaration(ContentReader& reader)
+:
+	VertexDeclaration()
+{
+	this->stride = reader.ReadUInt32();
+	const uint32_t element_count = reader.ReadUInt32();
+	if(static_cast<uint_fast64_t>(element_count) * 16 > reader.GetRemaining())
+	{
+		throw xna_error("vertex declaration of " + to_string(element_count) + " elements is larger than the remaining data");
+	}
+	this->elements.resize(element_count);
+	for(VertexElement& element : this->elements)
+	{
+		element.offset = reader.ReadUInt32();
+		element.format = static_cast<VertexElementFormat>(reader.ReadInt32());
+		element.usage = static_cast<VertexElementUsage>(reader.ReadInt32());
+		element.usage_index = reader.ReadUInt32();
+		if(element.offset + static_cast<uint_fast64_t>(element_size(element.format)) > this->stride)
+		{
+			throw xna_error("vertex element at offset " + to_string(element.offset) + " does not fit in the stride (" + to_string(this->stride) + ")");
+		}
+	}
+}
+
+const VertexElement* VertexDeclaration::find_element(const VertexElementUsage usage, const uint32_t usage_index) const
+{
+	for(const VertexElement& element : this->elements)
+	{
+		if(element.usage == usage && element.usage_index == usage_index)
+		{
+			return &element;
+		}
+	}
+	return nullptr;
+}
+
+VertexBuffer::VertexBuffer(ContentReader& reader)
+:
+	declaration(reader)
+{
+	this->type_reader_name = CONTENT_NAMESPACE + "VertexBufferReader";
+	this->vertex_count = reader.ReadUInt32();
+	const uint_fast64_t size = static_cast<uint_fast64_t>(this->vertex_count) * this->declaration.stride;
+	if(size > reader.GetRemaining())
+	{
+		throw xna_error("vertex buffer of " + to_string(this->vertex_count) + " vertices is larger than the remaining data");
+	}
+	if(!reader.IsBigEndian())
+	{
+		this->data = reader.ReadShared(size);
+		return;
+	}
+
+	// one swap over the whole buffer if every element is made of numbers of the same size at offsets aligned to it
+	uint_fast32_t unit = 0;
+	bool uniform = true;
+	for(const VertexElement& element : this->declaration.elements)
+	{
+		const uint_fast32_t element_unit = swap_unit(element.format);
+		uniform = uniform && (unit == 0 || unit == element_unit) && element.offset % element_unit == 0;
+		unit = element_unit;
+	}
+	if(uniform && unit != 0 && this->declaration.stride % unit == 0)
+	{
+		this->data = reader.ReadSwapped(size, unit);
+		return;
+	}
+	const uint8_t* p = reader.ReadView(size);
+	reader.GetBudget().allocate(size, "byte-swapped copy of content data");
+	Stats::add_allocation(size);
+	std::shared_ptr<uint8_t> copy(new uint8_t[size], std::default_delete<uint8_t[]>());
+	std::memcpy(copy.get(), p, size);
+	for(uint_fast64_t vertex = 0; vertex < this->vertex_count; ++vertex)
+	{
+		uint8_t* v = copy.get() + vertex * this->declaration.stride;
+		for(const VertexElement& element : this->declaration.elements)
+		{
+			byte_swap(v + element.offset, element_size(element.format), swap_unit(element.format));
+		}
+	}
+	this->data = std::move(copy);
+}
+
+const uint8_t* VertexBuffer::get_data() const
+{
+	return this->data.get();
+}
+
+uint_fast64_t VertexBuffer::get_data_size() const
+{
+	return static_cast<uint_fast64_t>(this->vertex_count) * this->declaration.stride;
+}
+
+IndexBuffer::IndexBuffer(ContentReader& reader)
+{
+	this->type_reader_name = CONTENT_NAMESPACE + "IndexBufferReader";
+	this->sixteen_bits = reader.ReadBoolean();
+	this->data_size = reader.ReadUInt32();
+	if(this->data_size % (this->sixteen_bits ? 2 : 4) != 0)
+	{
+		throw xna_error("index buffer size (" + to_string(this->data_size) + ") is not a whole number of indices");
+	}
+	this->data = reader.ReadSwapped(this->data_size, this->sixteen_bits ? 2 : 4);
+}
+
+const uint8_t* IndexBuffer::get_data() const
+{
+	return this->data.get();
+}
+
+uint32_t IndexBuffer::get_data_size() const
+{
+	return this->data_size;
+}
+
+uint32_t IndexBuffer::get_index_count() const
+{
+	return this->data_size / (this->sixteen_bits ? 2 : 4);
+}
+
+ArrayView<uint16_t> IndexBuffer::get_indices16() const
+{
+	if(!this->sixteen_bits)
+	{
+		throw xna_error("index buffer has 32 bit indices");
+	}
+	return view_or_copy<uint16_t>(this->data, this->get_index_count());
+}
+
+ArrayView<uint32_t> IndexBuffer::get_indices32() const
+{
+	if(this->sixteen_bits)
+	{
+		throw xna_error("index buffer has 16 bit indices");
+	}
+	return view_or_copy<uint32_t>(this->data, this->get_index_count());
+}
+
+Effect::Effect(ContentReader& reader)
+{
+	this->type_reader_name = CONTENT_NAMESPACE + "EffectReader";
+	this->bytecode_size = reader.ReadUInt32();
+	this->bytecode = reader.ReadShared(this->bytecode_size);
+}
+
+const uint8_t* Effect::get_bytecode() const
+{
+	return this->bytecode.get();
+}
+
+uint32_t Effect::get_bytecode_size() const
+{
+	return this->bytecode_size;
+}
+
+BasicEffect::BasicEffect(ContentReader& reader)
+{
+	this->type_reader_name = CONTENT_NAMESPACE + "BasicEffectReader";
+	this->texture = reader.ReadExternalReference();
+	this->diffuse_color = read_vector3(reader);
+	this->emissive_color = read_vector3(reader);
+	this->specular_color = read_vector3(reader);
+	this->specular_power = reader.ReadFloat();
+	this->alpha = reader.ReadFloat();
+	this->vertex_color_enabled = reader.ReadBoolean();
+}
+
+EffectMaterial::EffectMaterial(ContentReader& reader)
+{
+	this->type_reader_name = CONTENT_NAMESPACE + "EffectMaterialReader";
+	this->effect = reader.ReadExternalReference();
+	this->parameters = reader.ReadObject();
+}
+
+Model::Model(ContentReader& reader)
+{
+	this->type_reader_name = CONTENT_NAMESPACE + "ModelReader";
+	this->read(reader);
+}
+
+// 1 byte if there are fewer than 255 bones, otherwise 4; 0 is null and anything else is index + 1
+uint32_t Model::read_bone_reference(ContentReader& reader) const
+{
+	const uint32_t bone_count = static_cast<uint32_t>(this->bones.size());
+	const uint32_t reference = (bone_count < 255) ? reader.ReadUInt8() : reader.ReadUInt32();
+	if(reference == 0)
+	{
+		return ModelBone::NONE;
+	}
+	if(reference > bone_count)
+	{
+		throw xna_error("bone reference is too high (" + to_string(reference) + " > " + to_string(bone_count) + ")");
+	}
+	return reference - 1;
+}
+
+void Model::read(ContentReader& reader)
+{
+	// each bone takes at least a type id and a matrix
+	const uint32_t bone_count = reader.ReadUInt32();
+	if(static_cast<uint_fast64_t>(bone_count) * 65 > reader.GetRemaining())
+	{
+		throw xna_error("model of " + to_string(bone_count) + " bones is larger than the remaining data");
+	}
+	this->bones.resize(bone_count);
+	for(ModelBone& bone : this->bones)
+	{
+		bone.name = read_string_object(reader);
+		bone.transform = read_matrix(reader);
+	}
+	for(ModelBone& bone : this->bones)
+	{
+		bone.parent = this->read_bone_reference(reader);
+		const uint32_t child_count = reader.ReadUInt32();
+		if(child_count > reader.GetRemaining())
+		{
+			throw xna_error("bone has more children (" + to_string(child_count) + ") than the remaining data");
+		}
+		bone.children.reserve(child_count);
+		for(uint32_t i = 0; i < child_count; ++i)
+		{
+			const uint32_t child = this->read_bone_reference(reader);
+			if(child != ModelBone::NONE)
+			{
+				bone.children.push_back(child);
+			}
+		}
+	}
+
+	// each mesh takes at least a type id, a bone reference, a bounding sphere, a type id and a part count
+	const uint32_t mesh_count = reader.ReadUInt32();
+	if(static_cast<uint_fast64_t>(mesh_count) * 23 > reader.GetRemaining())
+	{
+		throw xna_error("model of " + to_string(mesh_count) + " meshes is larger than the remaining data");
+	}
+	this->meshes.resize(mesh_count);
+	for(ModelMesh& mesh : this->meshes)
+	{
+		mesh.name = read_string_object(reader);
+		mesh.parent_bone = this->read_bone_reference(reader);
+		mesh.bounds.center = read_vector3(reader);
+		mesh.bounds.radius = reader.ReadFloat();
+		mesh.tag = reader.ReadObject();
+
+		// 4 uint32s, a type id and 3 shared resource ids
+		const uint32_t part_count = reader.ReadUInt32();
+		if(static_cast<uint_fast64_t>(part_count) * 20 > reader.GetRemaining())
+		{
+			throw xna_error("mesh of " + to_string(part_count) + " parts is larger than the remaining data");
+		}
+		mesh.parts.resize(part_count);
+		for(ModelMeshPart& part : mesh.parts)
+		{
+			part.vertex_offset = reader.ReadUInt32();
+			part.vertex_count = reader.ReadUInt32();
+			part.start_index = reader.ReadUInt32();
+			part.primitive_count = reader.ReadUInt32();
+			part.tag = reader.ReadObject();
+			SharedResourceIds ids;
+			ids.vertex_buffer = reader.ReadSharedResource();
+			ids.index_buffer = reader.ReadSharedResource();
+			ids.effect = reader.ReadSharedResource();
+			this->shared_resource_ids.push_back(ids);
+		}
+	}
+
+	this->root_bone = this->read_bone_reference(reader);
+	this->tag = reader.ReadObject();
+}
+
+void Model::resolve_shared_resources(const std::vector<std::shared_ptr<ContentBase>>& shared_resources)
+{
+	std::vector<SharedResourceIds>::const_iterator ids = this->shared_resource_ids.begin();
+	for(ModelMesh& mesh : this->meshes)
+	{
+		for(ModelMeshPart& part : mesh.parts)
+		{
+			part.vertex_buffer = find_shared_resource<VertexBuffer>(shared_resources, ids->vertex_buffer, CONTENT_NAMESPACE + "VertexBufferReader");
+			part.index_buffer = find_shared_resource<IndexBuffer>(shared_resources, ids->index_buffer, CONTENT_NAMESPACE + "IndexBufferReader");
+			// BasicEffect, EffectMaterial or any other effect
+			part.effect = find_shared_resource<ContentBase>(shared_resources, ids->effect, "");
+			++ids;
+		}
+	}
+}
+
+} // namespace Content
+} // namespace XNA
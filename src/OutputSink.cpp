@@ -0,0 +1,66 @@
+#include "OutputSink.hpp"
+
+#include <cerrno>
+#include <cstring> // strerror
+
+#include "xna_exception.hpp"
+
+namespace XNA {
+namespace Export {
+
+OutputSink::~OutputSink()
+{
+}
+
+void MemorySink::write(const uint8_t* data, const size_t size)
+{
+	this->data.insert(this->data.end(), data, data + size);
+}
+
+FileSink::FileSink(const std::string& filename)
+:
+	filename(filename),
+	file(std::fopen(filename.c_str(), "wb"))
+{
+	if(this->file == nullptr)
+	{
+		throw xna_error("error opening " + filename + ": " + std::strerror(errno));
+	}
+}
+
+FileSink::~FileSink()
+{
+	if(this->file != nullptr)
+	{
+		std::fclose(this->file);
+	}
+}
+
+void FileSink::write(const uint8_t* data, const size_t size)
+{
+	if(this->file == nullptr)
+	{
+		throw xna_error("write to " + this->filename + " after it was closed");
+	}
+	if(size != 0 && std::fwrite(data, 1, size, this->file) != size)
+	{
+		throw xna_error("error writing " + this->filename + ": " + std::strerror(errno));
+	}
+}
+
+void FileSink::close()
+{
+	if(this->file == nullptr)
+	{
+		return;
+	}
+	const int result = std::fclose(this->file);
+	this->file = nullptr;
+	if(result != 0)
+	{
+		throw xna_error("error closing " + this->filename + ": " + std::strerror(errno));
+	}
+}
+
+} // namespace Export
+} // namespace XNA
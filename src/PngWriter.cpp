@@ -0,0 +1,447 @@
+#include "PngWriter.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <png.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+#include "xna_exception.hpp"
+
+namespace XNA {
+namespace Export {
+
+namespace {
+
+int libpng_filter_flags(const PngFilter filter)
+{
+	switch(filter)
+	{
+		case PngFilter::none:		return PNG_FILTER_NONE;
+		case PngFilter::sub:		return PNG_FILTER_SUB;
+		case PngFilter::up:			return PNG_FILTER_UP;
+		case PngFilter::average:	return PNG_FILTER_AVG;
+		case PngFilter::paeth:		return PNG_FILTER_PAETH;
+		case PngFilter::adaptive:	return PNG_ALL_FILTERS;
+		case PngFilter::libpng_default:
+		default:					return -1;
+	}
+}
+
+// libpng cannot unwind through C++ exceptions, so errors are kept here while libpng longjmps out
+struct LibpngOutput
+{
+	OutputSink* sink;
+	std::exception_ptr sink_error;
+	std::string libpng_error;
+};
+
+void libpng_write(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+	LibpngOutput* output = static_cast<LibpngOutput*>(png_get_io_ptr(png_ptr));
+	try
+	{
+		output->sink->write(data, length);
+	}
+	catch(...)
+	{
+		output->sink_error = std::current_exception();
+	}
+	// outside the handler: a longjmp out of it would leave the exception active
+	if(output->sink_error != nullptr)
+	{
+		png_error(png_ptr, "sink error");
+	}
+}
+
+void libpng_flush(png_structp)
+{
+}
+
+// instead of printing to stderr
+void libpng_error(png_structp png_ptr, png_const_charp message)
+{
+	static_cast<LibpngOutput*>(png_get_error_ptr(png_ptr))->libpng_error = message;
+	png_longjmp(png_ptr, 1);
+}
+
+void libpng_warning(png_structp, png_const_charp)
+{
+}
+
+void write_png_libpng(OutputSink& sink, const uint8_t* buf, const png_uint_32 width, const png_uint_32 height, const PngOptions& options)
+{
+	// set up before setjmp, as a longjmp skips destructors
+	const uint_fast64_t rowsize = 4 * static_cast<uint_fast64_t>(width);
+	std::vector<png_bytep> rows(height);
+	for(uint_fast32_t y = 0; y < height; ++y)
+	{
+		rows[y] = const_cast<png_bytep>(buf + y * rowsize);
+	}
+	LibpngOutput output = { &sink, nullptr, "" };
+
+	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, &output, libpng_error, libpng_warning);
+	if(png_ptr == nullptr)
+	{
+		throw xna_error("png_create_write_struct returned null");
+	}
+	png_infop info_ptr = png_create_info_struct(png_ptr);
+	if(info_ptr == nullptr)
+	{
+		png_destroy_write_struct(&png_ptr, nullptr);
+		throw xna_error("png_create_info_struct returned null");
+	}
+	if(setjmp(png_jmpbuf(png_ptr)))
+	{
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		if(output.sink_error != nullptr)
+		{
+			std::rethrow_exception(output.sink_error);
+		}
+		throw xna_error("libpng error while writing: " + output.libpng_error);
+	}
+	png_set_write_fn(png_ptr, &output, libpng_write, libpng_flush);
+	if(options.compression_level >= 0)
+	{
+		png_set_compression_level(png_ptr, options.compression_level);
+	}
+	const int filter_flags = libpng_filter_flags(options.filter);
+	if(filter_flags >= 0)
+	{
+		png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, filter_flags);
+	}
+	const int bit_depth = 8;
+	png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+	png_write_info(png_ptr, info_ptr);
+	png_write_image(png_ptr, rows.data());
+	png_write_end(png_ptr, info_ptr);
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+}
+
+/*
+parallel writer: rows are filtered, the filtered stream is split into chunks, and each chunk is deflated
+on its own thread into a raw deflate segment. non-final segments end with a sync flush so they are
+byte-aligned, and each chunk is primed with the previous 32 KiB as a dictionary so matches can still
+reach back across the boundary. the segments concatenate into one valid zlib stream (as pigz does).
+*/
+
+const uint_fast32_t PNG_BPP = 4;
+
+uint8_t paeth(const int a, const int b, const int c)
+{
+	const int p = a + b - c;
+	const int pa = std::abs(p - a);
+	const int pb = std::abs(p - b);
+	const int pc = std::abs(p - c);
+	if(pa <= pb && pa <= pc)
+	{
+		return static_cast<uint8_t>(a);
+	}
+	return static_cast<uint8_t>((pb <= pc) ? b : c);
+}
+
+// out receives rowsize bytes; prev is null for the first row
+void filter_row(const PngFilter filter, const uint8_t* row, const uint8_t* prev, const uint_fast64_t rowsize, uint8_t* out)
+{
+	for(uint_fast64_t x = 0; x < rowsize; ++x)
+	{
+		const int a = (x >= PNG_BPP) ? row[x - PNG_BPP] : 0;
+		const int b = (prev != nullptr) ? prev[x] : 0;
+		const int c = (prev != nullptr && x >= PNG_BPP) ? prev[x - PNG_BPP] : 0;
+		int predicted;
+		switch(filter)
+		{
+			case PngFilter::sub:		predicted = a; break;
+			case PngFilter::up:			predicted = b; break;
+			case PngFilter::average:	predicted = (a + b) / 2; break;
+			case PngFilter::paeth:		predicted = paeth(a, b, c); break;
+			default:					predicted = 0; break;
+		}
+		out[x] = static_cast<uint8_t>(row[x] - predicted);
+	}
+}
+
+uint_fast64_t filter_cost(const uint8_t* filtered, const uint_fast64_t rowsize)
+{
+	uint_fast64_t sum = 0;
+	for(uint_fast64_t x = 0; x < rowsize; ++x)
+	{
+		sum += static_cast<uint_fast64_t>(std::abs(static_cast<int8_t>(filtered[x])));
+	}
+	return sum;
+}
+
+uint8_t filter_type_byte(const PngFilter filter)
+{
+	switch(filter)
+	{
+		case PngFilter::sub:		return 1;
+		case PngFilter::up:			return 2;
+		case PngFilter::average:	return 3;
+		case PngFilter::paeth:		return 4;
+		default:					return 0;
+	}
+}
+
+void filter_rows(const PngFilter filter, const uint8_t* buf, const uint_fast64_t rowsize, const uint_fast32_t first, const uint_fast32_t last, uint8_t* out)
+{
+	std::vector<uint8_t> candidate(rowsize);
+	for(uint_fast32_t y = first; y < last; ++y)
+	{
+		const uint8_t* row = buf + y * rowsize;
+		const uint8_t* prev = (y > 0) ? row - rowsize : nullptr;
+		uint8_t* dest = out + y * (rowsize + 1);
+		if(filter != PngFilter::adaptive)
+		{
+			dest[0] = filter_type_byte(filter);
+			filter_row(filter, row, prev, rowsize, dest + 1);
+			continue;
+		}
+
+		uint_fast64_t best_cost = UINT_FAST64_MAX;
+		for(const PngFilter f : {PngFilter::none, PngFilter::sub, PngFilter::up, PngFilter::average, PngFilter::paeth})
+		{
+			filter_row(f, row, prev, rowsize, candidate.data());
+			const uint_fast64_t cost = filter_cost(candidate.data(), rowsize);
+			if(cost < best_cost)
+			{
+				best_cost = cost;
+				dest[0] = filter_type_byte(f);
+				std::copy_n(candidate.data(), rowsize, dest + 1);
+			}
+		}
+	}
+}
+
+template <typename F> void parallel_for(const unsigned int threads, const uint_fast64_t count, F f)
+{
+	std::atomic<uint_fast64_t> next(0);
+	auto worker = [&]()
+	{
+		for(uint_fast64_t i; (i = next++) < count; )
+		{
+			f(i);
+		}
+	};
+	std::vector<std::thread> pool;
+	for(unsigned int t = 1; t < threads; ++t)
+	{
+		pool.emplace_back(worker);
+	}
+	worker();
+	for(std::thread& t : pool)
+	{
+		t.join();
+	}
+}
+
+struct DeflateChunk
+{
+	std::vector<uint8_t> data;
+	uLong adler;
+	uint_fast64_t length;
+	std::string error;
+};
+
+// zlib counts bytes in uInt, so longer buffers are fed to it in pieces of at most this size
+const uint_fast64_t ZLIB_MAX_PIECE = std::numeric_limits<uInt>::max();
+
+uLong adler32_long(uLong adler, const uint8_t* data, uint_fast64_t length)
+{
+	while(length != 0)
+	{
+		const uInt piece = static_cast<uInt>(std::min(length, ZLIB_MAX_PIECE));
+		adler = adler32(adler, data, piece);
+		data += piece;
+		length -= piece;
+	}
+	return adler;
+}
+
+void deflate_chunk(const uint8_t* stream, const uint_fast64_t start, const uint_fast64_t length, const bool last, const int level, DeflateChunk& out)
+{
+	z_stream z;
+	std::memset(&z, 0, sizeof(z));
+	if(deflateInit2(&z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		out.error = "deflateInit2 failed";
+		return;
+	}
+	const uint_fast64_t dictionary_size = std::min<uint_fast64_t>(start, 32768);
+	if(dictionary_size != 0)
+	{
+		deflateSetDictionary(&z, stream + start - dictionary_size, static_cast<uInt>(dictionary_size));
+	}
+
+	// the buffer grows if the first guess is too small
+	out.data.resize(deflateBound(&z, static_cast<uLong>(std::min(length, ZLIB_MAX_PIECE))) + 16);
+	z.next_in = const_cast<Bytef*>(stream + start);
+	uint_fast64_t unread = length;
+	uint_fast64_t produced = 0;
+	while(true)
+	{
+		if(z.avail_in == 0 && unread != 0)
+		{
+			z.avail_in = static_cast<uInt>(std::min(unread, ZLIB_MAX_PIECE));
+			unread -= z.avail_in;
+		}
+		// only once the last piece is in is the chunk finished or flushed
+		const int flush = (unread != 0) ? Z_NO_FLUSH : last ? Z_FINISH : Z_SYNC_FLUSH;
+		const uInt room = static_cast<uInt>(std::min(out.data.size() - produced, ZLIB_MAX_PIECE));
+		z.next_out = out.data.data() + produced;
+		z.avail_out = room;
+		const int ret = deflate(&z, flush);
+		produced += room - z.avail_out;
+		if(ret == Z_STREAM_END || (!last && unread == 0 && ret == Z_OK && z.avail_in == 0 && z.avail_out != 0))
+		{
+			break;
+		}
+		if(ret != Z_OK && ret != Z_BUF_ERROR)
+		{
+			out.error = "deflate failed";
+			deflateEnd(&z);
+			return;
+		}
+		if(produced == out.data.size())
+		{
+			out.data.resize(out.data.size() * 2);
+		}
+	}
+	deflateEnd(&z);
+	out.data.resize(produced);
+	out.adler = adler32_long(adler32(0, nullptr, 0), stream + start, length);
+	out.length = length;
+}
+
+void put_u32_be(std::vector<uint8_t>& v, const uint32_t x)
+{
+	v.push_back(static_cast<uint8_t>(x >> 24));
+	v.push_back(static_cast<uint8_t>(x >> 16));
+	v.push_back(static_cast<uint8_t>(x >> 8));
+	v.push_back(static_cast<uint8_t>(x));
+}
+
+void write_png_chunk(OutputSink& sink, const char* type, const uint8_t* data, const uint_fast64_t length)
+{
+	std::vector<uint8_t> header;
+	put_u32_be(header, static_cast<uint32_t>(length));
+	header.insert(header.end(), type, type + 4);
+	uLong crc = crc32(0, nullptr, 0);
+	crc = crc32(crc, header.data() + 4, 4);
+	if(length != 0)
+	{
+		crc = crc32(crc, data, static_cast<uInt>(length));
+	}
+	std::vector<uint8_t> footer;
+	put_u32_be(footer, static_cast<uint32_t>(crc));
+
+	sink.write(header.data(), header.size());
+	sink.write(data, length);
+	sink.write(footer.data(), footer.size());
+}
+
+void write_png_parallel(OutputSink& sink, const uint8_t* buf, const uint32_t width, const uint32_t height, const PngOptions& options)
+{
+	const unsigned int threads = options.threads;
+	const uint_fast64_t rowsize = PNG_BPP * static_cast<uint_fast64_t>(width);
+	const uint_fast64_t stream_size = height * (rowsize + 1);
+	std::vector<uint8_t> stream(stream_size);
+
+	// libpng picks adaptive filtering for RGBA images by default
+	const PngFilter filter = (options.filter == PngFilter::libpng_default) ? PngFilter::adaptive : options.filter;
+	const uint_fast32_t row_blocks = std::min<uint_fast32_t>(height, threads * 4);
+	parallel_for(threads, row_blocks, [&](const uint_fast64_t i)
+	{
+		const uint_fast32_t first = static_cast<uint_fast32_t>(height * i / row_blocks);
+		const uint_fast32_t last = static_cast<uint_fast32_t>(height * (i + 1) / row_blocks);
+		filter_rows(filter, buf, rowsize, first, last, stream.data());
+	});
+
+	// chunks of at least 1 MiB; smaller ones lose too much ratio at the flush points
+	const uint_fast64_t chunk_count = std::max<uint_fast64_t>(1, std::min<uint_fast64_t>(threads * 2, stream_size >> 20));
+	std::vector<DeflateChunk> chunks(chunk_count);
+	const int level = (options.compression_level >= 0) ? options.compression_level : Z_DEFAULT_COMPRESSION;
+	parallel_for(threads, chunk_count, [&](const uint_fast64_t i)
+	{
+		const uint_fast64_t start = stream_size * i / chunk_count;
+		const uint_fast64_t end = stream_size * (i + 1) / chunk_count;
+		deflate_chunk(stream.data(), start, end - start, i + 1 == chunk_count, level, chunks[i]);
+	});
+
+	std::vector<uint8_t> zlib_stream;
+	// CMF: deflate, 32 KiB window; FLG: compression level hint and check bits
+	const uint_fast32_t cmf = 0x78;
+	const uint_fast32_t flevel = (level == Z_DEFAULT_COMPRESSION || level == 6) ? 2 : (level < 2) ? 0 : (level < 6) ? 1 : 3;
+	uint_fast32_t flg = flevel << 6;
+	flg += 31 - ((cmf * 256 + flg) % 31);
+	zlib_stream.push_back(static_cast<uint8_t>(cmf));
+	zlib_stream.push_back(static_cast<uint8_t>(flg));
+
+	uLong adler = adler32(0, nullptr, 0);
+	for(const DeflateChunk& chunk : chunks)
+	{
+		if(!chunk.error.empty())
+		{
+			throw xna_error("png: " + chunk.error);
+		}
+		zlib_stream.insert(zlib_stream.end(), chunk.data.begin(), chunk.data.end());
+		adler = adler32_combine(adler, chunk.adler, static_cast<z_off_t>(chunk.length));
+	}
+	put_u32_be(zlib_stream, static_cast<uint32_t>(adler));
+
+	const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	sink.write(signature, sizeof(signature));
+
+	std::vector<uint8_t> ihdr;
+	put_u32_be(ihdr, width);
+	put_u32_be(ihdr, height);
+	ihdr.push_back(8); // bit depth
+	ihdr.push_back(6); // color type: RGBA
+	ihdr.push_back(0); // compression method
+	ihdr.push_back(0); // filter method
+	ihdr.push_back(0); // interlace method
+	write_png_chunk(sink, "IHDR", ihdr.data(), ihdr.size());
+
+	const uint_fast64_t idat_size = 1 << 20;
+	for(uint_fast64_t pos = 0; pos < zlib_stream.size(); pos += idat_size)
+	{
+		write_png_chunk(sink, "IDAT", zlib_stream.data() + pos, std::min(idat_size, zlib_stream.size() - pos));
+	}
+	write_png_chunk(sink, "IEND", nullptr, 0);
+}
+
+} // namespace
+
+PngFilter png_filter_from_string(const std::string& name)
+{
+	if(name == "default")	return PngFilter::libpng_default;
+	if(name == "none")		return PngFilter::none;
+	if(name == "sub")		return PngFilter::sub;
+	if(name == "up")		return PngFilter::up;
+	if(name == "average")	return PngFilter::average;
+	if(name == "paeth")		return PngFilter::paeth;
+	if(name == "adaptive")	return PngFilter::adaptive;
+	throw xna_error("unknown png filter: " + name);
+}
+
+void write_png_RGBA(OutputSink& sink, const uint8_t* buf, const uint32_t width, const uint32_t height, const PngOptions& options)
+{
+	const uint_fast64_t image_size = 4 * static_cast<uint_fast64_t>(width) * height;
+	if(options.threads > 1 && image_size >= options.parallel_min_bytes)
+	{
+		write_png_parallel(sink, buf, width, height, options);
+	}
+	else
+	{
+		write_png_libpng(sink, buf, width, height, options);
+	}
+}
+
+} // namespace Export
+} // namespace XNA
@@ -0,0 +1,337 @@
+#include "SampleConvert.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define XNA_X86 1
+#endif
+
+#include "xna_exception.hpp"
+
+namespace XNA {
+namespace Content {
+
+using std::to_string;
+
+namespace {
+
+void check_layout(const uint_fast32_t bits_per_sample, const uint_fast32_t channel_count)
+{
+	if(bits_per_sample != 8 && bits_per_sample != 16 && bits_per_sample != 24 && bits_per_sample != 32)
+	{
+		throw xna_error("unsupported bits per sample: " + to_string(bits_per_sample));
+	}
+	if(channel_count == 0)
+	{
+		throw xna_error("channel count is 0");
+	}
+}
+
+inline float sample_to_float(const uint8_t* p, const uint_fast32_t bits_per_sample)
+{
+	switch(bits_per_sample)
+	{
+		case 8:
+		{
+			return static_cast<float>(p[0] - 128) * (1.0f / 128);
+		}
+		case 16:
+		{
+			return static_cast<float>(static_cast<int16_t>(p[0] | (p[1] << 8))) * (1.0f / 32768);
+		}
+		case 24:
+		{
+			// shift the sign bit into place, then back down
+			const int32_t v = static_cast<int32_t>((static_cast<uint32_t>(p[0]) << 8) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+			return static_cast<float>(v) * (1.0f / 8388608);
+		}
+		default:
+		{
+			const int32_t v = static_cast<int32_t>(static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24));
+			return static_cast<float>(v) * (1.0f / 2147483648.0f);
+		}
+	}
+}
+
+// to a signed integer in [-2^(bits-1), 2^(bits-1) - 1]; matches the SSE2 kernels (round to nearest even)
+inline int32_t float_to_sample(float x, const uint_fast32_t bits_per_sample)
+{
+	x = (x == x) ? std::min(std::max(x, -1.0f), 1.0f) : 0;
+	const double scale = static_cast<double>(1u << (bits_per_sample - 1));
+	const double v = std::nearbyint(static_cast<double>(x) * scale);
+	return static_cast<int32_t>(std::min(v, scale - 1));
+}
+
+inline void store_sample(uint8_t* p, const int32_t v, const uint_fast32_t bits_per_sample)
+{
+	if(bits_per_sample == 8)
+	{
+		p[0] = static_cast<uint8_t>(v + 128);
+		return;
+	}
+	const uint32_t u = static_cast<uint32_t>(v);
+	for(uint_fast32_t b = 0; b < bits_per_sample / 8; ++b)
+	{
+		p[b] = static_cast<uint8_t>(u >> (8 * b));
+	}
+}
+
+void deinterleave_scalar(const uint8_t* in, const uint_fast32_t bits_per_sample, const uint_fast32_t channel_count, const size_t first, const size_t frames, float* const* planes)
+{
+	const size_t sample_size = bits_per_sample / 8;
+	const size_t frame_size = sample_size * channel_count;
+	for(size_t i = first; i < frames; ++i)
+	{
+		const uint8_t* p = in + i * frame_size;
+		for(uint_fast32_t c = 0; c < channel_count; ++c)
+		{
+			planes[c][i] = sample_to_float(p + c * sample_size, bits_per_sample);
+		}
+	}
+}
+
+void interleave_scalar(const float* const* planes, const uint_fast32_t bits_per_sample, const uint_fast32_t channel_count, const size_t first, const size_t frames, uint8_t* out)
+{
+	const size_t sample_size = bits_per_sample / 8;
+	const size_t frame_size = sample_size * channel_count;
+	for(size_t i = first; i < frames; ++i)
+	{
+		uint8_t* p = out + i * frame_size;
+		for(uint_fast32_t c = 0; c < channel_count; ++c)
+		{
+			store_sample(p + c * sample_size, float_to_sample(planes[c][i], bits_per_sample), bits_per_sample);
+		}
+	}
+}
+
+#ifdef XNA_X86
+/*
+SSE2 kernels for the common layouts (8 and 16-bit, mono and stereo).
+each returns the number of frames it converted; the caller finishes the rest with the scalar code.
+*/
+
+inline void store_scaled(float* out, const __m128i v, const __m128 scale)
+{
+	_mm_storeu_ps(out, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+}
+
+size_t deinterleave_16_sse2(const uint8_t* in, const uint_fast32_t channel_count, const size_t frames, float* const* planes)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / 32768);
+	size_t i = 0;
+	if(channel_count == 1)
+	{
+		for(; i + 8 <= frames; i += 8)
+		{
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2*i));
+			// duplicate each sample into both halves of a 32-bit lane, then sign-extend with an arithmetic shift
+			store_scaled(planes[0] + i, _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16), scale);
+			store_scaled(planes[0] + i + 4, _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16), scale);
+		}
+	}
+	else if(channel_count == 2)
+	{
+		for(; i + 4 <= frames; i += 4)
+		{
+			// each 32-bit lane holds one frame: left in the low half, right in the high half
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 4*i));
+			store_scaled(planes[0] + i, _mm_srai_epi32(_mm_slli_epi32(x, 16), 16), scale);
+			store_scaled(planes[1] + i, _mm_srai_epi32(x, 16), scale);
+		}
+	}
+	return i;
+}
+
+inline void store_u8x8_scaled(float* out, const __m128i v16, const __m128 scale)
+{
+	// v16: 8 zero-extended 16-bit samples
+	const __m128i bias = _mm_set1_epi32(128);
+	const __m128i zero = _mm_setzero_si128();
+	store_scaled(out, _mm_sub_epi32(_mm_unpacklo_epi16(v16, zero), bias), scale);
+	store_scaled(out + 4, _mm_sub_epi32(_mm_unpackhi_epi16(v16, zero), bias), scale);
+}
+
+size_t deinterleave_8_sse2(const uint8_t* in, const uint_fast32_t channel_count, const size_t frames, float* const* planes)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / 128);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	if(channel_count == 1)
+	{
+		for(; i + 16 <= frames; i += 16)
+		{
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			store_u8x8_scaled(planes[0] + i, _mm_unpacklo_epi8(x, zero), scale);
+			store_u8x8_scaled(planes[0] + i + 8, _mm_unpackhi_epi8(x, zero), scale);
+		}
+	}
+	else if(channel_count == 2)
+	{
+		const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+		for(; i + 8 <= frames; i += 8)
+		{
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2*i));
+			store_u8x8_scaled(planes[0] + i, _mm_and_si128(x, low_bytes), scale);
+			store_u8x8_scaled(planes[1] + i, _mm_srli_epi16(x, 8), scale);
+		}
+	}
+	return i;
+}
+
+// 4 floats to rounded 32-bit integers; NaN becomes 0 and the range is clamped to [-scale, scale]
+inline __m128i quantize_4_sse2(const float* p, const __m128 scale)
+{
+	__m128 v = _mm_loadu_ps(p);
+	v = _mm_and_ps(v, _mm_cmpord_ps(v, v));
+	v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1)), _mm_set1_ps(1));
+	return _mm_cvtps_epi32(_mm_mul_ps(v, scale));
+}
+
+// 8 floats to saturated 16-bit integers
+inline __m128i quantize_8_sse2(const float* p, const __m128 scale)
+{
+	return _mm_packs_epi32(quantize_4_sse2(p, scale), quantize_4_sse2(p + 4, scale));
+}
+
+size_t interleave_16_sse2(const float* const* planes, const uint_fast32_t channel_count, const size_t frames, uint8_t* out)
+{
+	const __m128 scale = _mm_set1_ps(32768);
+	size_t i = 0;
+	if(channel_count == 1)
+	{
+		for(; i + 8 <= frames; i += 8)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2*i), quantize_8_sse2(planes[0] + i, scale));
+		}
+	}
+	else if(channel_count == 2)
+	{
+		for(; i + 8 <= frames; i += 8)
+		{
+			const __m128i left = quantize_8_sse2(planes[0] + i, scale);
+			const __m128i right = quantize_8_sse2(planes[1] + i, scale);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4*i), _mm_unpacklo_epi16(left, right));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4*i + 16), _mm_unpackhi_epi16(left, right));
+		}
+	}
+	return i;
+}
+
+// 8 floats to unsigned 8-bit samples in the low 8 bytes
+inline __m128i quantize_u8x8_sse2(const float* p, const __m128 scale)
+{
+	const __m128i v = _mm_add_epi16(quantize_8_sse2(p, scale), _mm_set1_epi16(128));
+	return _mm_packus_epi16(v, v);
+}
+
+size_t interleave_8_sse2(const float* const* planes, const uint_fast32_t channel_count, const size_t frames, uint8_t* out)
+{
+	const __m128 scale = _mm_set1_ps(128);
+	size_t i = 0;
+	if(channel_count == 1)
+	{
+		for(; i + 16 <= frames; i += 16)
+		{
+			const __m128i a = _mm_add_epi16(quantize_8_sse2(planes[0] + i, scale), _mm_set1_epi16(128));
+			const __m128i b = _mm_add_epi16(quantize_8_sse2(planes[0] + i + 8, scale), _mm_set1_epi16(128));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(a, b));
+		}
+	}
+	else if(channel_count == 2)
+	{
+		for(; i + 8 <= frames; i += 8)
+		{
+			const __m128i left = quantize_u8x8_sse2(planes[0] + i, scale);
+			const __m128i right = quantize_u8x8_sse2(planes[1] + i, scale);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2*i), _mm_unpacklo_epi8(left, right));
+		}
+	}
+	return i;
+}
+#endif
+
+void check_sound(const Sound& sound)
+{
+	if(sound.format != SoundFormat::PCM)
+	{
+		throw xna_error("cannot convert samples of sound format " + to_string(sound.format));
+	}
+	check_layout(sound.bits_per_sample, sound.channel_count);
+}
+
+} // namespace
+
+void deinterleave_to_float(const uint8_t* in, const uint_fast32_t bits_per_sample, const uint_fast32_t channel_count, const size_t frames, float* const* planes)
+{
+	check_layout(bits_per_sample, channel_count);
+	size_t done = 0;
+	#ifdef XNA_X86
+	if(bits_per_sample == 16)
+	{
+		done = deinterleave_16_sse2(in, channel_count, frames, planes);
+	}
+	else if(bits_per_sample == 8)
+	{
+		done = deinterleave_8_sse2(in, channel_count, frames, planes);
+	}
+	#endif
+	deinterleave_scalar(in, bits_per_sample, channel_count, done, frames, planes);
+}
+
+void interleave_from_float(const float* const* planes, const uint_fast32_t bits_per_sample, const uint_fast32_t channel_count, const size_t frames, uint8_t* out)
+{
+	check_layout(bits_per_sample, channel_count);
+	size_t done = 0;
+	#ifdef XNA_X86
+	if(bits_per_sample == 16)
+	{
+		done = interleave_16_sse2(planes, channel_count, frames, out);
+	}
+	else if(bits_per_sample == 8)
+	{
+		done = interleave_8_sse2(planes, channel_count, frames, out);
+	}
+	#endif
+	interleave_scalar(planes, bits_per_sample, channel_count, done, frames, out);
+}
+
+uint_fast64_t frame_count(const Sound& sound)
+{
+	check_sound(sound);
+	return sound.get_data_size() / sound.block_align;
+}
+
+void to_planar_float(const Sound& sound, const uint_fast64_t first_frame, const size_t frames, float* const* planes)
+{
+	const uint_fast64_t total = frame_count(sound);
+	if(first_frame > total || frames > total - first_frame)
+	{
+		throw xna_error("frame range " + to_string(first_frame) + "+" + to_string(frames) + " is past the end of the sound (" + to_string(total) + " frames)");
+	}
+	deinterleave_to_float(sound.get_data() + first_frame * sound.block_align, sound.bits_per_sample, sound.channel_count, frames, planes);
+}
+
+std::vector<std::vector<float>> to_planar_float(const Sound& sound)
+{
+	const size_t frames = static_cast<size_t>(frame_count(sound));
+	std::vector<std::vector<float>> out(sound.channel_count, std::vector<float>(frames));
+	std::vector<float*> planes;
+	for(std::vector<float>& plane : out)
+	{
+		planes.push_back(plane.data());
+	}
+	to_planar_float(sound, 0, frames, planes.data());
+	return out;
+}
+
+void from_planar_float(const Sound& sound, const float* const* planes, const size_t frames, uint8_t* out)
+{
+	check_sound(sound);
+	interleave_from_float(planes, sound.bits_per_sample, sound.channel_count, frames, out);
+}
+
+} // namespace Content
+} // namespace XNA
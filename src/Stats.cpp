@@ -0,0 +1,152 @@
+#include "Stats.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+
+namespace XNA {
+namespace Stats {
+
+namespace {
+
+const size_t STAGE_COUNT = static_cast<size_t>(Stage::count);
+const size_t COUNTER_COUNT = static_cast<size_t>(Counter::count);
+
+#ifndef XNA_NO_STATS
+std::array<std::atomic<uint64_t>, STAGE_COUNT> stage_ns;
+std::array<std::atomic<uint64_t>, STAGE_COUNT> stage_calls;
+std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters;
+#endif
+
+} // namespace
+
+const char* to_string(const Stage stage)
+{
+	switch(stage)
+	{
+		case Stage::file_read:		return "file read";
+		case Stage::xnb_read:		return "XNB read";
+		case Stage::decompress:		return "decompress";
+		case Stage::lzx_decode:		return "LZX decode";
+		case Stage::decode_table:	return "decode table build";
+		case Stage::lz4_decode:		return "LZ4 decode";
+		case Stage::content:		return "content";
+		case Stage::export_:		return "export";
+		case Stage::count:			break;
+	}
+	return "?";
+}
+
+const char* to_string(const Counter counter)
+{
+	switch(counter)
+	{
+		case Counter::files:					return "files";
+		case Counter::bytes_in:					return "bytes in";
+		case Counter::bytes_out:				return "bytes out";
+		case Counter::lzx_frames:				return "LZX frames";
+		case Counter::lzx_verbatim_blocks:		return "LZX verbatim blocks";
+		case Counter::lzx_aligned_blocks:		return "LZX aligned blocks";
+		case Counter::lzx_uncompressed_blocks:	return "LZX uncompressed blocks";
+		case Counter::decode_tables:			return "decode tables";
+		case Counter::allocations:				return "allocations";
+		case Counter::allocated_bytes:			return "allocated bytes";
+		case Counter::objects:					return "objects";
+		case Counter::count:					break;
+	}
+	return "?";
+}
+
+#ifndef XNA_NO_STATS
+
+namespace detail {
+
+std::atomic<bool> enabled(false);
+
+void add(const Counter counter, const uint_fast64_t n)
+{
+	counters[static_cast<size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+}
+
+void add_time(const Stage stage, const uint64_t ns)
+{
+	stage_ns[static_cast<size_t>(stage)].fetch_add(ns, std::memory_order_relaxed);
+	stage_calls[static_cast<size_t>(stage)].fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace detail
+
+void enable(const bool on)
+{
+	detail::enabled.store(on, std::memory_order_relaxed);
+}
+
+Snapshot snapshot()
+{
+	Snapshot s;
+	for(size_t i = 0; i < STAGE_COUNT; ++i)
+	{
+		s.stage_ns[i] = stage_ns[i].load(std::memory_order_relaxed);
+		s.stage_calls[i] = stage_calls[i].load(std::memory_order_relaxed);
+	}
+	for(size_t i = 0; i < COUNTER_COUNT; ++i)
+	{
+		s.counters[i] = counters[i].load(std::memory_order_relaxed);
+	}
+	return s;
+}
+
+void reset()
+{
+	for(size_t i = 0; i < STAGE_COUNT; ++i)
+	{
+		stage_ns[i].store(0, std::memory_order_relaxed);
+		stage_calls[i].store(0, std::memory_order_relaxed);
+	}
+	for(std::atomic<uint64_t>& counter : counters)
+	{
+		counter.store(0, std::memory_order_relaxed);
+	}
+}
+
+#else
+
+Snapshot snapshot()
+{
+	return Snapshot();
+}
+
+void reset()
+{
+}
+
+#endif
+
+void print(std::ostream& out, const Snapshot& snapshot)
+{
+	char line[96];
+	std::snprintf(line, sizeof(line), "%-24s %12s %10s\n", "stage", "ms", "calls");
+	out << line;
+	for(size_t i = 0; i < STAGE_COUNT; ++i)
+	{
+		if(snapshot.stage_calls[i] == 0)
+		{
+			continue;
+		}
+		std::snprintf(line, sizeof(line), "%-24s %12.3f %10" PRIu64 "\n", to_string(static_cast<Stage>(i)), static_cast<double>(snapshot.stage_ns[i]) / 1e6, snapshot.stage_calls[i]);
+		out << line;
+	}
+	std::snprintf(line, sizeof(line), "%-24s %12s\n", "counter", "value");
+	out << line;
+	for(size_t i = 0; i < COUNTER_COUNT; ++i)
+	{
+		if(snapshot.counters[i] == 0)
+		{
+			continue;
+		}
+		std::snprintf(line, sizeof(line), "%-24s %12" PRIu64 "\n", to_string(static_cast<Counter>(i)), snapshot.counters[i]);
+		out << line;
+	}
+}
+
+} // namespace Stats
+} // namespace XNA
@@ -0,0 +1,874 @@
+#include "SurfaceConvert.hpp"
+
+#include <algorithm>
+#include <array>
+#include <string>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define XNA_X86 1
+#endif
+
+#include "CpuFeatures.hpp"
+#include "xna_exception.hpp"
+
+namespace XNA {
+namespace Content {
+
+namespace {
+
+// pixels converted per step; keeps the intermediate floats in L1
+const size_t CHUNK_PIXELS = 1024;
+
+// table-driven half to float conversion (see "Fast Half Float Conversions", Jeroen van der Zijp)
+struct HalfTables
+{
+	std::array<uint32_t, 2048> mantissa;
+	std::array<uint32_t, 64> exponent;
+	std::array<uint16_t, 64> offset;
+
+	HalfTables()
+	{
+		this->mantissa[0] = 0;
+		for(uint32_t i = 1; i < 1024; ++i)
+		{
+			// subnormal half: normalize the mantissa
+			uint32_t m = i << 13;
+			uint32_t e = 0;
+			while((m & 0x00800000) == 0)
+			{
+				e -= 0x00800000;
+				m <<= 1;
+			}
+			m &= ~0x00800000u;
+			e += 0x38800000;
+			this->mantissa[i] = m | e;
+		}
+		for(uint32_t i = 1024; i < 2048; ++i)
+		{
+			this->mantissa[i] = 0x38000000 + ((i - 1024) << 13);
+		}
+
+		this->exponent[0] = 0;
+		for(uint32_t i = 1; i < 31; ++i)
+		{
+			this->exponent[i] = i << 23;
+		}
+		this->exponent[31] = 0x47800000;
+		this->exponent[32] = 0x80000000;
+		for(uint32_t i = 33; i < 63; ++i)
+		{
+			this->exponent[i] = 0x80000000 + ((i - 32) << 23);
+		}
+		this->exponent[63] = 0xC7800000;
+
+		this->offset.fill(1024);
+		this->offset[0] = 0;
+		this->offset[32] = 0;
+	}
+};
+
+const HalfTables& half_tables()
+{
+	static const HalfTables t;
+	return t;
+}
+
+void half_to_float_table(const uint16_t* in, float* out, const size_t count)
+{
+	const HalfTables& t = half_tables();
+	for(size_t i = 0; i < count; ++i)
+	{
+		const uint_fast16_t h = in[i];
+		const uint32_t bits = t.mantissa[t.offset[h >> 10] + (h & 0x3FF)] + t.exponent[h >> 10];
+		std::copy_n(reinterpret_cast<const uint8_t*>(&bits), sizeof(float), reinterpret_cast<uint8_t*>(out + i));
+	}
+}
+
+uint8_t tonemap_scalar(float x, const float exposure)
+{
+	x *= exposure;
+	x = (x > 0) ? std::min(x, 1e30f) : 0;
+	return static_cast<uint8_t>(x / (1 + x) * 255 + 0.5f);
+}
+
+uint8_t unorm_scalar(const float x)
+{
+	const float c = (x > 0) ? std::min(x, 1.0f) : 0;
+	return static_cast<uint8_t>(c * 255 + 0.5f);
+}
+
+void tonemap_RGBA_scalar(const float* in, uint8_t* out, const size_t pixels, const float exposure)
+{
+	for(size_t i = 0; i < pixels; ++i)
+	{
+		out[4*i + 0] = tonemap_scalar(in[4*i + 0], exposure);
+		out[4*i + 1] = tonemap_scalar(in[4*i + 1], exposure);
+		out[4*i + 2] = tonemap_scalar(in[4*i + 2], exposure);
+		out[4*i + 3] = unorm_scalar(in[4*i + 3]);
+	}
+}
+
+#ifdef XNA_X86
+__attribute__((target("avx,f16c")))
+void half_to_float_f16c(const uint16_t* in, float* out, const size_t count)
+{
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		_mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+	}
+	half_to_float_table(in + i, out + i, count - i);
+}
+
+// 4 halves, zero-extended to 32 bits, to floats with the same bits as the tables give
+inline __m128 half_to_float_4_sse2(const __m128i h)
+{
+	const __m128i exponent_mask = _mm_set1_epi32(0x7C00 << 13);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i bits = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7FFF)), 13);
+	const __m128i exponent = _mm_and_si128(bits, exponent_mask);
+	bits = _mm_add_epi32(bits, _mm_set1_epi32((127 - 15) << 23));
+	// infinity and NaN keep the largest exponent
+	bits = _mm_add_epi32(bits, _mm_and_si128(_mm_cmpeq_epi32(exponent, exponent_mask), _mm_set1_epi32((128 - 16) << 23)));
+	// a subnormal is normalized by the subtraction, which is exact
+	const __m128i subnormal = _mm_cmpeq_epi32(exponent, zero);
+	const __m128 normalized = _mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(bits, _mm_set1_epi32(1 << 23))), _mm_castsi128_ps(_mm_set1_epi32(113 << 23)));
+	bits = _mm_or_si128(_mm_and_si128(subnormal, _mm_castps_si128(normalized)), _mm_andnot_si128(subnormal, bits));
+	bits = _mm_or_si128(bits, _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16));
+	return _mm_castsi128_ps(bits);
+}
+
+void half_to_float_sse2(const uint16_t* in, float* out, const size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		_mm_storeu_ps(out + i, half_to_float_4_sse2(_mm_unpacklo_epi16(h, zero)));
+		_mm_storeu_ps(out + i + 4, half_to_float_4_sse2(_mm_unpackhi_epi16(h, zero)));
+	}
+	half_to_float_table(in + i, out + i, count - i);
+}
+
+// RGB: x*e / (1 + x*e), A: clamp(x, 0, 1); 4 floats (one pixel) per vector
+void tonemap_RGBA_sse2(const float* in, uint8_t* out, const size_t pixels, const float exposure)
+{
+	const __m128 scale = _mm_setr_ps(exposure, exposure, exposure, 1);
+	const __m128 alpha_mask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1);
+	const __m128 big = _mm_set1_ps(1e30f);
+	const __m128 c255 = _mm_set1_ps(255);
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	auto pixel = [&](const float* p)
+	{
+		// max(NaN, 0) yields 0 because the second operand is returned
+		__m128 v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(p), scale), zero), big);
+		const __m128 mapped = _mm_div_ps(v, _mm_add_ps(one, v));
+		const __m128 alpha = _mm_min_ps(v, one);
+		v = _mm_or_ps(_mm_and_ps(alpha_mask, alpha), _mm_andnot_ps(alpha_mask, mapped));
+		return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, c255), half));
+	};
+
+	size_t i = 0;
+	for(; i + 4 <= pixels; i += 4)
+	{
+		const __m128i p01 = _mm_packs_epi32(pixel(in + 4*i), pixel(in + 4*i + 4));
+		const __m128i p23 = _mm_packs_epi32(pixel(in + 4*i + 8), pixel(in + 4*i + 12));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4*i), _mm_packus_epi16(p01, p23));
+	}
+	tonemap_RGBA_scalar(in + 4*i, out + 4*i, pixels - i, exposure);
+}
+
+__attribute__((target("avx2")))
+inline __m256i tonemap_2_pixels_avx2(const float* p, const __m256 scale, const __m256 alpha_mask)
+{
+	const __m256 one = _mm256_set1_ps(1);
+	__m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(p), scale), _mm256_setzero_ps()), _mm256_set1_ps(1e30f));
+	const __m256 mapped = _mm256_div_ps(v, _mm256_add_ps(one, v));
+	const __m256 alpha = _mm256_min_ps(v, one);
+	v = _mm256_blendv_ps(mapped, alpha, alpha_mask);
+	return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, _mm256_set1_ps(255)), _mm256_set1_ps(0.5f)));
+}
+
+// same as tonemap_RGBA_sse2, two pixels per vector
+__attribute__((target("avx2")))
+void tonemap_RGBA_avx2(const float* in, uint8_t* out, const size_t pixels, const float exposure)
+{
+	const __m256 scale = _mm256_setr_ps(exposure, exposure, exposure, 1, exposure, exposure, exposure, 1);
+	const __m256 alpha_mask = _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1));
+	// packs work within 128-bit lanes; this restores pixel order
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	size_t i = 0;
+	for(; i + 8 <= pixels; i += 8)
+	{
+		const __m256i a = _mm256_packs_epi32(tonemap_2_pixels_avx2(in + 4*i, scale, alpha_mask), tonemap_2_pixels_avx2(in + 4*i + 8, scale, alpha_mask));
+		const __m256i b = _mm256_packs_epi32(tonemap_2_pixels_avx2(in + 4*i + 16, scale, alpha_mask), tonemap_2_pixels_avx2(in + 4*i + 24, scale, alpha_mask));
+		const __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(a, b), order);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 4*i), bytes);
+	}
+	tonemap_RGBA_sse2(in + 4*i, out + 4*i, pixels - i, exposure);
+}
+#endif
+
+void tonemap_RGBA(const float* in, uint8_t* out, const size_t pixels, const float exposure)
+{
+	#ifdef XNA_X86
+	static const bool avx2 = CPU::has_avx2();
+	if(avx2)
+	{
+		tonemap_RGBA_avx2(in, out, pixels, exposure);
+		return;
+	}
+	tonemap_RGBA_sse2(in, out, pixels, exposure);
+	#else
+	tonemap_RGBA_scalar(in, out, pixels, exposure);
+	#endif
+}
+
+#ifdef XNA_X86
+// (r0, g0, r1, g1) to two pixels with blue 0 and alpha 1
+inline void store_RG_pixels_sse2(const __m128 rg, float* out)
+{
+	const __m128 zero_one = _mm_setr_ps(0, 1, 0, 1);
+	_mm_storeu_ps(out, _mm_movelh_ps(rg, zero_one));
+	_mm_storeu_ps(out + 4, _mm_movehl_ps(zero_one, rg));
+}
+
+// (r0, r1, r2, r3) to four pixels with green and blue 0 and alpha 1
+inline void store_R_pixels_sse2(const __m128 r, float* out)
+{
+	const __m128 zero_one = _mm_setr_ps(0, 0, 0, 1);
+	_mm_storeu_ps(out, _mm_move_ss(zero_one, r));
+	_mm_storeu_ps(out + 4, _mm_move_ss(zero_one, _mm_shuffle_ps(r, r, 1)));
+	_mm_storeu_ps(out + 8, _mm_move_ss(zero_one, _mm_shuffle_ps(r, r, 2)));
+	_mm_storeu_ps(out + 12, _mm_move_ss(zero_one, _mm_shuffle_ps(r, r, 3)));
+}
+
+// 8 unorm16 values to floats in [0, 1], the low 4 in lo and the high 4 in hi
+inline void unorm16_to_float_sse2(const uint8_t* in, __m128& lo, __m128& hi)
+{
+	const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+	const __m128 scale = _mm_set1_ps(1.0f / 65535);
+	lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128())), scale);
+	hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, _mm_setzero_si128())), scale);
+}
+#endif
+
+// converts a run of pixels of a half format to RGBA floats; missing channels become (0, 0, 1)
+void half_pixels_to_RGBA32F(const Texture2D_SurfaceFormat format, const uint16_t* in, float* out, const size_t pixels)
+{
+	switch(format)
+	{
+		case Texture2D_SurfaceFormat::HalfVector4:
+		case Texture2D_SurfaceFormat::HdrBlendable:
+		{
+			half_to_float(in, out, 4 * pixels);
+			return;
+		}
+		case Texture2D_SurfaceFormat::HalfVector2:
+		{
+			// convert into the upper half of the buffer, then spread in place (writes never overtake reads)
+			float* tmp = out + 2 * pixels;
+			half_to_float(in, tmp, 2 * pixels);
+			size_t i = 0;
+			#ifdef XNA_X86
+			for(; i + 2 <= pixels; i += 2)
+			{
+				store_RG_pixels_sse2(_mm_loadu_ps(tmp + 2*i), out + 4*i);
+			}
+			#endif
+			for(; i < pixels; ++i)
+			{
+				const float r = tmp[2*i];
+				const float g = tmp[2*i + 1];
+				out[4*i + 0] = r;
+				out[4*i + 1] = g;
+				out[4*i + 2] = 0;
+				out[4*i + 3] = 1;
+			}
+			return;
+		}
+		case Texture2D_SurfaceFormat::HalfSingle:
+		{
+			float* tmp = out + 3 * pixels;
+			half_to_float(in, tmp, pixels);
+			size_t i = 0;
+			#ifdef XNA_X86
+			for(; i + 4 <= pixels; i += 4)
+			{
+				store_R_pixels_sse2(_mm_loadu_ps(tmp + i), out + 4*i);
+			}
+			#endif
+			for(; i < pixels; ++i)
+			{
+				const float r = tmp[i];
+				out[4*i + 0] = r;
+				out[4*i + 1] = 0;
+				out[4*i + 2] = 0;
+				out[4*i + 3] = 1;
+			}
+			return;
+		}
+		default:
+		{
+			throw xna_error("not a half-float surface format: " + to_string(format));
+		}
+	}
+}
+
+bool is_half_format(const Texture2D_SurfaceFormat format)
+{
+	return format == Texture2D_SurfaceFormat::HalfSingle
+		|| format == Texture2D_SurfaceFormat::HalfVector2
+		|| format == Texture2D_SurfaceFormat::HalfVector4
+		|| format == Texture2D_SurfaceFormat::HdrBlendable;
+}
+
+size_t pixel_count(const Texture2D_SurfaceFormat format, const std::vector<uint8_t>& data)
+{
+	const uint_fast32_t pixel_size = bytes_per_pixel(format);
+	if(pixel_size == 0)
+	{
+		throw xna_error("unsupported surface format: " + to_string(format));
+	}
+	if(data.size() % pixel_size != 0)
+	{
+		throw xna_error("image data size is not a multiple of " + std::to_string(pixel_size));
+	}
+	return data.size() / pixel_size;
+}
+
+template <typename T> inline T load(const uint8_t* p)
+{
+	T v;
+	std::copy_n(p, sizeof(T), reinterpret_cast<uint8_t*>(&v));
+	return v;
+}
+
+// snorm8 as XNA defines it: v / 127, clamped to -1
+inline float snorm8(const int8_t v)
+{
+	return std::max(v * (1.0f / 127), -1.0f);
+}
+
+/*
+decodes a run of pixels to RGBA floats. channels a format lacks become (0, 0, 1).
+the loops are branch-free per format; the unpacking of the wider formats has SSE2 paths, with the scalar loop finishing the run.
+if unorm_target is set, signed formats are remapped from [-1, 1] to [0, 1].
+*/
+void decode_RGBA32F(const Texture2D_SurfaceFormat format, const uint8_t* in, float* out, const size_t pixels, const bool unorm_target)
+{
+	const float snorm_scale = unorm_target ? 0.5f : 1;
+	const float snorm_bias = unorm_target ? 0.5f : 0;
+
+	switch(format)
+	{
+		case Texture2D_SurfaceFormat::RGBA8888:
+		{
+			for(size_t i = 0; i < 4 * pixels; ++i)
+			{
+				out[i] = in[i] * (1.0f / 255);
+			}
+			return;
+		}
+		case Texture2D_SurfaceFormat::BGR565:
+		{
+			for(size_t i = 0; i < pixels; ++i)
+			{
+				const uint32_t v = load<uint16_t>(in + 2*i);
+				out[4*i + 0] = static_cast<float>((v >> 11) & 0x1F) * (1.0f / 31);
+				out[4*i + 1] = static_cast<float>((v >> 5) & 0x3F) * (1.0f / 63);
+				out[4*i + 2] = static_cast<float>(v & 0x1F) * (1.0f / 31);
+				out[4*i + 3] = 1;
+			}
+			return;
+		}
+		case Texture2D_SurfaceFormat::BGRA5551:
+		{
+			for(size_t i = 0; i < pixels; ++i)
+			{
+				const uint32_t v = load<uint16_t>(in + 2*i);
+				out[4*i + 0] = static_cast<float>((v >> 10) & 0x1F) * (1.0f / 31);
+				out[4*i + 1] = static_cast<float>((v >> 5) & 0x1F) * (1.0f / 31);
+				out[4*i + 2] = static_cast<float>(v & 0x1F) * (1.0f / 31);
+				out[4*i + 3] = static_cast<float>(v >> 15);
+			}
+			return;
+		}
+		case Texture2D_SurfaceFormat::BGRA4444:
+		{
+			for(size_t i = 0; i < pixels; ++i)
+			{
+				const uint32_t v = load<uint16_t>(in + 2*i);
+				out[4*i + 0] = static_cast<float>((v >> 8) & 0xF) * (1.0f / 15);
+				out[4*i + 1] = static_cast<float>((v >> 4) & 0xF) * (1.0f / 15);
+				out[4*i + 2] = static_cast<float>(v & 0xF) * (1.0f / 15);
+				out[4*i + 3] = static_cast<float>(v >> 12) * (1.0f / 15);
+			}
+			return;
+		}
+		case Texture2D_SurfaceFormat::NormalizedByte2:
+		{
+			for(size_t i = 0; i < pixels; ++i)
+			{
+				out[4*i + 0] = snorm8(static_cast<int8_t>(in[2*i + 0])) * snorm_scale + snorm_bias;
+				out[4*i + 1] = snorm8(static_cast<int8_t>(in[2*i + 1])) * snorm_scale + snorm_bias;
+				out[4*i + 2] = 0;
+				out[4*i + 3] = 1;
+			}
+			return;
+		}
+		case Texture2D_SurfaceFormat::NormalizedByte4:
+		{
+			for(size_t i = 0; i < 4 * pixels; ++i)
+			{
+				out[i] = snorm8(static_cast<int8_t>(in[i])) * snorm_scale + snorm_bias;
+			}
+			return;
+		}
+		case Texture2D_SurfaceFormat::RGBA1010102:
+		{
+			for(size_t i = 0; i < pixels; ++i)
+			{
+				const uint32_t v = load<uint32_t>(in + 4*i);
+				out[4*i + 0] = static_cast<float>(v & 0x3FF) * (1.0f / 1023);
+				out[4*i + 1] = static_cast<float>((v >> 10) & 0x3FF) * (1.0f / 1023);
+				out[4*i + 2] = static_cast<float>((v >> 20) & 0x3FF) * (1.0f / 1023);
+				out[4*i + 3] = static_cast<float>(v >> 30) * (1.0f / 3);
+			}
+			return;
+		}
+		case Texture2D_SurfaceFormat::RG32:
+		{
+			size_t i = 0;
+			#ifdef XNA_X86
+			for(; i + 4 <= pixels; i += 4)
+			{
+				__m128 lo, hi;
+				unorm16_to_float_sse2(in + 4*i, lo, hi);
+				store_RG_pixels_sse2(lo, out + 4*i);
+				store_RG_pixels_sse2(hi, out + 4*i + 8);
+			}
+			#endif
+			for(; i < pixels; ++i)
+			{
+				out[4*i + 0] = load<uint16_t>(in + 4*i) * (1.0f / 65535);
+				out[4*i + 1] = load<uint16_t>(in + 4*i + 2) * (1.0f / 65535);
+				out[4*i + 2] = 0;
+				out[4*i + 3] = 1;
+			}
+			return;
+		}
+		case Texture2D_SurfaceFormat::RGBA64:
+		{
+			size_t i = 0;
+			#ifdef XNA_X86
+			for(; i + 8 <= 4 * pixels; i += 8)
+			{
+				__m128 lo, hi;
+				unorm16_to_float_sse2(in + 2*i, lo, hi);
+				_mm_storeu_ps(out + i, lo);
+				_mm_storeu_ps(out + i + 4, hi);
+			}
+			#endif
+			for(; i < 4 * pixels; ++i)
+			{
+				out[i] = load<uint16_t>(in + 2*i) * (1.0f / 65535);
+			}
+			return;
+		}
+		case Texture2D_SurfaceFormat::Alpha8:
+		{
+			for(size_t i = 0; i < pixels; ++i)
+			{
+				out[4*i + 0] = 0;
+				out[4*i + 1] = 0;
+				out[4*i + 2] = 0;
+				out[4*i + 3] = in[i] * (1.0f / 255);
+			}
+			return;
+		}
+		case Texture2D_SurfaceFormat::Single:
+		{
+			size_t i = 0;
+			#ifdef XNA_X86
+			for(; i + 4 <= pixels; i += 4)
+			{
+				store_R_pixels_sse2(_mm_loadu_ps(reinterpret_cast<const float*>(in + 4*i)), out + 4*i);
+			}
+			#endif
+			for(; i < pixels; ++i)
+			{
+				out[4*i + 0] = load<float>(in + 4*i);
+				out[4*i + 1] = 0;
+				out[4*i + 2] = 0;
+				out[4*i + 3] = 1;
+			}
+			return;
+		}
+		case Texture2D_SurfaceFormat::Vector2:
+		{
+			size_t i = 0;
+			#ifdef XNA_X86
+			for(; i + 2 <= pixels; i += 2)
+			{
+				store_RG_pixels_sse2(_mm_loadu_ps(reinterpret_cast<const float*>(in + 8*i)), out + 4*i);
+			}
+			#endif
+			for(; i < pixels; ++i)
+			{
+				out[4*i + 0] = load<float>(in + 8*i);
+				out[4*i + 1] = load<float>(in + 8*i + 4);
+				out[4*i + 2] = 0;
+				out[4*i + 3] = 1;
+			}
+			return;
+		}
+		case Texture2D_SurfaceFormat::Vector4:
+		{
+			std::copy_n(in, 16 * pixels, reinterpret_cast<uint8_t*>(out));
+			return;
+		}
+		case Texture2D_SurfaceFormat::HalfSingle:
+		case Texture2D_SurfaceFormat::HalfVector2:
+		case Texture2D_SurfaceFormat::HalfVector4:
+		case Texture2D_SurfaceFormat::HdrBlendable:
+		{
+			for(size_t i = 0; i < pixels; i += CHUNK_PIXELS)
+			{
+				const size_t n = std::min(CHUNK_PIXELS, pixels - i);
+				const size_t pixel_size = bytes_per_pixel(format);
+				std::array<uint16_t, 4 * CHUNK_PIXELS> halves;
+				std::copy_n(in + i * pixel_size, n * pixel_size, reinterpret_cast<uint8_t*>(halves.data()));
+				half_pixels_to_RGBA32F(format, halves.data(), out + 4 * i, n);
+			}
+			return;
+		}
+		default:
+		{
+			throw xna_error("unsupported surface format: " + to_string(format));
+		}
+	}
+}
+
+inline uint16_t unorm16_scalar(const float x)
+{
+	const float c = (x > 0) ? std::min(x, 1.0f) : 0;
+	return static_cast<uint16_t>(c * 65535 + 0.5f);
+}
+
+void quantize_RGBA8_scalar(const float* in, uint8_t* out, const size_t count)
+{
+	for(size_t i = 0; i < count; ++i)
+	{
+		out[i] = unorm_scalar(in[i]);
+	}
+}
+
+void quantize_RGBA16_scalar(const float* in, uint16_t* out, const size_t count)
+{
+	for(size_t i = 0; i < count; ++i)
+	{
+		out[i] = unorm16_scalar(in[i]);
+	}
+}
+
+void tonemap_in_place(float* data, const size_t pixels, const float exposure)
+{
+	for(size_t i = 0; i < pixels; ++i)
+	{
+		for(size_t c = 0; c < 3; ++c)
+		{
+			float x = data[4*i + c] * exposure;
+			x = (x > 0) ? std::min(x, 1e30f) : 0;
+			data[4*i + c] = x / (1 + x);
+		}
+	}
+}
+
+#ifdef XNA_X86
+inline __m128i quantize_4_sse2(const float* p, const __m128 scale)
+{
+	// max(NaN, 0) yields 0 because the second operand is returned
+	const __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), _mm_setzero_ps()), _mm_set1_ps(1));
+	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), _mm_set1_ps(0.5f)));
+}
+
+void quantize_RGBA8_sse2(const float* in, uint8_t* out, const size_t count)
+{
+	const __m128 scale = _mm_set1_ps(255);
+	size_t i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		const __m128i a = _mm_packs_epi32(quantize_4_sse2(in + i, scale), quantize_4_sse2(in + i + 4, scale));
+		const __m128i b = _mm_packs_epi32(quantize_4_sse2(in + i + 8, scale), quantize_4_sse2(in + i + 12, scale));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(a, b));
+	}
+	quantize_RGBA8_scalar(in + i, out + i, count - i);
+}
+
+void quantize_RGBA16_sse2(const float* in, uint16_t* out, const size_t count)
+{
+	// SSE2 has no unsigned 32 to 16 pack; bias into signed range and back
+	const __m128 scale = _mm_set1_ps(65535);
+	const __m128i bias32 = _mm_set1_epi32(32768);
+	const __m128i bias16 = _mm_set1_epi16(-32768);
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		const __m128i a = _mm_sub_epi32(quantize_4_sse2(in + i, scale), bias32);
+		const __m128i b = _mm_sub_epi32(quantize_4_sse2(in + i + 4, scale), bias32);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(_mm_packs_epi32(a, b), bias16));
+	}
+	quantize_RGBA16_scalar(in + i, out + i, count - i);
+}
+#endif
+
+void quantize_RGBA8(const float* in, uint8_t* out, const size_t count)
+{
+	#ifdef XNA_X86
+	quantize_RGBA8_sse2(in, out, count);
+	#else
+	quantize_RGBA8_scalar(in, out, count);
+	#endif
+}
+
+void quantize_RGBA16(const float* in, uint16_t* out, const size_t count)
+{
+	#ifdef XNA_X86
+	quantize_RGBA16_sse2(in, out, count);
+	#else
+	quantize_RGBA16_scalar(in, out, count);
+	#endif
+}
+
+
+// 255 / a, used to undo premultiplication; a = 0 is left unchanged
+struct ReciprocalTable
+{
+	std::array<float, 256> r;
+
+	ReciprocalTable()
+	{
+		this->r[0] = 1;
+		for(uint_fast32_t a = 1; a < 256; ++a)
+		{
+			this->r[a] = 255.0f / static_cast<float>(a);
+		}
+	}
+};
+
+const ReciprocalTable& reciprocal_table()
+{
+	static const ReciprocalTable t;
+	return t;
+}
+
+void unpremultiply_scalar(uint8_t* data, const size_t pixels)
+{
+	const ReciprocalTable& t = reciprocal_table();
+	for(size_t i = 0; i < pixels; ++i)
+	{
+		uint8_t* p = data + 4*i;
+		const float r = t.r[p[3]];
+		p[0] = static_cast<uint8_t>(std::min(p[0] * r + 0.5f, 255.0f));
+		p[1] = static_cast<uint8_t>(std::min(p[1] * r + 0.5f, 255.0f));
+		p[2] = static_cast<uint8_t>(std::min(p[2] * r + 0.5f, 255.0f));
+	}
+}
+
+// c * a / 255, rounded
+inline uint8_t mul_div255(const uint_fast32_t c, const uint_fast32_t a)
+{
+	const uint_fast32_t t = c * a + 128;
+	return static_cast<uint8_t>((t + (t >> 8)) >> 8);
+}
+
+void premultiply_scalar(uint8_t* data, const size_t pixels)
+{
+	for(size_t i = 0; i < pixels; ++i)
+	{
+		uint8_t* p = data + 4*i;
+		p[0] = mul_div255(p[0], p[3]);
+		p[1] = mul_div255(p[1], p[3]);
+		p[2] = mul_div255(p[2], p[3]);
+	}
+}
+
+#ifdef XNA_X86
+// multiplies each pixel by (255/a, 255/a, 255/a, 1) in float; 4 pixels per iteration
+void unpremultiply_sse2(uint8_t* data, const size_t pixels)
+{
+	const ReciprocalTable& t = reciprocal_table();
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	auto pixel = [&](const __m128i words, const uint8_t a)
+	{
+		const float r = t.r[a];
+		const __m128 v = _mm_cvtepi32_ps(words);
+		return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_setr_ps(r, r, r, 1)), half));
+	};
+
+	size_t i = 0;
+	for(; i + 4 <= pixels; i += 4)
+	{
+		uint8_t* p = data + 4*i;
+		const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		const __m128i lo = _mm_unpacklo_epi8(px, zero);
+		const __m128i hi = _mm_unpackhi_epi8(px, zero);
+		const __m128i p0 = pixel(_mm_unpacklo_epi16(lo, zero), p[3]);
+		const __m128i p1 = pixel(_mm_unpackhi_epi16(lo, zero), p[7]);
+		const __m128i p2 = pixel(_mm_unpacklo_epi16(hi, zero), p[11]);
+		const __m128i p3 = pixel(_mm_unpackhi_epi16(hi, zero), p[15]);
+		// saturation clamps colors that exceeded alpha
+		const __m128i out = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p), out);
+	}
+	unpremultiply_scalar(data + 4*i, pixels - i);
+}
+
+// integer c * a / 255 on 16-bit lanes; the alpha lane is multiplied by 255 so it is preserved
+void premultiply_sse2(uint8_t* data, const size_t pixels)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgb_mask = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+	const __m128i alpha_255 = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+	const __m128i bias = _mm_set1_epi16(128);
+
+	auto two_pixels = [&](const __m128i words)
+	{
+		__m128i a = _mm_shufflelo_epi16(words, _MM_SHUFFLE(3, 3, 3, 3));
+		a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+		a = _mm_or_si128(_mm_and_si128(a, rgb_mask), alpha_255);
+		const __m128i t = _mm_add_epi16(_mm_mullo_epi16(words, a), bias);
+		return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+	};
+
+	size_t i = 0;
+	for(; i + 4 <= pixels; i += 4)
+	{
+		uint8_t* p = data + 4*i;
+		const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		const __m128i lo = two_pixels(_mm_unpacklo_epi8(px, zero));
+		const __m128i hi = two_pixels(_mm_unpackhi_epi8(px, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(lo, hi));
+	}
+	premultiply_scalar(data + 4*i, pixels - i);
+}
+#endif
+
+} // namespace
+
+void half_to_float(const uint16_t* in, float* out, const size_t count)
+{
+	#ifdef XNA_X86
+	static const bool f16c = CPU::has_f16c();
+	if(f16c)
+	{
+		half_to_float_f16c(in, out, count);
+		return;
+	}
+	half_to_float_sse2(in, out, count);
+	#else
+	half_to_float_table(in, out, count);
+	#endif
+}
+
+std::vector<float> to_RGBA32F(const Texture2D_SurfaceFormat format, const std::vector<uint8_t>& data)
+{
+	const size_t pixels = pixel_count(format, data);
+	std::vector<float> out(4 * pixels);
+	decode_RGBA32F(format, data.data(), out.data(), pixels, false);
+	return out;
+}
+
+std::vector<uint8_t> to_RGBA8(const Texture2D_SurfaceFormat format, const std::vector<uint8_t>& data, const float exposure)
+{
+	const size_t pixels = pixel_count(format, data);
+
+	if(format == Texture2D_SurfaceFormat::RGBA8888)
+	{
+		return data;
+	}
+
+	std::vector<uint8_t> out(4 * pixels);
+	const size_t pixel_size = bytes_per_pixel(format);
+	std::array<float, 4 * CHUNK_PIXELS> floats;
+	for(size_t i = 0; i < pixels; i += CHUNK_PIXELS)
+	{
+		const size_t n = std::min(CHUNK_PIXELS, pixels - i);
+		decode_RGBA32F(format, data.data() + i * pixel_size, floats.data(), n, true);
+		if(is_half_format(format))
+		{
+			tonemap_RGBA(floats.data(), out.data() + 4 * i, n, exposure);
+		}
+		else
+		{
+			quantize_RGBA8(floats.data(), out.data() + 4 * i, 4 * n);
+		}
+	}
+	return out;
+}
+
+std::vector<uint16_t> to_RGBA16(const Texture2D_SurfaceFormat format, const std::vector<uint8_t>& data, const float exposure)
+{
+	const size_t pixels = pixel_count(format, data);
+	std::vector<uint16_t> out(4 * pixels);
+
+	if(format == Texture2D_SurfaceFormat::RGBA64)
+	{
+		std::copy_n(data.data(), data.size(), reinterpret_cast<uint8_t*>(out.data()));
+		return out;
+	}
+	if(format == Texture2D_SurfaceFormat::RGBA8888)
+	{
+		// exact: v * 65535 / 255
+		for(size_t i = 0; i < 4 * pixels; ++i)
+		{
+			out[i] = static_cast<uint16_t>(data[i] * 257);
+		}
+		return out;
+	}
+
+	const size_t pixel_size = bytes_per_pixel(format);
+	std::array<float, 4 * CHUNK_PIXELS> floats;
+	for(size_t i = 0; i < pixels; i += CHUNK_PIXELS)
+	{
+		const size_t n = std::min(CHUNK_PIXELS, pixels - i);
+		decode_RGBA32F(format, data.data() + i * pixel_size, floats.data(), n, true);
+		if(is_half_format(format))
+		{
+			tonemap_in_place(floats.data(), n, exposure);
+		}
+		quantize_RGBA16(floats.data(), out.data() + 4 * i, 4 * n);
+	}
+	return out;
+}
+
+void unpremultiply_RGBA8(uint8_t* data, const size_t pixels)
+{
+	#ifdef XNA_X86
+	unpremultiply_sse2(data, pixels);
+	#else
+	unpremultiply_scalar(data, pixels);
+	#endif
+}
+
+void premultiply_RGBA8(uint8_t* data, const size_t pixels)
+{
+	#ifdef XNA_X86
+	premultiply_sse2(data, pixels);
+	#else
+	premultiply_scalar(data, pixels);
+	#endif
+}
+
+} // namespace Content
+} // namespace XNA
@@ -4,22 +4,33 @@
 
 #include <BinaryWriter.hpp>
 
+#include "Lz4Decoder.hpp"
+#include "Lz4Encoder.hpp"
 #include "LzxDecoder.hpp"
+#include "LzxEncoder.hpp"
+#include "Stats.hpp"
 #include "xna_exception.hpp"
 
 namespace XNA {
 namespace XNB {
 
-XNB::XNB(BinaryReader& reader)
-{
-	this->read(reader);
-}
+namespace {
 
-XNB::~XNB()
+std::shared_ptr<const uint8_t> make_shared_buffer(std::unique_ptr<uint8_t[]> buffer)
 {
+	return std::shared_ptr<const uint8_t>(buffer.release(), std::default_delete<const uint8_t[]>());
 }
 
-void XNB::read(BinaryReader& reader)
+struct Header
+{
+	Platform platform;
+	Profile profile;
+	Compression compression;
+	uint32_t file_length;
+};
+
+// reads up to the file length, which is checked against the size of the file
+Header read_header(BinaryReader& reader)
 {
 	if(reader.GetFileSize() < 14)
 	{
@@ -40,8 +51,9 @@ void XNB::read(BinaryReader& reader)
 		throw xna_error("Invalid format: " + format);
 	}
 
+	Header header;
 	const int8_t platform = reader.ReadInt8();
-	this->platform = static_cast<Platform>(platform);
+	header.platform = static_cast<Platform>(platform);
 
 	const uint8_t xna_version = reader.ReadUInt8();
 	// 5 = XNA Game Studio 4.0
@@ -52,130 +64,698 @@ void XNB::read(BinaryReader& reader)
 
 	const uint8_t flags = reader.ReadUInt8();
 
-	const bool compressed = (flags & XNA::XNB::Flag::compressed) != 0;
-	const uint32_t file_length = reader.ReadUInt32();
-	if(file_length != reader.GetFileSize())
+	header.profile = ((flags & XNA::XNB::Flag::hidef) != 0) ? Profile::HiDef : Profile::Reach;
+	const bool lzx = (flags & XNA::XNB::Flag::compressed) != 0;
+	const bool lz4 = (flags & XNA::XNB::Flag::lz4) != 0;
+	if(lzx && lz4)
+	{
+		throw xna_error("both LZX and LZ4 compression flags are set");
+	}
+	header.compression = lzx ? Compression::lzx : (lz4 ? Compression::lz4 : Compression::none);
+	header.file_length = reader.ReadUInt32();
+	if(header.file_length != reader.GetFileSize())
 	{
-		throw xna_error("File length mismatch: " + std::to_string(file_length) + " should be " + std::to_string(reader.GetFileSize()));
+		throw xna_error("File length mismatch: " + std::to_string(header.file_length) + " should be " + std::to_string(reader.GetFileSize()));
 	}
+	return header;
+}
 
-	if(compressed)
+/*
+adds up the frame sizes of LZX data as BodyDecoder will read them, so that a decompressed size that the data
+cannot produce is rejected before the output is allocated
+*/
+void check_frames(const uint8_t* data, const uint_fast64_t size, const uint_fast64_t decompressed_size)
+{
+	uint_fast64_t total = 0;
+	uint_fast64_t pos = 0;
+	while(pos + 2 <= size)
 	{
-		const uint_fast64_t read_length = file_length - 14;
-		const uint_fast64_t decompressed_size = reader.ReadUInt32();
-		std::unique_ptr<uint8_t[]> compressed_data = reader.ReadBytes(read_length);
-		std::unique_ptr<uint8_t[]> decompressed_data = XNB::decompress(std::move(compressed_data), read_length, decompressed_size);
-		reader.ChangeFile(std::move(decompressed_data), decompressed_size);
+		uint_fast32_t frame_size = 0x8000;
+		if(data[pos] == 0xFF)
+		{
+			if(pos + 5 > size)
+			{
+				break;
+			}
+			frame_size = static_cast<uint_fast32_t>((data[pos + 1] << 8) | data[pos + 2]);
+			pos += 3;
+		}
+		const uint_fast32_t block_size = static_cast<uint_fast32_t>((data[pos] << 8) | data[pos + 1]);
+		pos += 2;
+		if(block_size == 0 || frame_size == 0)
+		{
+			break;
+		}
+		total += frame_size;
+		pos += block_size;
+	}
+	if(total != decompressed_size)
+	{
+		throw lzx_error("XNB::decompress: the frames hold " + std::to_string(total) + " bytes, not the decompressed size (" + std::to_string(decompressed_size) + ")");
+	}
+}
+
+/*
+the decoder of the last compressed body this thread finished with, so that a thread that reads one XNB after another
+(a batch or a daemon worker) reuses its window instead of allocating one per file
+*/
+thread_local std::unique_ptr<LzxDecoder> spare_lzx;
+
+std::unique_ptr<LzxDecoder> acquire_lzx()
+{
+	if(spare_lzx != nullptr)
+	{
+		spare_lzx->Reset();
+		return std::move(spare_lzx);
+	}
+	return std::unique_ptr<LzxDecoder>(new LzxDecoder(16)); // window = 16 bits, window size = 65536 bytes
+}
+
+} // namespace
+
+// decodes the LZX frames of a compressed body in order, as far as they are needed
+class BodyDecoder
+{
+	public:
+		BodyDecoder(std::unique_ptr<uint8_t[]> compressed, const uint_fast64_t compressed_size, const uint_fast64_t decompressed_size, LzxAnalysis* analysis = nullptr)
+		:
+			compressed(std::move(compressed)),
+			compressed_size(compressed_size),
+			in_position(0),
+			decompressed_size(decompressed_size),
+			out_position(0),
+			frames(0),
+			index(nullptr),
+			lzx(acquire_lzx())
+		{
+			check_frames(this->compressed.get(), compressed_size, decompressed_size);
+			Stats::add_allocation(decompressed_size);
+			this->data = make_shared_buffer(std::unique_ptr<uint8_t[]>(new uint8_t[decompressed_size]));
+			this->lzx->SetAnalysis(analysis);
+		}
+
+		BodyDecoder(const BodyDecoder&) = delete;
+
+		~BodyDecoder()
+		{
+			// Reset before its next use drops the analysis and anything left of this body
+			spare_lzx = std::move(this->lzx);
+		}
+
+		// the whole body, of which the first get_decoded() bytes are valid
+		const std::shared_ptr<const uint8_t>& get_data() const
+		{
+			return this->data;
+		}
+
+		uint_fast64_t get_decoded() const
+		{
+			return this->out_position;
+		}
+
+		uint_fast64_t get_compressed_size() const
+		{
+			return this->compressed_size;
+		}
+
+		// the frames decoded from now on add a checkpoint to index before every interval-th one
+		void set_index(SeekIndex* index)
+		{
+			this->index = index;
+		}
+
+		// continues from a checkpoint, which need not be after what is already decoded
+		void resume(const SeekCheckpoint& checkpoint)
+		{
+			if(checkpoint.in_position > this->compressed_size || checkpoint.out_position > this->decompressed_size)
+			{
+				throw lzx_error("XNB::decompress: checkpoint is past the end of the body");
+			}
+			this->lzx->RestoreCheckpoint(checkpoint.lzx);
+			this->in_position = checkpoint.in_position;
+			this->out_position = checkpoint.out_position;
+		}
+
+		// decodes frames until at least end bytes are valid, or all of them if end is past the end; returns how many are
+		uint_fast64_t decode_until(const uint_fast64_t end)
+		{
+			if(end <= this->out_position)
+			{
+				return this->out_position;
+			}
+			const Stats::Timer timer(Stats::Stage::decompress);
+			const uint8_t* in = this->compressed.get();
+			uint8_t* out = const_cast<uint8_t*>(this->data.get());
+			while(this->out_position < end && this->in_position < this->compressed_size)
+			{
+				// not before the first frame, which decoding from the start is no slower than
+				if(this->index != nullptr && this->frames != 0 && this->frames % this->index->interval == 0 && this->out_position < this->decompressed_size)
+				{
+					SeekCheckpoint checkpoint;
+					checkpoint.in_position = this->in_position;
+					checkpoint.out_position = this->out_position;
+					this->lzx->SaveCheckpoint(checkpoint.lzx);
+					this->index->checkpoints.push_back(std::move(checkpoint));
+				}
+				// errors are located by the frame's offset in the file, which has a 14-byte header
+				const uint_fast64_t frame_position = 14 + this->in_position;
+				uint_fast32_t frame_size = 0x8000; // 32768
+				const uint_fast64_t header_size = (in[this->in_position] == 0xFF) ? 5 : 2;
+				if(header_size > this->compressed_size - this->in_position)
+				{
+					throw lzx_error("XNB::decompress: truncated frame header", frame_position);
+				}
+				const uint8_t* header = in + this->in_position;
+				if(header_size == 5)
+				{
+					frame_size = static_cast<uint_fast32_t>((header[1] << 8) | header[2]);
+					header += 3;
+				}
+				const uint_fast32_t block_size = static_cast<uint_fast32_t>((header[0] << 8) | header[1]);
+				this->in_position += header_size;
+
+				if(block_size == 0 || frame_size == 0)
+				{
+					this->in_position = this->compressed_size;
+					break;
+				}
+				if(frame_size > this->decompressed_size - this->out_position)
+				{
+					throw lzx_error("XNB::decompress: bad data (frame size > decompressed size - output position)", frame_position);
+				}
+				if(block_size > this->compressed_size - this->in_position)
+				{
+					throw lzx_error("XNB::decompress: frame is past the end of the file", frame_position);
+				}
+
+				try
+				{
+					this->lzx->Decompress(in + this->in_position, block_size, out + this->out_position, frame_size);
+				}
+				catch(const lzx_error& e)
+				{
+					throw lzx_error(e.what(), frame_position);
+				}
+				this->out_position += frame_size;
+				this->in_position += block_size;
+				++this->frames;
+				Stats::add(Stats::Counter::bytes_out, frame_size);
+			}
+
+			if(end >= this->decompressed_size && this->out_position != this->decompressed_size)
+			{
+				throw lzx_error("XNB::decompress: final output position (" + std::to_string(this->out_position) + ") does not match expected size (" + std::to_string(this->decompressed_size) + ")");
+			}
+			return this->out_position;
+		}
+
+	private:
+		std::unique_ptr<uint8_t[]> compressed;
+		uint_fast64_t compressed_size;
+		uint_fast64_t in_position;
+		std::shared_ptr<const uint8_t> data;
+		uint_fast64_t decompressed_size;
+		uint_fast64_t out_position;
+		uint_fast64_t frames;
+		SeekIndex* index;
+		std::unique_ptr<LzxDecoder> lzx;
+};
+
+XNB::XNB(BinaryReader& reader, const Content::ReadOptions& options)
+{
+	this->read(reader, options);
+}
+
+XNB::~XNB()
+{
+}
+
+void XNB::read(BinaryReader& reader, const Content::ReadOptions& options)
+{
+	const Stats::Timer timer(Stats::Stage::xnb_read);
+	Content::MemoryBudget budget(options.max_total_bytes);
+	std::unique_ptr<BodyDecoder> decoder;
+	Body body = XNB::read_body(reader, options, budget, decoder);
+	this->platform = body.platform;
+
+	const bool partial = options.primary_only || options.max_mip_count != UINT32_MAX;
+	if(decoder != nullptr && !partial)
+	{
+		decoder->decode_until(body.size);
+		budget.release(decoder->get_compressed_size());
+		decoder.reset();
+	}
+
+	// the body is shared with content that references it instead of copying (e.g. sound data)
+	std::unique_ptr<Content::ContentReader> content_reader;
+	if(decoder == nullptr)
+	{
+		content_reader.reset(new Content::ContentReader(std::move(body.data), body.size, options, budget));
 	}
 	else
 	{
-		const uint_fast64_t read_length = file_length - 10;
-		reader.ChangeFile(reader.ReadBytes(read_length), read_length);
+		// frames are decoded as the content reaches them, so a partial read stops early
+		BodyDecoder* d = decoder.get();
+		content_reader.reset(new Content::ContentReader(std::move(body.data), body.size, options, budget, [d](const uint_fast64_t end)
+		{
+			return d->decode_until(end);
+		}));
+	}
+	try
+	{
+		this->read_content(*content_reader, options);
+	}
+	catch(const content_error&)
+	{
+		throw;
+	}
+	catch(const lzx_error&)
+	{
+		// from decoding more of the body
+		throw;
+	}
+	catch(const memory_error&)
+	{
+		// from the budget, not the content
+		throw;
+	}
+	catch(const xna_error& e)
+	{
+		// the position is where the failed read started or just after it
+		throw content_error(e.what(), content_reader->GetPosition());
 	}
+	this->peak_memory = content_reader->GetBudget().get_peak();
+}
 
-	const uint_fast64_t type_count = reader.Read7BitEncodedInt();
+void XNB::read_content(Content::ContentReader& content_reader, const Content::ReadOptions& options)
+{
+	// the Xbox 360 content writer writes numbers big-endian, and so do the type writers for their bulk data
+	content_reader.SetBigEndian(this->platform == Platform::Xbox_360);
+	const uint_fast64_t type_count = content_reader.Read7BitEncodedInt();
 	for(uint_fast64_t i = 0; i < type_count; ++i)
 	{
-		const std::string type_reader_name = reader.ReadStringMS();
-		const int32_t type_reader_version = reader.ReadInt32();
+		const std::string type_reader_name = content_reader.ReadStringMS();
+		const int32_t type_reader_version = content_reader.ReadInt32();
 		std::pair<std::string, int32_t> type_reader = std::make_pair(type_reader_name, type_reader_version);
 		this->type_readers.push_back(type_reader);
 	}
+	std::vector<std::string> type_reader_names;
+	for(const std::pair<std::string, int32_t>& type_reader : this->type_readers)
+	{
+		type_reader_names.push_back(type_reader.first);
+	}
+	content_reader.SetTypeReaders(type_reader_names);
 
-	const uint_fast64_t shared_resource_count = reader.Read7BitEncodedInt();
-	if(shared_resource_count > UINT32_MAX)
+	const uint_fast64_t shared_resource_count = content_reader.Read7BitEncodedInt();
+	if(shared_resource_count > UINT32_MAX || shared_resource_count >= options.max_objects)
 	{
 		throw xna_error("XNB::read: too many shared resources (" + std::to_string(shared_resource_count) + ")");
 	}
 	// there is 1 primary asset before the shared resources
 	const uint_fast64_t object_count = shared_resource_count + 1;
 
+	const Stats::Timer content_timer(Stats::Stage::content);
+	if(options.primary_only)
+	{
+		this->objects.push_back(content_reader.ReadObject());
+		if(content_reader.HasUnresolvedSharedResources())
+		{
+			throw xna_error("XNB::read: the primary asset refers to shared resources, which primary_only does not read");
+		}
+		return;
+	}
 	for(uint_fast64_t i = 0; i < object_count; ++i)
 	{
-		this->objects.push_back(this->read_object(reader));
+		this->objects.push_back(content_reader.ReadObject());
 	}
+	content_reader.ResolveSharedResources(std::vector<std::shared_ptr<Content::ContentBase>>(this->objects.begin() + 1, this->objects.end()));
 }
 
-std::shared_ptr<XNA::Content::ContentBase> XNB::read_object(BinaryReader& reader)
+Body XNB::read_body(BinaryReader& reader, const Content::ReadOptions& options, const uint_fast64_t end)
 {
-	// perhaps 64 bits is overkill, but conservative guesses tend to bite someone in the ass in the future
-	uint_fast64_t type_id = reader.Read7BitEncodedInt();
-	if(type_id == 0)
+	Content::MemoryBudget budget(options.max_total_bytes);
+	std::unique_ptr<BodyDecoder> decoder;
+	Body body = XNB::read_body(reader, options, budget, decoder);
+	if(decoder != nullptr)
 	{
-		return nullptr;
+		body.decoded = decoder->decode_until(end);
 	}
+	return body;
+}
+
+Body XNB::read_body(BinaryReader& reader, const Content::ReadOptions& options, Content::MemoryBudget& budget, std::unique_ptr<BodyDecoder>& decoder)
+{
+	const Header header = read_header(reader);
+	const uint32_t file_length = header.file_length;
 
-	if(type_id > this->type_readers.size())
+	Stats::add(Stats::Counter::files);
+	Stats::add(Stats::Counter::bytes_in, file_length);
+
+	budget.allocate(file_length, "file");
+
+	Body body;
+	body.platform = header.platform;
+	body.profile = header.profile;
+	body.compression = header.compression;
+	if(header.compression == Compression::lz4)
 	{
-		throw xna_error("type id is too high (" + std::to_string(type_id) + " > " + std::to_string(this->type_readers.size()) + ")");
+		const uint_fast64_t read_length = file_length - 14;
+		body.size = reader.ReadUInt32();
+		if(body.size > options.max_body_size)
+		{
+			throw xna_error("decompressed size (" + std::to_string(body.size) + ") is over the limit (" + std::to_string(options.max_body_size) + ")");
+		}
+		if(body.size > Lz4Decoder::MaxDecompressedSize(read_length))
+		{
+			throw lz4_error("decompressed size (" + std::to_string(body.size) + ") is more than " + std::to_string(read_length) + " bytes of LZ4 can hold", 10);
+		}
+		budget.allocate(read_length, "compressed data");
+		const std::unique_ptr<uint8_t[]> compressed_data = reader.ReadBytes(read_length);
+		budget.allocate(body.size, "decompressed data");
+		Stats::add_allocation(body.size);
+		std::unique_ptr<uint8_t[]> data(new uint8_t[body.size]);
+		{
+			const Stats::Timer timer(Stats::Stage::decompress);
+			try
+			{
+				Lz4Decoder::Decompress(compressed_data.get(), read_length, data.get(), body.size);
+			}
+			catch(const lz4_error& e)
+			{
+				// errors are located by offset in the file, which has a 14-byte header
+				throw lz4_error(e.what(), 14 + e.position);
+			}
+		}
+		budget.release(read_length);
+		body.data = make_shared_buffer(std::move(data));
+		body.decoded = body.size;
 	}
+	else if(header.compression == Compression::lzx)
+	{
+		const uint_fast64_t read_length = file_length - 14;
+		body.size = reader.ReadUInt32();
+		if(body.size > options.max_body_size)
+		{
+			throw xna_error("decompressed size (" + std::to_string(body.size) + ") is over the limit (" + std::to_string(options.max_body_size) + ")");
+		}
+		budget.allocate(read_length, "compressed data");
+		std::unique_ptr<uint8_t[]> compressed_data = reader.ReadBytes(read_length);
+		budget.allocate(body.size, "decompressed data");
+		// nothing is decoded yet: the caller decodes as much as it needs, then releases compressed_data from budget
+		decoder.reset(new BodyDecoder(std::move(compressed_data), read_length, body.size));
+		body.data = decoder->get_data();
+		body.decoded = 0;
+		return body;
+	}
+	else
+	{
+		body.size = file_length - 10;
+		if(body.size > options.max_body_size)
+		{
+			throw xna_error("body size (" + std::to_string(body.size) + ") is over the limit (" + std::to_string(options.max_body_size) + ")");
+		}
+		budget.allocate(body.size, "body");
+		Stats::add_allocation(body.size);
+		body.data = make_shared_buffer(reader.ReadBytes(body.size));
+		body.decoded = body.size;
+	}
+	Stats::add(Stats::Counter::bytes_out, body.size);
+	return body;
+}
 
-	type_id -= 1;
-
-	const std::pair<std::string, int32_t> type_reader_info = this->type_readers[type_id];
-	const std::string type_reader_qualified = type_reader_info.first;
-	//const int32_t type_reader_version = type_reader_info.second;
-	const std::string type_reader_name = type_reader_qualified.substr(0, type_reader_qualified.find(','));
+void XNB::analyze_lzx(BinaryReader& reader, LzxAnalysis& analysis)
+{
+	const Header header = read_header(reader);
+	if(header.compression == Compression::lzx)
+	{
+		const uint_fast64_t read_length = header.file_length - 14;
+		const uint_fast64_t body_size = reader.ReadUInt32();
+		BodyDecoder decoder(reader.ReadBytes(read_length), read_length, body_size, &analysis);
+		decoder.decode_until(body_size);
+	}
+}
 
-	return XNA::Content::ContentBase::Read(reader, type_reader_name);
+SeekIndex XNB::build_seek_index(BinaryReader& reader, const uint_fast32_t interval)
+{
+	if(interval == 0)
+	{
+		throw xna_error("XNB::build_seek_index: the interval must be at least 1 frame");
+	}
+	Content::MemoryBudget budget(UINT64_MAX);
+	std::unique_ptr<BodyDecoder> decoder;
+	const Body body = XNB::read_body(reader, Content::ReadOptions(), budget, decoder);
+
+	SeekIndex index;
+	index.file_length = reader.GetFileSize();
+	index.body_size = body.size;
+	index.interval = interval;
+	if(decoder != nullptr)
+	{
+		decoder->set_index(&index);
+		decoder->decode_until(body.size);
+	}
+	return index;
 }
 
-std::unique_ptr<uint8_t[]> XNB::decompress(std::unique_ptr<uint8_t[]> compressed, const uint_fast64_t compressed_size, const uint_fast64_t decompressed_size)
+std::vector<uint8_t> XNB::read_range(BinaryReader& reader, const uint_fast64_t offset, const uint_fast64_t length, const SeekIndex* index)
 {
-	BinaryReader reader(std::move(compressed), compressed_size);
+	Content::MemoryBudget budget(UINT64_MAX);
+	std::unique_ptr<BodyDecoder> decoder;
+	const Body body = XNB::read_body(reader, Content::ReadOptions(), budget, decoder);
+	if(offset > body.size || length > body.size - offset)
+	{
+		throw xna_error("XNB::read_range: " + std::to_string(length) + " bytes at " + std::to_string(offset) + " are past the end of the body (" + std::to_string(body.size) + ")");
+	}
+	if(decoder != nullptr)
+	{
+		if(index != nullptr)
+		{
+			if(index->file_length != reader.GetFileSize() || index->body_size != body.size)
+			{
+				throw xna_error("XNB::read_range: the seek index is for another file");
+			}
+			// the last checkpoint at or before offset
+			const auto after = std::upper_bound(index->checkpoints.begin(), index->checkpoints.end(), offset, [](const uint_fast64_t position, const SeekCheckpoint& checkpoint)
+			{
+				return position < checkpoint.out_position;
+			});
+			if(after != index->checkpoints.begin())
+			{
+				decoder->resume(*(after - 1));
+			}
+		}
+		decoder->decode_until(offset + length);
+	}
+	return std::vector<uint8_t>(body.data.get() + offset, body.data.get() + offset + length);
+}
 
-	std::unique_ptr<uint8_t[]> xnbData(new uint8_t[decompressed_size]);
-	uint_fast32_t out_position = 0;
+std::vector<uint8_t> encode(const uint8_t* body, const uint_fast64_t body_size, const Platform platform, const Profile profile, const Compression compression)
+{
+	std::vector<uint8_t> data;
+	if(compression == Compression::lzx)
+	{
+		LzxEncoder lzx(16);
+		lzx.Compress(body, body_size, [&data](const std::vector<uint8_t>& block, const uint_fast32_t frame_size)
+		{
+			if(block.size() > 0xFFFF)
+			{
+				throw lzx_error("XNB::encode: compressed frame is too large (" + std::to_string(block.size()) + ")");
+			}
+			// the short form is for full frames, and cannot start with 0xFF
+			if(frame_size != LzxEncoder::FRAME_SIZE || block.size() >= 0xFF00)
+			{
+				data.push_back(0xFF);
+				data.push_back(static_cast<uint8_t>(frame_size >> 8));
+				data.push_back(static_cast<uint8_t>(frame_size & 0xFF));
+			}
+			data.push_back(static_cast<uint8_t>(block.size() >> 8));
+			data.push_back(static_cast<uint8_t>(block.size() & 0xFF));
+			data.insert(data.end(), block.begin(), block.end());
+		});
+	}
+	else if(compression == Compression::lz4)
+	{
+		data = Lz4Encoder().Compress(body, body_size);
+	}
+	else
+	{
+		data.assign(body, body + body_size);
+	}
 
-	LzxDecoder lzx(16); // window = 16 bits, window size = 65536 bytes
-	uint_fast32_t pos = 0;
-	while(pos < compressed_size)
+	const bool compressed = (compression != Compression::none);
+	const uint_fast64_t file_length = (compressed ? 14 : 10) + static_cast<uint_fast64_t>(data.size());
+	if(file_length > UINT32_MAX || body_size > UINT32_MAX)
+	{
+		throw xna_error("XNB::encode: body is too large (" + std::to_string(body_size) + ")");
+	}
+	std::vector<uint8_t> file = {'X', 'N', 'B', static_cast<uint8_t>(platform), 5};
+	Flag_type flags = (profile == Profile::HiDef) ? static_cast<Flag_type>(Flag::hidef) : 0;
+	if(compression == Compression::lzx)
+	{
+		flags |= static_cast<Flag_type>(Flag::compressed);
+	}
+	else if(compression == Compression::lz4)
 	{
-		uint_fast8_t hi = reader.ReadUInt8();
-		uint_fast8_t lo = reader.ReadUInt8();
-		uint_fast16_t frame_size;
-		uint_fast16_t block_size;
-		if(hi == 0xFF)
+		flags |= static_cast<Flag_type>(Flag::lz4);
+	}
+	file.push_back(flags);
+	auto push_u32 = [&file](const uint_fast64_t v)
+	{
+		for(uint_fast32_t i = 0; i < 4; ++i)
 		{
-			hi = lo;
-			lo = reader.ReadUInt8();
-			frame_size = static_cast<uint_fast16_t>((hi << 8) | lo);
+			file.push_back(static_cast<uint8_t>((v >> (8 * i)) & 0xFF));
+		}
+	};
+	push_u32(file_length);
+	if(compressed)
+	{
+		push_u32(body_size);
+	}
+	file.insert(file.end(), data.begin(), data.end());
+	return file;
+}
+
+namespace {
 
-			hi = reader.ReadUInt8();
-			lo = reader.ReadUInt8();
-			block_size = static_cast<uint_fast16_t>((hi << 8) | lo);
+const char SEEK_INDEX_MAGIC[8] = {'X', 'N', 'B', 'S', 'E', 'E', 'K', 1};
 
-			pos += 5;
+void put(std::vector<uint8_t>& data, const uint_fast64_t v, const uint_fast32_t bytes)
+{
+	for(uint_fast32_t i = 0; i < bytes; ++i)
+	{
+		data.push_back(static_cast<uint8_t>((v >> (8 * i)) & 0xFF));
+	}
+}
+
+// little-endian reads that throw at the end of the data
+class SeekIndexReader
+{
+	public:
+		SeekIndexReader(const uint8_t* data, const uint_fast64_t size)
+		:
+			data(data),
+			size(size),
+			position(0)
+		{
 		}
-		else
+
+		const uint8_t* take(const uint_fast64_t length)
 		{
-			frame_size = 0x8000; // 32768
-			block_size = static_cast<uint_fast16_t>((hi << 8) | lo);
-			pos += 2;
+			if(length > this->size - this->position)
+			{
+				throw xna_error("seek index is truncated");
+			}
+			const uint8_t* p = this->data + this->position;
+			this->position += length;
+			return p;
 		}
 
-		if(block_size == 0 || frame_size == 0)
+		uint_fast64_t get(const uint_fast32_t bytes)
 		{
-			break;
+			const uint8_t* p = this->take(bytes);
+			uint_fast64_t v = 0;
+			for(uint_fast32_t i = 0; i < bytes; ++i)
+			{
+				v |= static_cast<uint_fast64_t>(p[i]) << (8 * i);
+			}
+			return v;
 		}
-		if(frame_size > decompressed_size - out_position)
+
+		bool at_end() const
 		{
-			throw lzx_error("XNB::decompress: bad data (frame size > decompressed size - output position)");
+			return this->position == this->size;
 		}
 
-		std::unique_ptr<uint8_t[]> inBuf = reader.ReadBytes(block_size);
-		lzx.Decompress(inBuf.get(), block_size, xnbData.get() + out_position, frame_size);
-		out_position += frame_size;
+	private:
+		const uint8_t* data;
+		uint_fast64_t size;
+		uint_fast64_t position;
+};
 
-		pos += block_size;
-	}
+} // namespace
 
-	if(out_position != decompressed_size)
+std::vector<uint8_t> encode_seek_index(const SeekIndex& index)
+{
+	std::vector<uint8_t> data(SEEK_INDEX_MAGIC, SEEK_INDEX_MAGIC + sizeof(SEEK_INDEX_MAGIC));
+	put(data, index.file_length, 8);
+	put(data, index.body_size, 8);
+	put(data, index.interval, 4);
+	put(data, index.checkpoints.size(), 4);
+	// all windows are the same size
+	put(data, index.checkpoints.empty() ? 0 : index.checkpoints.front().lzx.window.size(), 4);
+	for(const SeekCheckpoint& checkpoint : index.checkpoints)
 	{
-		throw lzx_error("XNB::decompress: final output position (" + std::to_string(out_position) + ") does not match expected size (" + std::to_string(decompressed_size) + ")");
+		const LzxCheckpoint& lzx = checkpoint.lzx;
+		put(data, checkpoint.in_position, 8);
+		put(data, checkpoint.out_position, 8);
+		put(data, lzx.window_position, 4);
+		for(const uint32_t R : lzx.R)
+		{
+			put(data, R, 4);
+		}
+		put(data, lzx.header_read, 1);
+		put(data, lzx.block_type, 1);
+		put(data, lzx.block_length, 4);
+		put(data, lzx.block_remaining, 4);
+		data.insert(data.end(), lzx.main_tree_lengths.begin(), lzx.main_tree_lengths.end());
+		data.insert(data.end(), lzx.length_tree_lengths.begin(), lzx.length_tree_lengths.end());
+		data.insert(data.end(), lzx.aligned_tree_lengths.begin(), lzx.aligned_tree_lengths.end());
+		data.insert(data.end(), lzx.window.begin(), lzx.window.end());
 	}
+	return data;
+}
 
-	return xnbData;
+SeekIndex decode_seek_index(const uint8_t* data, const uint_fast64_t size)
+{
+	SeekIndexReader reader(data, size);
+	if(!std::equal(SEEK_INDEX_MAGIC, SEEK_INDEX_MAGIC + sizeof(SEEK_INDEX_MAGIC), reader.take(sizeof(SEEK_INDEX_MAGIC))))
+	{
+		throw xna_error("not a seek index (or not this version of one)");
+	}
+	SeekIndex index;
+	index.file_length = reader.get(8);
+	index.body_size = reader.get(8);
+	index.interval = static_cast<uint_fast32_t>(reader.get(4));
+	const uint_fast64_t count = reader.get(4);
+	const uint_fast64_t window_size = reader.get(4);
+	if(index.interval == 0 || window_size > (1 << 21))
+	{
+		throw xna_error("seek index is invalid");
+	}
+	for(uint_fast64_t i = 0; i < count; ++i)
+	{
+		SeekCheckpoint checkpoint;
+		LzxCheckpoint& lzx = checkpoint.lzx;
+		checkpoint.in_position = reader.get(8);
+		checkpoint.out_position = reader.get(8);
+		if(checkpoint.out_position > index.body_size || (i != 0 && checkpoint.out_position <= index.checkpoints.back().out_position))
+		{
+			throw xna_error("seek index checkpoint " + std::to_string(i) + " is out of order");
+		}
+		lzx.window_position = static_cast<uint32_t>(reader.get(4));
+		for(uint32_t& R : lzx.R)
+		{
+			R = static_cast<uint32_t>(reader.get(4));
+		}
+		lzx.header_read = reader.get(1) != 0;
+		lzx.block_type = static_cast<uint8_t>(reader.get(1));
+		lzx.block_length = static_cast<uint32_t>(reader.get(4));
+		lzx.block_remaining = static_cast<uint32_t>(reader.get(4));
+		const uint8_t* p = reader.take(lzx.main_tree_lengths.size());
+		std::copy_n(p, lzx.main_tree_lengths.size(), lzx.main_tree_lengths.begin());
+		p = reader.take(lzx.length_tree_lengths.size());
+		std::copy_n(p, lzx.length_tree_lengths.size(), lzx.length_tree_lengths.begin());
+		p = reader.take(lzx.aligned_tree_lengths.size());
+		std::copy_n(p, lzx.aligned_tree_lengths.size(), lzx.aligned_tree_lengths.begin());
+		p = reader.take(window_size);
+		lzx.window.assign(p, p + window_size);
+		index.checkpoints.push_back(std::move(checkpoint));
+	}
+	if(!reader.at_end())
+	{
+		throw xna_error("seek index has trailing data");
+	}
+	return index;
 }
 
 } // namespace XNB
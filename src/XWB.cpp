@@ -0,0 +1,331 @@
+#include "XWB.hpp"
+
+#include <algorithm>
+
+#include "xna_exception.hpp"
+
+namespace XNA {
+namespace XWB {
+
+using std::to_string;
+
+namespace {
+
+// see xact3wb.h in the DirectX SDK
+enum BankFlag : uint32_t
+{
+	TYPE_STREAMING = 0x00000001,
+	FLAGS_ENTRYNAMES = 0x00010000,
+	FLAGS_COMPACT = 0x00020000,
+};
+
+enum Segment : uint_fast32_t
+{
+	BANKDATA = 0,
+	ENTRYMETADATA = 1,
+	SEEKTABLES = 2,
+	ENTRYNAMES = 3,
+	ENTRYWAVEDATA = 4,
+	SEGMENT_COUNT = 5,
+};
+
+const uint32_t ADPCM_BLOCKALIGN_CONVERSION_OFFSET = 22;
+
+// the 7 standard Microsoft ADPCM predictor pairs
+const int16_t ADPCM_COEFFICIENTS[7][2] =
+{
+	{256, 0}, {512, -256}, {0, 0}, {192, 64}, {240, 0}, {460, -208}, {392, -232},
+};
+
+struct Region
+{
+	uint32_t offset;
+	uint32_t length;
+};
+
+// bounds-checked reads from the mapping in the bank's byte order
+class BankReader
+{
+	public:
+		BankReader(const uint8_t* data, const uint_fast64_t size, const bool big_endian)
+		:
+			data(data),
+			size(size),
+			big_endian(big_endian)
+		{
+		}
+
+		uint32_t UInt32(const uint_fast64_t pos) const
+		{
+			const uint8_t* p = this->at(pos, 4);
+			if(this->big_endian)
+			{
+				return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+			}
+			return p[0] | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+		}
+
+		// fixed-size field, null padded
+		std::string String(const uint_fast64_t pos, const uint_fast64_t length) const
+		{
+			const char* p = reinterpret_cast<const char*>(this->at(pos, length));
+			return std::string(p, std::find(p, p + length, '\0'));
+		}
+
+		const uint8_t* at(const uint_fast64_t pos, const uint_fast64_t length) const
+		{
+			if(pos > this->size || length > this->size - pos)
+			{
+				throw xna_error("XWB: read of " + to_string(length) + " bytes at " + to_string(pos) + " is past the end of the file (" + to_string(this->size) + ")");
+			}
+			return this->data + pos;
+		}
+
+	private:
+		const uint8_t* data;
+		uint_fast64_t size;
+		bool big_endian;
+};
+
+// WAVEBANKMINIWAVEFORMAT: tag:2, channels:3, samples per second:18, block align:8, bits per sample:1
+void read_mini_format(const uint32_t f, Entry& entry)
+{
+	entry.format = static_cast<WaveFormat>(f & 0x3);
+	entry.channel_count = static_cast<uint16_t>((f >> 2) & 0x7);
+	entry.sample_rate = (f >> 5) & 0x3FFFF;
+	const uint32_t block_align = (f >> 23) & 0xFF;
+	const bool wide = ((f >> 31) & 1) != 0;
+
+	switch(entry.format)
+	{
+		case WaveFormat::PCM:
+		{
+			entry.bits_per_sample = wide ? 16 : 8;
+			entry.block_align = static_cast<uint16_t>(block_align);
+			break;
+		}
+		case WaveFormat::ADPCM:
+		{
+			entry.bits_per_sample = 4;
+			entry.block_align = static_cast<uint16_t>((block_align + ADPCM_BLOCKALIGN_CONVERSION_OFFSET) * entry.channel_count);
+			break;
+		}
+		default:
+		{
+			// XMA and WMA are not decoded; the field means something else for them
+			entry.bits_per_sample = wide ? 16 : 8;
+			entry.block_align = static_cast<uint16_t>(block_align);
+			break;
+		}
+	}
+}
+
+} // namespace
+
+std::string to_string(const WaveFormat f)
+{
+	switch(f)
+	{
+		case WaveFormat::PCM:	return "PCM";
+		case WaveFormat::XMA:	return "XMA";
+		case WaveFormat::ADPCM:	return "ADPCM";
+		case WaveFormat::WMA:	return "WMA";
+	}
+	return to_string(static_cast<uint32_t>(f));
+}
+
+WaveBank::WaveBank(const std::string& filename)
+:
+	file(std::make_shared<MappedFile>(filename))
+{
+	this->read();
+}
+
+void WaveBank::read()
+{
+	if(this->file->size() < 12)
+	{
+		throw xna_error("file is too small to be XWB format");
+	}
+	const std::string signature(reinterpret_cast<const char*>(this->file->data()), 4);
+	if(signature == "WBND")
+	{
+		this->big_endian = false;
+	}
+	else if(signature == "DNBW")
+	{
+		this->big_endian = true;
+	}
+	else
+	{
+		throw xna_error("Invalid format: " + signature);
+	}
+	const BankReader reader(this->file->data(), this->file->size(), this->big_endian);
+
+	// versions 1-3 (early XACT 2 betas) use a different layout; 42 and later add a header version
+	const uint32_t version = reader.UInt32(4);
+	if(version < 4)
+	{
+		throw xna_error("Unhandled XACT version: " + to_string(version));
+	}
+	uint_fast64_t pos = (version >= 42) ? 12 : 8;
+
+	Region segments[SEGMENT_COUNT];
+	for(uint_fast32_t i = 0; i < SEGMENT_COUNT; ++i)
+	{
+		segments[i].offset = reader.UInt32(pos);
+		segments[i].length = reader.UInt32(pos + 4);
+		pos += 8;
+	}
+	for(const Region& segment : segments)
+	{
+		reader.at(segment.offset, segment.length);
+	}
+
+	// WAVEBANKDATA
+	const uint_fast64_t bank = segments[BANKDATA].offset;
+	const uint32_t flags = reader.UInt32(bank);
+	const uint32_t entry_count = reader.UInt32(bank + 4);
+	this->name = reader.String(bank + 8, 64);
+	const uint32_t metadata_size = reader.UInt32(bank + 72);
+	const uint32_t name_size = reader.UInt32(bank + 76);
+	const uint32_t alignment = reader.UInt32(bank + 80);
+	const uint32_t compact_format = reader.UInt32(bank + 84);
+	this->streaming = (flags & TYPE_STREAMING) != 0;
+	const bool compact = (flags & FLAGS_COMPACT) != 0;
+
+	if(compact ? (metadata_size != 4) : (metadata_size < 4))
+	{
+		throw xna_error("XWB: invalid entry size: " + to_string(metadata_size));
+	}
+	// checked up front so that a bad count cannot cause a huge allocation
+	if(static_cast<uint_fast64_t>(entry_count) * metadata_size > segments[ENTRYMETADATA].length)
+	{
+		throw xna_error("XWB: entry count (" + to_string(entry_count) + ") does not fit in the entry table");
+	}
+
+	const Region& wave_data = segments[ENTRYWAVEDATA];
+	this->entries.resize(entry_count);
+	for(uint_fast32_t i = 0; i < entry_count; ++i)
+	{
+		Entry& entry = this->entries[i];
+		const uint_fast64_t entry_pos = segments[ENTRYMETADATA].offset + static_cast<uint_fast64_t>(i) * metadata_size;
+		Region play = {0, 0};
+		Region loop = {0, 0};
+		if(compact)
+		{
+			// offset:21 (in units of alignment), length deviation:11; the length is implied by the next entry
+			const uint32_t e = reader.UInt32(entry_pos);
+			const uint_fast64_t start = static_cast<uint_fast64_t>(e & 0x1FFFFF) * alignment;
+			const uint32_t deviation = e >> 21;
+			const uint_fast64_t end = (i + 1 < entry_count) ? static_cast<uint_fast64_t>(reader.UInt32(entry_pos + 4) & 0x1FFFFF) * alignment : wave_data.length;
+			if(end > wave_data.length || end < start || end - start < deviation)
+			{
+				throw xna_error("XWB: invalid compact entry " + to_string(i));
+			}
+			play.offset = static_cast<uint32_t>(start);
+			play.length = static_cast<uint32_t>(end - start - deviation);
+			read_mini_format(compact_format, entry);
+			entry.duration = 0;
+		}
+		else
+		{
+			// WAVEBANKENTRY; older tools wrote shorter entries
+			const uint32_t flags_and_duration = reader.UInt32(entry_pos);
+			entry.duration = flags_and_duration >> 4;
+			read_mini_format((metadata_size >= 8) ? reader.UInt32(entry_pos + 4) : compact_format, entry);
+			play.offset = (metadata_size >= 12) ? reader.UInt32(entry_pos + 8) : 0;
+			play.length = (metadata_size >= 16) ? reader.UInt32(entry_pos + 12) : wave_data.length;
+			loop.offset = (metadata_size >= 20) ? reader.UInt32(entry_pos + 16) : 0;
+			loop.length = (metadata_size >= 24) ? reader.UInt32(entry_pos + 20) : 0;
+		}
+
+		if(play.offset > wave_data.length || play.length > wave_data.length - play.offset)
+		{
+			throw xna_error("XWB: wave data of entry " + to_string(i) + " is outside the wave data segment");
+		}
+		entry.offset = wave_data.offset + play.offset;
+		entry.length = play.length;
+		entry.loop_start = loop.offset;
+		entry.loop_length = loop.length;
+
+		if((flags & FLAGS_ENTRYNAMES) != 0 && name_size != 0)
+		{
+			const uint_fast64_t name_pos = static_cast<uint_fast64_t>(i) * name_size;
+			if(name_pos + name_size <= segments[ENTRYNAMES].length)
+			{
+				entry.name = reader.String(segments[ENTRYNAMES].offset + name_pos, name_size);
+			}
+		}
+	}
+}
+
+std::size_t WaveBank::find(const std::string& entry_name) const
+{
+	for(std::size_t i = 0; i < this->entries.size(); ++i)
+	{
+		if(this->entries[i].name == entry_name)
+		{
+			return i;
+		}
+	}
+	return this->entries.size();
+}
+
+const uint8_t* WaveBank::get_wave_data(const std::size_t i) const
+{
+	if(i >= this->entries.size())
+	{
+		throw xna_error("invalid wave bank entry index (" + to_string(i) + ")");
+	}
+	return this->file->data() + this->entries[i].offset;
+}
+
+std::shared_ptr<Content::Sound> WaveBank::get_sound(const std::size_t i) const
+{
+	const uint8_t* data = this->get_wave_data(i);
+	const Entry& entry = this->entries[i];
+
+	Content::SoundFormat format;
+	std::vector<uint8_t> extra_info;
+	if(entry.format == WaveFormat::PCM)
+	{
+		format = Content::SoundFormat::PCM;
+		if(this->big_endian && entry.bits_per_sample != 8)
+		{
+			throw xna_error("wave bank entry " + to_string(i) + " has big-endian samples");
+		}
+	}
+	else if(entry.format == WaveFormat::ADPCM && !this->big_endian)
+	{
+		format = Content::SoundFormat::ADPCM;
+		// ADPCMWAVEFORMAT after WAVEFORMATEX: samples per block, coefficient count, coefficients
+		const uint_fast32_t samples_per_block = (entry.block_align - 7u * entry.channel_count) * 2u / std::max<uint_fast32_t>(entry.channel_count, 1) + 2u;
+		auto push_u16 = [&extra_info](const uint_fast32_t v)
+		{
+			extra_info.push_back(static_cast<uint8_t>(v & 0xFF));
+			extra_info.push_back(static_cast<uint8_t>((v >> 8) & 0xFF));
+		};
+		push_u16(samples_per_block);
+		push_u16(7);
+		for(const int16_t* pair : ADPCM_COEFFICIENTS)
+		{
+			push_u16(static_cast<uint16_t>(pair[0]));
+			push_u16(static_cast<uint16_t>(pair[1]));
+		}
+	}
+	else
+	{
+		throw xna_error("unhandled wave bank format: " + to_string(entry.format) + (this->big_endian ? " (big-endian)" : ""));
+	}
+
+	// shares ownership of the mapping
+	std::shared_ptr<const uint8_t> view(this->file, data);
+	std::shared_ptr<Content::Sound> sound = std::make_shared<Content::Sound>(format, entry.channel_count, entry.sample_rate, entry.block_align, entry.bits_per_sample, std::move(extra_info), std::move(view), entry.length);
+	sound->loop_start = entry.loop_start;
+	sound->loop_length = entry.loop_length;
+	return sound;
+}
+
+} // namespace XWB
+} // namespace XNA
@@ -0,0 +1,228 @@
+#include "Xbox360.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define XNA_X86 1
+#endif
+
+#include "CpuFeatures.hpp"
+#include "xna_exception.hpp"
+
+namespace XNA {
+namespace Content {
+
+using std::to_string;
+
+namespace {
+
+void byte_swap_scalar(uint8_t* data, const size_t size, const uint_fast32_t unit)
+{
+	for(size_t i = 0; i + unit <= size; i += unit)
+	{
+		std::reverse(data + i, data + i + unit);
+	}
+}
+
+#ifdef XNA_X86
+// pshufb indexes of 16 bytes of unit-byte values with their bytes reversed
+inline void shuffle_indexes(const uint_fast32_t unit, uint8_t* indexes)
+{
+	for(uint_fast32_t i = 0; i < 16; ++i)
+	{
+		indexes[i] = static_cast<uint8_t>(i - i % unit + (unit - 1 - i % unit));
+	}
+}
+
+__attribute__((target("ssse3")))
+void byte_swap_ssse3(uint8_t* data, const size_t size, const uint_fast32_t unit)
+{
+	alignas(16) uint8_t indexes[16];
+	shuffle_indexes(unit, indexes);
+	const __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(indexes));
+
+	size_t i = 0;
+	for(; i + 16 <= size; i += 16)
+	{
+		__m128i* p = reinterpret_cast<__m128i*>(data + i);
+		_mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), shuffle));
+	}
+	byte_swap_scalar(data + i, size - i, unit);
+}
+
+// vpshufb shuffles within 128-bit lanes, which is all a swap needs
+__attribute__((target("avx2")))
+void byte_swap_avx2(uint8_t* data, const size_t size, const uint_fast32_t unit)
+{
+	alignas(16) uint8_t indexes[16];
+	shuffle_indexes(unit, indexes);
+	const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(indexes)));
+
+	size_t i = 0;
+	for(; i + 64 <= size; i += 64)
+	{
+		__m256i* p = reinterpret_cast<__m256i*>(data + i);
+		const __m256i a = _mm256_loadu_si256(p);
+		const __m256i b = _mm256_loadu_si256(p + 1);
+		_mm256_storeu_si256(p, _mm256_shuffle_epi8(a, shuffle));
+		_mm256_storeu_si256(p + 1, _mm256_shuffle_epi8(b, shuffle));
+	}
+	byte_swap_ssse3(data + i, size - i, unit);
+}
+#endif
+
+/*
+the block index in a tiled image of block (x, y) of the image (see Xenia's or UModel's texture untiling, after the
+Xbox 360 XGAddress2DTiledOffset); aligned_width is in blocks and a multiple of 32
+*/
+inline uint_fast64_t tiled_offset(const uint_fast64_t x, const uint_fast64_t y, const uint_fast64_t aligned_width, const uint_fast32_t log_block_size)
+{
+	const uint_fast64_t macro = ((x >> 5) + (y >> 5) * (aligned_width >> 5)) << (log_block_size + 7);
+	const uint_fast64_t micro = ((x & 7) + ((y & 0xE) << 2)) << log_block_size;
+	const uint_fast64_t offset = macro + ((micro & ~static_cast<uint_fast64_t>(0xF)) << 1) + (micro & 0xF) + ((y & 1) << 4);
+	return (((offset & ~static_cast<uint_fast64_t>(0x1FF)) << 3) + ((y & 16) << 7) + ((offset & 0x1C0) << 2) + (((((y & 8) >> 2) + (x >> 3)) & 3) << 6) + (offset & 0x3F)) >> log_block_size;
+}
+
+uint_fast32_t log_block_size(const uint_fast32_t block_size)
+{
+	switch(block_size)
+	{
+		case 1:		return 0;
+		case 2:		return 1;
+		case 4:		return 2;
+		case 8:		return 3;
+		case 16:	return 4;
+	}
+	throw xna_error("unsupported block size for Xbox 360 tiling: " + to_string(block_size));
+}
+
+template <bool untile> inline void copy_block(const uint8_t* in, uint8_t* out, const size_t linear, const size_t tiled, const size_t size)
+{
+	if(untile)
+	{
+		std::memcpy(out + linear, in + tiled, size);
+	}
+	else
+	{
+		std::memcpy(out + tiled, in + linear, size);
+	}
+}
+
+/*
+copies every block between the linear and the tiled layouts. runs of blocks in the same 16 bytes of a tile row (and
+no more than 8) are consecutive in both, so they are copied together.
+*/
+template <bool untile> void copy_tiled(const uint8_t* in, uint8_t* out, const uint_fast32_t width, const uint_fast32_t height, const uint_fast32_t block_size)
+{
+	const uint_fast32_t log_size = log_block_size(block_size);
+	const uint_fast64_t aligned_width = (static_cast<uint_fast64_t>(width) + 31) & ~static_cast<uint_fast64_t>(31);
+	const uint_fast32_t run = std::min<uint_fast32_t>(8, 16 / block_size);
+	const size_t row_size = static_cast<size_t>(width) * block_size;
+
+	if(block_size >= 4)
+	{
+		// tiles of blocks of 4 bytes or more are one after another, so the offsets in one tile are all it takes
+		std::array<uint32_t, 32 * 32> tile_offsets; // bytes, by y & 31 and (x & 31) / run
+		for(uint_fast32_t y = 0; y < 32; ++y)
+		{
+			for(uint_fast32_t r = 0; r < 32 / run; ++r)
+			{
+				tile_offsets[y * 32 + r] = static_cast<uint32_t>(tiled_offset(r * run, y, 32, log_size) << log_size);
+			}
+		}
+		const size_t tile_size = 1024 * block_size;
+		for(uint_fast64_t y = 0; y < height; ++y)
+		{
+			const size_t tile_row = (y >> 5) * (aligned_width >> 5) * tile_size;
+			const uint32_t* offsets = &tile_offsets[(y & 31) * 32];
+			uint_fast64_t x = 0;
+			for(; x + run <= width; x += run)
+			{
+				copy_block<untile>(in, out, y * row_size + x * block_size, tile_row + (x >> 5) * tile_size + offsets[(x & 31) / run], 16);
+			}
+			for(; x < width; ++x)
+			{
+				copy_block<untile>(in, out, y * row_size + x * block_size, tile_row + (x >> 5) * tile_size + offsets[(x & 31) / run] + (x % run) * block_size, block_size);
+			}
+		}
+		return;
+	}
+
+	for(uint_fast64_t y = 0; y < height; ++y)
+	{
+		uint_fast64_t x = 0;
+		for(; x + run <= width; x += run)
+		{
+			copy_block<untile>(in, out, y * row_size + x * block_size, tiled_offset(x, y, aligned_width, log_size) << log_size, run * block_size);
+		}
+		for(; x < width; ++x)
+		{
+			copy_block<untile>(in, out, y * row_size + x * block_size, tiled_offset(x, y, aligned_width, log_size) << log_size, block_size);
+		}
+	}
+}
+
+} // namespace
+
+void byte_swap(uint8_t* data, const size_t size, const uint_fast32_t unit)
+{
+	if(unit <= 1)
+	{
+		return;
+	}
+	#ifdef XNA_X86
+	if(unit == 2 || unit == 4 || unit == 8)
+	{
+		static const bool avx2 = CPU::has_avx2();
+		static const bool ssse3 = CPU::has_ssse3();
+		if(avx2)
+		{
+			byte_swap_avx2(data, size, unit);
+			return;
+		}
+		if(ssse3)
+		{
+			byte_swap_ssse3(data, size, unit);
+			return;
+		}
+	}
+	#endif
+	byte_swap_scalar(data, size, unit);
+}
+
+uint_fast64_t xbox360_tiled_size(const uint_fast32_t width, const uint_fast32_t height, const uint_fast32_t block_size)
+{
+	const uint_fast32_t log_size = log_block_size(block_size);
+	const uint_fast64_t aligned_width = (static_cast<uint_fast64_t>(width) + 31) & ~static_cast<uint_fast64_t>(31);
+	const uint_fast64_t aligned_height = (static_cast<uint_fast64_t>(height) + 31) & ~static_cast<uint_fast64_t>(31);
+	if(block_size >= 4)
+	{
+		return aligned_width * aligned_height * block_size;
+	}
+	// smaller blocks spread a tile over more than its size, the furthest in the last row of tiles
+	uint_fast64_t end = 0;
+	for(uint_fast64_t y = aligned_height - 32; y < aligned_height; ++y)
+	{
+		for(uint_fast64_t x = 0; x < aligned_width; ++x)
+		{
+			end = std::max(end, tiled_offset(x, y, aligned_width, log_size) + 1);
+		}
+	}
+	return end * block_size;
+}
+
+void xbox360_untile(const uint8_t* tiled, uint8_t* linear, const uint_fast32_t width, const uint_fast32_t height, const uint_fast32_t block_size)
+{
+	copy_tiled<true>(tiled, linear, width, height, block_size);
+}
+
+void xbox360_tile(const uint8_t* linear, uint8_t* tiled, const uint_fast32_t width, const uint_fast32_t height, const uint_fast32_t block_size)
+{
+	copy_tiled<false>(linear, tiled, width, height, block_size);
+}
+
+} // namespace Content
+} // namespace XNA
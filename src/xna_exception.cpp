@@ -3,10 +3,19 @@
 #include <string>
 using std::string;
 
-xna_error::xna_error(const string& what_arg) : runtime_error(what_arg) {}
-xna_error::xna_error(const char* what_arg) : runtime_error(what_arg) {}
+xna_error::xna_error(const string& what_arg, const uint_fast64_t position) : runtime_error(what_arg), position(position) {}
+xna_error::xna_error(const char* what_arg) : runtime_error(what_arg), position(NO_POSITION) {}
 void xna_error::dummy(){}
 
-lzx_error::lzx_error(const string& what_arg) : xna_error(what_arg) {}
+lzx_error::lzx_error(const string& what_arg, const uint_fast64_t position) : xna_error(what_arg, position) {}
 lzx_error::lzx_error(const char* what_arg) : xna_error(what_arg) {}
 void lzx_error::dummy(){}
+
+lz4_error::lz4_error(const string& what_arg, const uint_fast64_t position) : xna_error(what_arg, position) {}
+void lz4_error::dummy(){}
+
+content_error::content_error(const string& what_arg, const uint_fast64_t position) : xna_error(what_arg, position) {}
+void content_error::dummy(){}
+
+memory_error::memory_error(const string& what_arg) : xna_error(what_arg) {}
+void memory_error::dummy(){}
@@ -0,0 +1,497 @@
+#include "Daemon.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// a line longer than this is not a request
+const std::size_t MAX_LINE = 64 * 1024;
+
+// written to by the signal handler to wake run; -1 when no daemon is running
+volatile std::sig_atomic_t signal_wake_fd = -1;
+
+extern "C" void on_signal(int)
+{
+	if(signal_wake_fd >= 0)
+	{
+		const char c = 's';
+		const ssize_t ignored = write(signal_wake_fd, &c, 1);
+		(void)ignored;
+	}
+}
+
+void send_all(const int fd, const std::string& data)
+{
+	std::size_t sent = 0;
+	while(sent < data.size())
+	{
+		const ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(n <= 0)
+		{
+			return; // the client is gone; its jobs are still done
+		}
+		sent += static_cast<std::size_t>(n);
+	}
+}
+
+std::vector<std::string> split_tabs(const std::string& line)
+{
+	std::vector<std::string> fields;
+	std::string::size_type start = 0;
+	while(true)
+	{
+		const std::string::size_type tab = line.find('\t', start);
+		fields.push_back(line.substr(start, tab - start));
+		if(tab == std::string::npos)
+		{
+			return fields;
+		}
+		start = tab + 1;
+	}
+}
+
+// replies are one line, so no message may break it
+std::string one_line(std::string s)
+{
+	std::replace(s.begin(), s.end(), '\n', ' ');
+	std::replace(s.begin(), s.end(), '\r', ' ');
+	return s;
+}
+
+std::future<std::string> ready(std::string reply)
+{
+	std::promise<std::string> promise;
+	promise.set_value(std::move(reply));
+	return promise.get_future();
+}
+
+std::string format_result(const DaemonResult& result)
+{
+	if(!result.errors.empty())
+	{
+		std::string reply = "error";
+		for(const std::string& error : result.errors)
+		{
+			reply += "\t" + one_line(error);
+		}
+		return reply;
+	}
+	std::string reply = "ok";
+	for(const std::string& output : result.outputs)
+	{
+		reply += "\t" + output;
+	}
+	return reply;
+}
+
+} // namespace
+
+LatencyHistory::LatencyHistory(const std::size_t capacity)
+:
+	next(0),
+	capacity(capacity)
+{
+}
+
+void LatencyHistory::add(const double ms)
+{
+	if(this->samples.size() < this->capacity)
+	{
+		this->samples.push_back(ms);
+		return;
+	}
+	this->samples[this->next] = ms;
+	this->next = (this->next + 1) % this->capacity;
+}
+
+std::string LatencyHistory::to_json() const
+{
+	std::vector<double> sorted = this->samples;
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&sorted](const double p)
+	{
+		if(sorted.empty())
+		{
+			return 0.0;
+		}
+		// nearest rank
+		const std::size_t rank = static_cast<std::size_t>(p / 100 * static_cast<double>(sorted.size()) + 0.999999);
+		return sorted[std::min(sorted.size(), std::max<std::size_t>(rank, 1)) - 1];
+	};
+	std::ostringstream out;
+	out.precision(3);
+	out << std::fixed << "{\"samples\":" << sorted.size() << ",\"p50\":" << percentile(50) << ",\"p90\":" << percentile(90)
+	    << ",\"p99\":" << percentile(99) << ",\"max\":" << (sorted.empty() ? 0.0 : sorted.back()) << "}";
+	return out.str();
+}
+
+Daemon::Daemon(DaemonOptions options, Convert convert)
+:
+	options(std::move(options)),
+	convert(std::move(convert)),
+	listen_fd(-1),
+	running(0),
+	completed(0),
+	failed(0),
+	refused(0),
+	stopping(false)
+{
+	this->wake_pipe[0] = this->wake_pipe[1] = -1;
+	this->options.workers = std::max(1u, this->options.workers);
+	this->options.queue_capacity = std::max<std::size_t>(1, this->options.queue_capacity);
+}
+
+Daemon::~Daemon()
+{
+	this->stop();
+	for(std::thread& t : this->workers)
+	{
+		t.join();
+	}
+	if(this->listen_fd >= 0)
+	{
+		close(this->listen_fd);
+		unlink(this->options.socket_path.c_str());
+	}
+	for(const int fd : this->wake_pipe)
+	{
+		if(fd >= 0)
+		{
+			close(fd);
+		}
+	}
+}
+
+void Daemon::run()
+{
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(this->options.socket_path.empty() || this->options.socket_path.size() >= sizeof(address.sun_path))
+	{
+		throw std::string("socket path must be 1-" + std::to_string(sizeof(address.sun_path) - 1) + " characters: " + this->options.socket_path);
+	}
+	std::memcpy(address.sun_path, this->options.socket_path.c_str(), this->options.socket_path.size());
+
+	this->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(this->listen_fd < 0)
+	{
+		throw std::string("could not create a socket: ") + std::strerror(errno);
+	}
+	// a socket file nobody answers on is left over from a daemon that did not exit cleanly
+	const bool in_use = (connect(this->listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+	close(this->listen_fd);
+	this->listen_fd = -1;
+	if(in_use)
+	{
+		throw std::string("another daemon is listening on " + this->options.socket_path);
+	}
+	unlink(this->options.socket_path.c_str());
+	this->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(this->listen_fd < 0)
+	{
+		throw std::string("could not create a socket: ") + std::strerror(errno);
+	}
+	if(bind(this->listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		const std::string error = std::strerror(errno);
+		close(this->listen_fd);
+		this->listen_fd = -1;
+		throw std::string("could not bind " + this->options.socket_path + ": " + error);
+	}
+	if(listen(this->listen_fd, 64) != 0)
+	{
+		throw std::string("could not listen on " + this->options.socket_path + ": " + std::strerror(errno));
+	}
+	if(pipe2(this->wake_pipe, O_CLOEXEC) != 0)
+	{
+		throw std::string("could not create a pipe: ") + std::strerror(errno);
+	}
+
+	for(unsigned int i = 0; i < this->options.workers; ++i)
+	{
+		this->workers.emplace_back([this]() { this->work(); });
+	}
+
+	signal_wake_fd = this->wake_pipe[1];
+	struct sigaction action;
+	std::memset(&action, 0, sizeof(action));
+	action.sa_handler = on_signal;
+	sigemptyset(&action.sa_mask);
+	struct sigaction old_int, old_term;
+	sigaction(SIGINT, &action, &old_int);
+	sigaction(SIGTERM, &action, &old_term);
+
+	pollfd fds[2] = { { this->listen_fd, POLLIN, 0 }, { this->wake_pipe[0], POLLIN, 0 } };
+	while(true)
+	{
+		if(poll(fds, 2, -1) < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		if(fds[1].revents != 0)
+		{
+			break;
+		}
+		if((fds[0].revents & POLLIN) == 0)
+		{
+			continue;
+		}
+		const int fd = accept4(this->listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+		if(fd < 0)
+		{
+			continue;
+		}
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if(this->connections.size() >= this->options.max_connections)
+		{
+			++this->refused;
+			send_all(fd, "error\ttoo many connections\n");
+			close(fd);
+			continue;
+		}
+		this->connections.push_back(fd);
+		std::thread([this, fd]() { this->serve(fd); }).detach();
+	}
+
+	sigaction(SIGINT, &old_int, nullptr);
+	sigaction(SIGTERM, &old_term, nullptr);
+	signal_wake_fd = -1;
+
+	// no new requests are read, but the ones that were are answered
+	this->stop();
+	std::unique_lock<std::mutex> lock(this->mutex);
+	for(const int fd : this->connections)
+	{
+		shutdown(fd, SHUT_RD);
+	}
+	this->connections_done.wait(lock, [this]() { return this->connections.empty(); });
+}
+
+void Daemon::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->job_ready.notify_all();
+	this->room.notify_all();
+	if(this->wake_pipe[1] >= 0)
+	{
+		const char c = 'q';
+		const ssize_t ignored = write(this->wake_pipe[1], &c, 1);
+		(void)ignored;
+	}
+}
+
+void Daemon::work()
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while(true)
+	{
+		// the queue is drained before stopping, as its clients are waiting for the replies
+		this->job_ready.wait(lock, [this]() { return this->stopping || !this->queue.empty(); });
+		if(this->queue.empty())
+		{
+			return;
+		}
+		std::unique_ptr<QueuedJob> job = std::move(this->queue.front());
+		this->queue.pop_front();
+		++this->running;
+		lock.unlock();
+		this->room.notify_one();
+
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		DaemonResult result;
+		try
+		{
+			result = this->convert(job->job);
+		}
+		catch(const std::exception& e)
+		{
+			result.errors.push_back(e.what());
+		}
+		catch(const std::string& e)
+		{
+			result.errors.push_back(e);
+		}
+		const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+		lock.lock();
+		--this->running;
+		++this->completed;
+		if(!result.errors.empty())
+		{
+			++this->failed;
+		}
+		this->latency.add(std::chrono::duration<double, std::milli>(end - job->queued).count());
+		this->service.add(std::chrono::duration<double, std::milli>(end - start).count());
+		job->result.set_value(std::move(result));
+	}
+}
+
+std::future<DaemonResult> Daemon::submit(DaemonJob job)
+{
+	std::unique_ptr<QueuedJob> queued(new QueuedJob);
+	queued->job = std::move(job);
+	queued->queued = std::chrono::steady_clock::now();
+	std::future<DaemonResult> result = queued->result.get_future();
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		// backpressure: a full queue blocks this client until a worker takes a job
+		this->room.wait(lock, [this]() { return this->stopping || this->queue.size() < this->options.queue_capacity; });
+		if(this->stopping)
+		{
+			throw std::string("shutting down");
+		}
+		this->queue.push_back(std::move(queued));
+	}
+	this->job_ready.notify_one();
+	return result;
+}
+
+std::string Daemon::stats_json()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return "{\"queued\":" + std::to_string(this->queue.size())
+		+ ",\"capacity\":" + std::to_string(this->options.queue_capacity)
+		+ ",\"running\":" + std::to_string(this->running)
+		+ ",\"workers\":" + std::to_string(this->options.workers)
+		+ ",\"connections\":" + std::to_string(this->connections.size())
+		+ ",\"completed\":" + std::to_string(this->completed)
+		+ ",\"failed\":" + std::to_string(this->failed)
+		+ ",\"refused\":" + std::to_string(this->refused)
+		+ ",\"latency_ms\":" + this->latency.to_json()
+		+ ",\"service_ms\":" + this->service.to_json() + "}";
+}
+
+std::future<std::string> Daemon::handle(const std::string& line)
+{
+	const std::vector<std::string> fields = split_tabs(line);
+	if(fields[0] == "convert" && (fields.size() == 2 || fields.size() == 3) && !fields[1].empty())
+	{
+		std::future<DaemonResult> result;
+		try
+		{
+			result = this->submit({ fields[1], (fields.size() == 3) ? fields[2] : "" });
+		}
+		catch(const std::string& e)
+		{
+			return ready("error\t" + e);
+		}
+		// formatted by whoever waits for the reply
+		return std::async(std::launch::deferred, [result = std::move(result)]() mutable { return format_result(result.get()); });
+	}
+	if(line == "stats")
+	{
+		return ready(this->stats_json());
+	}
+	if(line == "shutdown")
+	{
+		this->stop();
+		return ready("ok");
+	}
+	return ready("error\tunknown request: " + one_line(fields[0]));
+}
+
+void Daemon::serve(const int fd)
+{
+	// replies are sent in the order of the requests by a thread of their own, so that requests are read and queued while earlier jobs run
+	std::mutex replies_mutex;
+	std::condition_variable replies_changed;
+	std::deque<std::future<std::string>> replies;
+	bool reading = true;
+	std::thread writer([&]()
+	{
+		std::unique_lock<std::mutex> lock(replies_mutex);
+		while(true)
+		{
+			replies_changed.wait(lock, [&]() { return !reading || !replies.empty(); });
+			if(replies.empty())
+			{
+				return;
+			}
+			std::future<std::string> reply = std::move(replies.front());
+			lock.unlock();
+			send_all(fd, reply.get() + "\n");
+			lock.lock();
+			// only now, so that a reply that is being waited for still counts as outstanding
+			replies.pop_front();
+			replies_changed.notify_all();
+		}
+	});
+	auto add_reply = [&](std::future<std::string> reply)
+	{
+		std::unique_lock<std::mutex> lock(replies_mutex);
+		// a client that does not take its replies is not read either
+		replies_changed.wait(lock, [&]() { return replies.size() < this->options.queue_capacity; });
+		replies.push_back(std::move(reply));
+		replies_changed.notify_all();
+	};
+
+	std::string buffer;
+	char chunk[4096];
+	while(true)
+	{
+		const std::string::size_type newline = buffer.find('\n');
+		if(newline != std::string::npos)
+		{
+			std::string line = buffer.substr(0, newline);
+			buffer.erase(0, newline + 1);
+			if(!line.empty() && line.back() == '\r')
+			{
+				line.pop_back();
+			}
+			add_reply(this->handle(line));
+			continue;
+		}
+		if(buffer.size() > MAX_LINE)
+		{
+			add_reply(ready("error\tline is too long"));
+			break;
+		}
+		const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+		if(n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(n <= 0)
+		{
+			break;
+		}
+		buffer.append(chunk, static_cast<std::size_t>(n));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(replies_mutex);
+		reading = false;
+	}
+	replies_changed.notify_all();
+	writer.join();
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->connections.erase(std::find(this->connections.begin(), this->connections.end(), fd));
+		this->connections_done.notify_all();
+	}
+	// not before it is out of connections, as accept may hand out the same number again once it is closed
+	close(fd);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// what a client asked to convert; output is empty for the default name
+struct DaemonJob
+{
+	std::string input;
+	std::string output;
+};
+
+struct DaemonResult
+{
+	std::vector<std::string> outputs;
+	std::vector<std::string> errors;
+};
+
+struct DaemonOptions
+{
+	std::string socket_path;
+	unsigned int workers = 1;
+	// jobs waiting for a worker, and replies a client has outstanding; a client that would exceed either stops being read until there is room
+	std::size_t queue_capacity = 16;
+	// clients connected at once; more are told so and disconnected
+	std::size_t max_connections = 64;
+};
+
+// the most recent durations, for percentiles
+class LatencyHistory
+{
+	public:
+		explicit LatencyHistory(std::size_t capacity = 10000);
+
+		void add(double ms);
+
+		// {"samples": n, "p50": ms, "p90": ms, "p99": ms, "max": ms}
+		std::string to_json() const;
+
+	private:
+		std::vector<double> samples;
+		std::size_t next;
+		std::size_t capacity;
+};
+
+/*
+serves conversion jobs on a Unix stream socket to clients that would otherwise start a process per file. the workers
+live as long as the daemon, so whatever they keep per thread (e.g. the library's LZX decoder) stays warm.
+
+a client sends lines and gets one line back for each, in order. it need not wait for a reply before sending the next
+request: its jobs are queued as they are read and run side by side.
+	convert<TAB>input[<TAB>output]	ok<TAB>output...	or	error<TAB>message
+	stats							{"queued": ..., "latency_ms": {...}, ...} (see stats_json)
+	shutdown						ok; the daemon finishes the jobs it has and exits
+paths are as the daemon sees them, so relative ones are from its working directory.
+*/
+class Daemon
+{
+	public:
+		using Convert = std::function<DaemonResult(const DaemonJob&)>;
+
+		Daemon(DaemonOptions options, Convert convert);
+		Daemon(const Daemon&) = delete;
+		~Daemon();
+
+		// serves until a client sends shutdown or the process gets SIGINT or SIGTERM; throws std::string if the socket cannot be set up
+		void run();
+
+	private:
+		struct QueuedJob
+		{
+			DaemonJob job;
+			std::chrono::steady_clock::time_point queued;
+			std::promise<DaemonResult> result;
+		};
+
+		void work();
+		void serve(int fd);
+		std::future<std::string> handle(const std::string& line);
+		std::future<DaemonResult> submit(DaemonJob job);
+		std::string stats_json();
+		void stop();
+
+		DaemonOptions options;
+		Convert convert;
+		int listen_fd;
+		int wake_pipe[2];
+
+		std::mutex mutex;
+		std::condition_variable job_ready;
+		std::condition_variable room;
+		std::condition_variable connections_done;
+		std::deque<std::unique_ptr<QueuedJob>> queue;
+		std::vector<int> connections;
+		unsigned int running;
+		uint64_t completed;
+		uint64_t failed;
+		uint64_t refused;
+		bool stopping;
+		// from queued to done, and the conversion alone
+		LatencyHistory latency;
+		LatencyHistory service;
+		std::vector<std::thread> workers;
+};
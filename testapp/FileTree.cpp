@@ -0,0 +1,99 @@
+#include "FileTree.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace {
+
+bool ends_with_nocase(const std::string& name, const std::string& extension)
+{
+	if(name.size() < extension.size())
+	{
+		return false;
+	}
+	return std::equal(extension.begin(), extension.end(), name.end() - static_cast<std::ptrdiff_t>(extension.size()), [](const char a, const char b)
+	{
+		return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+	});
+}
+
+void walk(const std::string& directory, const std::string& relative, const std::string& extension, std::vector<TreeFile>& files)
+{
+	std::unique_ptr<DIR, int(*)(DIR*)> dir(opendir(directory.c_str()), closedir);
+	if(dir == nullptr)
+	{
+		throw std::string("could not open directory " + directory + ": " + std::strerror(errno));
+	}
+	while(const dirent* entry = readdir(dir.get()))
+	{
+		const std::string name = entry->d_name;
+		if(name == "." || name == "..")
+		{
+			continue;
+		}
+		const std::string path = directory + "/" + name;
+		const std::string relative_path = relative.empty() ? name : relative + "/" + name;
+		struct stat st;
+		if(lstat(path.c_str(), &st) != 0)
+		{
+			continue;
+		}
+		if(S_ISDIR(st.st_mode))
+		{
+			walk(path, relative_path, extension, files);
+		}
+		else if(S_ISREG(st.st_mode) && ends_with_nocase(name, extension))
+		{
+			files.push_back({path, relative_path});
+		}
+	}
+}
+
+} // namespace
+
+std::vector<TreeFile> list_files(const std::string& directory, const std::string& extension)
+{
+	std::vector<TreeFile> files;
+	walk(directory, "", extension, files);
+	std::sort(files.begin(), files.end(), [](const TreeFile& a, const TreeFile& b)
+	{
+		return a.path < b.path;
+	});
+	return files;
+}
+
+bool is_directory(const std::string& path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+void make_parent_directories(const std::string& path)
+{
+	for(std::string::size_type slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1))
+	{
+		const std::string directory = path.substr(0, slash);
+		if(mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST)
+		{
+			throw std::string("could not create directory " + directory + ": " + std::strerror(errno));
+		}
+	}
+}
+
+bool stat_file(const std::string& path, uint64_t& size, int64_t& mtime_ns)
+{
+	struct stat st;
+	if(stat(path.c_str(), &st) != 0)
+	{
+		return false;
+	}
+	size = static_cast<uint64_t>(st.st_size);
+	mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+	return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// path relative to its input directory: "assets/a/b.xnb" in "assets" is "a/b.xnb"
+struct TreeFile
+{
+	std::string path;
+	std::string relative_path;
+};
+
+// files under directory whose names end in extension (case-insensitive), sorted by path; symlinks are not followed
+std::vector<TreeFile> list_files(const std::string& directory, const std::string& extension);
+
+bool is_directory(const std::string& path);
+
+// creates the directory that will contain path, and its parents, as needed
+void make_parent_directories(const std::string& path);
+
+// false if path cannot be stat'ed; mtime_ns is the modification time in nanoseconds since the epoch
+bool stat_file(const std::string& path, uint64_t& size, int64_t& mtime_ns);
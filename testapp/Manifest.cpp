@@ -0,0 +1,176 @@
+#include "Manifest.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+const char* const MAGIC = "libxna-manifest 3";
+// the same but with paths written as they are, so that one with a tab or a newline could not be stored
+const char* const MAGIC_2 = "libxna-manifest 2";
+
+// a tab, a newline or a backslash in a path becomes \t, \n or \\, so that a line is always one entry
+std::string escape(const std::string& path)
+{
+	std::string escaped;
+	escaped.reserve(path.size());
+	for(const char c : path)
+	{
+		switch(c)
+		{
+			case '\t': escaped += "\\t"; break;
+			case '\n': escaped += "\\n"; break;
+			case '\\': escaped += "\\\\"; break;
+			default: escaped += c; break;
+		}
+	}
+	return escaped;
+}
+
+std::string unescape(const std::string& field)
+{
+	std::string path;
+	path.reserve(field.size());
+	for(std::string::size_type i = 0; i < field.size(); ++i)
+	{
+		if(field[i] != '\\' || i + 1 == field.size())
+		{
+			path += field[i];
+			continue;
+		}
+		switch(field[++i])
+		{
+			case 't': path += '\t'; break;
+			case 'n': path += '\n'; break;
+			default: path += field[i]; break;
+		}
+	}
+	return path;
+}
+
+uint64_t rotl(const uint64_t x, const int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+// splitmix64's finalizer
+uint64_t mix(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+	return z ^ (z >> 31);
+}
+
+} // namespace
+
+Manifest::Manifest(std::string filename, std::string key)
+:
+	filename(std::move(filename)),
+	key(std::move(key))
+{
+	std::ifstream in(this->filename);
+	std::string line;
+	if(!std::getline(in, line) || (line != MAGIC && line != MAGIC_2))
+	{
+		return;
+	}
+	const bool escaped = (line == MAGIC);
+	if(!std::getline(in, line))
+	{
+		return;
+	}
+	const bool current = (line == this->key);
+	// path, size, mtime, hash, "stale" or "current" and outputs, separated by tabs (see escape)
+	while(std::getline(in, line))
+	{
+		std::istringstream fields(line);
+		std::string path, size, mtime, hash, state;
+		if(!std::getline(fields, path, '\t') || !std::getline(fields, size, '\t') || !std::getline(fields, mtime, '\t') || !std::getline(fields, hash, '\t') || !std::getline(fields, state, '\t'))
+		{
+			continue;
+		}
+		ManifestEntry entry;
+		entry.stale = (!current || state != "current");
+		try
+		{
+			entry.size = std::stoull(size);
+			entry.mtime_ns = std::stoll(mtime);
+			entry.hash = std::stoull(hash, nullptr, 16);
+		}
+		catch(const std::logic_error&)
+		{
+			continue;
+		}
+		std::string output;
+		while(std::getline(fields, output, '\t'))
+		{
+			entry.outputs.push_back(escaped ? unescape(output) : output);
+		}
+		this->entries[escaped ? unescape(path) : path] = std::move(entry);
+	}
+}
+
+void Manifest::save() const
+{
+	const std::string temp_filename = this->filename + ".tmp";
+	{
+		std::ofstream out(temp_filename);
+		out << MAGIC << "\n" << this->key << "\n";
+		for(const std::pair<const std::string, ManifestEntry>& item : this->entries)
+		{
+			char hash[17];
+			std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(item.second.hash));
+			out << escape(item.first) << "\t" << item.second.size << "\t" << item.second.mtime_ns << "\t" << hash << "\t" << (item.second.stale ? "stale" : "current");
+			for(const std::string& output : item.second.outputs)
+			{
+				out << "\t" << escape(output);
+			}
+			out << "\n";
+		}
+		if(!out)
+		{
+			throw std::string("error writing " + temp_filename);
+		}
+	}
+	if(std::rename(temp_filename.c_str(), this->filename.c_str()) != 0)
+	{
+		throw std::string("could not replace " + this->filename + ": " + std::strerror(errno));
+	}
+}
+
+uint64_t hash_file(const std::string& filename)
+{
+	std::ifstream in(filename, std::ios::binary);
+	if(!in)
+	{
+		throw std::string("could not open " + filename);
+	}
+	uint64_t h = 0x9E3779B97F4A7C15;
+	uint64_t size = 0;
+	std::vector<char> buffer(1 << 16);
+	while(in)
+	{
+		in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+		const std::size_t n = static_cast<std::size_t>(in.gcount());
+		std::size_t i = 0;
+		for(; i + 8 <= n; i += 8)
+		{
+			uint64_t word;
+			std::memcpy(&word, buffer.data() + i, 8);
+			h = rotl(h ^ (word * 0x9E3779B97F4A7C15), 31) * 0xBF58476D1CE4E5B9;
+		}
+		for(; i < n; ++i)
+		{
+			h = (h ^ static_cast<uint8_t>(buffer[i])) * 0x100000001B3;
+		}
+		size += n;
+	}
+	if(in.bad())
+	{
+		throw std::string("error reading " + filename);
+	}
+	return mix(h ^ size);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// what an input looked like when it was last converted, and what that wrote
+struct ManifestEntry
+{
+	uint64_t size;
+	int64_t mtime_ns;
+	uint64_t hash; // of the contents (see hash_file)
+	std::vector<std::string> outputs;
+	// converted with another key; the outputs are only kept so that they can be found, and the input is converted again
+	bool stale = false;
+};
+
+/*
+a record of converted inputs, kept in a text file between runs. an entry is only valid for the same library version
+and conversion options (together, key); the entries of a manifest written with another key are loaded as stale, so
+that outputs that are no longer written can be found, and stay stale until their input is converted again.
+*/
+class Manifest
+{
+	public:
+		Manifest(std::string filename, std::string key);
+
+		// replaces the file atomically
+		void save() const;
+
+		std::unordered_map<std::string, ManifestEntry> entries;
+
+	private:
+		std::string filename;
+		std::string key;
+};
+
+// a fast non-cryptographic 64-bit hash of a file's contents; throws std::string if it cannot be read
+uint64_t hash_file(const std::string& filename);
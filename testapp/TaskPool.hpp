@@ -0,0 +1,104 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads; tasks may push more tasks
+class TaskPool
+{
+	public:
+		// no threads: push runs each task on the calling thread before it returns
+		TaskPool()
+		{
+		}
+
+		explicit TaskPool(unsigned int threads)
+		{
+			if(threads == 0)
+			{
+				threads = 1;
+			}
+			for(unsigned int i = 0; i < threads; ++i)
+			{
+				this->workers.emplace_back([this]() { this->run(); });
+			}
+		}
+
+		TaskPool(const TaskPool&) = delete;
+
+		~TaskPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->stopping = true;
+			}
+			this->task_ready.notify_all();
+			for(std::thread& t : this->workers)
+			{
+				t.join();
+			}
+		}
+
+		void push(std::function<void()> task)
+		{
+			if(this->workers.empty())
+			{
+				task();
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->tasks.push_back(std::move(task));
+			}
+			this->task_ready.notify_one();
+		}
+
+		// blocks until the queue is empty and no task is running
+		void wait()
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->idle.wait(lock, [this]() { return this->tasks.empty() && this->running == 0; });
+		}
+
+		unsigned int size() const
+		{
+			return static_cast<unsigned int>(this->workers.size());
+		}
+
+	private:
+		void run()
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			while(true)
+			{
+				this->task_ready.wait(lock, [this]() { return this->stopping || !this->tasks.empty(); });
+				if(this->tasks.empty())
+				{
+					return;
+				}
+				std::function<void()> task = std::move(this->tasks.front());
+				this->tasks.pop_front();
+				++this->running;
+				lock.unlock();
+				task();
+				lock.lock();
+				--this->running;
+				if(this->tasks.empty() && this->running == 0)
+				{
+					this->idle.notify_all();
+				}
+			}
+		}
+
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()>> tasks;
+		std::mutex mutex;
+		std::condition_variable task_ready;
+		std::condition_variable idle;
+		unsigned int running = 0;
+		bool stopping = false;
+};
@@ -1,135 +1,1314 @@
 #include <BinaryReader.hpp>
-#include <BinaryWriter.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <ios>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
 #include <XNB.hpp>
+#include <XWB.hpp>
 #include <Content.hpp>
-#include <png.h>
-#include <cstring> // strerror
+#include <Export.hpp>
+#include <LzxDecoder.hpp>
+#include <Model.hpp>
+#include <PngWriter.hpp>
+#include <Stats.hpp>
+#include <Version.hpp>
+#include <SurfaceConvert.hpp>
 #include <xna_exception.hpp>
 
-void write_png_RGBA(const char* filename, uint8_t* buf, png_uint_32 width, png_uint_32 height)
+#include "Daemon.hpp"
+#include "FileTree.hpp"
+#include "Manifest.hpp"
+#include "TaskPool.hpp"
+
+struct Options
 {
-	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-	if(png_ptr == nullptr)
+	bool unpremultiply = false;
+	bool all_mips = false;
+	bool thumbnail = false;
+	bool decode_adpcm = false;
+	bool analyze_lzx = false;
+	bool stats = false;
+	bool validate = false;
+	bool recompress = false;
+	uint_fast32_t seek_index_interval = 0; // frames between checkpoints; 0 for no --seek-index
+	bool read_range = false;
+	uint_fast64_t range_offset = 0;
+	uint_fast64_t range_length = 0;
+	XNA::XNB::Compression compression = XNA::XNB::Compression::lzx;
+	std::string out_dir;
+	std::string manifest;
+	uint_fast64_t max_memory = UINT64_MAX;
+	unsigned int jobs = 1;
+	std::string daemon_socket;
+	std::size_t queue_capacity = 0; // for --daemon; 0 for 4 per job
+	XNA::Export::ImageFormat image_format = XNA::Export::ImageFormat::png;
+	XNA::Export::PngOptions png;
+};
+
+std::mutex output_mutex;
+std::atomic<bool> any_failed(false);
+
+// what each input wrote and which inputs failed, for --manifest; guarded by output_mutex
+std::unordered_map<std::string, std::vector<std::string>> outputs_written;
+std::unordered_set<std::string> inputs_failed;
+
+// what the --daemon job this thread is converting wrote and what went wrong, instead of the globals above
+thread_local DaemonResult* current_job = nullptr;
+
+// wave bank entries are reported as bank.xwb[i]
+std::string input_name(const std::string& filename)
+{
+	const std::string::size_type bracket = filename.rfind('[');
+	if(bracket == std::string::npos || filename.back() != ']')
 	{
-		throw std::string("png_create_write_struct returned null");
+		return filename;
 	}
-	png_infop info_ptr = png_create_info_struct(png_ptr);
-	if(info_ptr == nullptr)
+	return filename.substr(0, bracket);
+}
+
+void report_error(const std::string& filename, const std::string& message)
+{
+	if(current_job != nullptr)
 	{
-		png_free_data(png_ptr, info_ptr, PNG_FREE_ALL, -1);
-		png_destroy_write_struct(&png_ptr, nullptr);
-		throw std::string("png_create_info_struct returned null");
+		current_job->errors.push_back(filename + ": " + message);
+		return;
 	}
-	FILE* fp = fopen(filename, "wb");
-	if(fp == nullptr)
+	std::lock_guard<std::mutex> lock(output_mutex);
+	std::cerr << filename << ": " << message << "\n";
+	any_failed = true;
+	inputs_failed.insert(input_name(filename));
+}
+
+void report_written(const std::string& filename, const std::string& outname)
+{
+	if(current_job != nullptr)
 	{
-		throw std::string("error opening png file: ") + strerror(errno);
+		current_job->outputs.push_back(outname);
+		return;
 	}
-	png_init_io(png_ptr, fp);
-	const int bit_depth = 8;
-	png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-	png_write_info(png_ptr, info_ptr);
-	uint_fast32_t rowsize = 4 * width * sizeof(png_byte);
-	for(uint_fast32_t y = 0; y < height; ++y)
+	std::lock_guard<std::mutex> lock(output_mutex);
+	std::cout << filename << ": wrote " << outname << "\n";
+	outputs_written[input_name(filename)].push_back(outname);
+}
+
+// "out.png" + ".mip1" -> "out.mip1.png"
+std::string add_suffix(const std::string& outname, const std::string& suffix)
+{
+	const std::string::size_type dot = outname.rfind('.');
+	const std::string::size_type slash = outname.rfind('/');
+	if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
 	{
-		png_write_row(png_ptr, buf + y * rowsize);
+		return outname + suffix;
 	}
-	png_write_end(png_ptr, info_ptr);
-	fclose(fp);
-	png_free_data(png_ptr, info_ptr, PNG_FREE_ALL, -1);
-	png_destroy_write_struct(&png_ptr, &info_ptr);
+	return outname.substr(0, dot) + suffix + outname.substr(dot);
 }
 
-int main(int argc, char** argv)
+// runs f, reporting any error against filename
+template <typename F> void guarded(const std::string& filename, F f)
 {
-	if(argc <= 1)
+	try
 	{
-		std::cout << "usage: " << argv[0] << " <input file> [output file]\n";
-		return EXIT_FAILURE;
+		f();
+	}
+	catch(const std::string& e)
+	{
+		report_error(filename, e);
 	}
+	catch(const xna_error& e)
+	{
+		report_error(filename, e.what());
+	}
+	catch(const std::bad_alloc& e)
+	{
+		// caught so that afl-fuzz does not detect it as a crash
+		report_error(filename, std::string("error allocating memory (") + e.what() + ")");
+	}
+}
 
-	std::string filename(argv[1]);
-	std::string outname(argc > 2 ? argv[2] : "");
-	try
+void export_texture(const std::shared_ptr<XNA::Content::Texture2D>& tex, const std::string& filename, const std::string& outname, const Options& options, TaskPool& pool)
+{
+	if(options.unpremultiply && tex->get_surface_format() == XNA::Content::Texture2D_SurfaceFormat::RGBA8888)
+	{
+		tex->unpremultiply_alpha();
+	}
+
+	if(options.image_format == XNA::Export::ImageFormat::dds)
+	{
+		// one file with every mip that was read
+		pool.push([tex, filename, outname]()
+		{
+			guarded(filename, [&]()
+			{
+				XNA::Export::FileSink sink(outname);
+				XNA::Export::write_dds(*tex, sink);
+				sink.close();
+				report_written(filename, outname);
+			});
+		});
+		return;
+	}
+
+	const uint_fast32_t mip_count = options.all_mips ? tex->get_mip_count() : std::min<uint_fast32_t>(tex->get_mip_count(), 1);
+	for(uint_fast32_t i = 0; i < mip_count; ++i)
+	{
+		const std::string mip_outname = (i == 0) ? outname : add_suffix(outname, ".mip" + std::to_string(i));
+		// each mip is an independent image, so encode them concurrently, and then not each on threads of its own
+		XNA::Export::PngOptions png = options.png;
+		if(mip_count > 1)
+		{
+			png.threads = 1;
+		}
+		pool.push([tex, i, filename, mip_outname, png, &options]()
+		{
+			guarded(filename, [&]()
+			{
+				XNA::Export::FileSink sink(mip_outname);
+				XNA::Export::write_image(*tex, static_cast<uint32_t>(i), options.image_format, sink, png);
+				sink.close();
+				report_written(filename, mip_outname);
+			});
+		});
+	}
+}
+
+void export_sound(const std::shared_ptr<XNA::Content::Sound>& sound, const std::string& filename, const std::string& outname, const Options& options)
+{
+	XNA::Export::FileSink sink(outname);
+	XNA::Export::write_wav(*sound, sink, options.decode_adpcm);
+	sink.close();
+	report_written(filename, outname);
+}
+
+// reads a float vector element of vertex i; false if the buffer has no such element
+bool read_vertex_element(const XNA::Content::VertexBuffer& vb, const XNA::Content::VertexElement* element, const uint_fast64_t i, float* out, const uint_fast32_t n)
+{
+	if(element == nullptr || XNA::Content::element_size(element->format) != n * sizeof(float))
+	{
+		return false;
+	}
+	std::memcpy(out, vb.get_data() + i * vb.declaration.stride + element->offset, n * sizeof(float));
+	return true;
+}
+
+// Wavefront OBJ of every mesh part, in the space of its parent bone
+void export_model(const std::shared_ptr<XNA::Content::Model>& model, const std::string& filename, const std::string& outname)
+{
+	using XNA::Content::VertexElementUsage;
+	const XNA::Stats::Timer timer(XNA::Stats::Stage::export_);
+
+	std::ofstream out(outname);
+	if(!out)
+	{
+		throw std::string("could not open " + outname);
+	}
+	// enough digits that every float reads back the same
+	out.precision(std::numeric_limits<float>::max_digits10);
+	// v, vt and vn are numbered separately, and a part may have no vt or vn
+	uint_fast64_t positions_written = 0;
+	uint_fast64_t uvs_written = 0;
+	uint_fast64_t normals_written = 0;
+	for(const XNA::Content::ModelMesh& mesh : model->meshes)
+	{
+		out << "o " << (mesh.name.empty() ? "mesh" : mesh.name) << "\n";
+		for(const XNA::Content::ModelMeshPart& part : mesh.parts)
+		{
+			if(part.vertex_buffer == nullptr || part.index_buffer == nullptr)
+			{
+				throw std::string("mesh part has no vertex or index buffer");
+			}
+			const XNA::Content::VertexBuffer& vb = *part.vertex_buffer;
+			const XNA::Content::IndexBuffer& ib = *part.index_buffer;
+			if(static_cast<uint_fast64_t>(part.vertex_offset) + part.vertex_count > vb.vertex_count
+			|| static_cast<uint_fast64_t>(part.start_index) + part.primitive_count * uint_fast64_t(3) > ib.get_index_count())
+			{
+				throw std::string("mesh part is outside its buffers");
+			}
+			const XNA::Content::VertexElement* position = vb.declaration.find_element(VertexElementUsage::Position);
+			const XNA::Content::VertexElement* normal = vb.declaration.find_element(VertexElementUsage::Normal);
+			const XNA::Content::VertexElement* uv = vb.declaration.find_element(VertexElementUsage::TextureCoordinate);
+			const bool has_normals = (normal != nullptr && XNA::Content::element_size(normal->format) == 3 * sizeof(float));
+			const bool has_uvs = (uv != nullptr && XNA::Content::element_size(uv->format) == 2 * sizeof(float));
+			for(uint_fast64_t v = part.vertex_offset; v < static_cast<uint_fast64_t>(part.vertex_offset) + part.vertex_count; ++v)
+			{
+				float f[3];
+				if(!read_vertex_element(vb, position, v, f, 3))
+				{
+					throw std::string("vertex buffer has no Vector3 positions");
+				}
+				out << "v " << f[0] << " " << f[1] << " " << f[2] << "\n";
+				if(has_normals && read_vertex_element(vb, normal, v, f, 3))
+				{
+					out << "vn " << f[0] << " " << f[1] << " " << f[2] << "\n";
+				}
+				if(has_uvs && read_vertex_element(vb, uv, v, f, 2))
+				{
+					// OBJ texture coordinates start at the bottom
+					out << "vt " << f[0] << " " << (1 - f[1]) << "\n";
+				}
+			}
+			XNA::Content::ArrayView<uint16_t> indices16;
+			XNA::Content::ArrayView<uint32_t> indices32;
+			if(ib.sixteen_bits)
+			{
+				indices16 = ib.get_indices16();
+			}
+			else
+			{
+				indices32 = ib.get_indices32();
+			}
+			for(uint_fast64_t t = 0; t < part.primitive_count; ++t)
+			{
+				out << "f";
+				for(uint_fast64_t k = 0; k < 3; ++k)
+				{
+					const uint_fast64_t index_position = part.start_index + t * 3 + k;
+					// indices are relative to vertex_offset
+					const uint_fast64_t index = ib.sixteen_bits ? indices16[index_position] : indices32[index_position];
+					if(index >= part.vertex_count)
+					{
+						throw std::string("index " + std::to_string(index) + " is outside its mesh part");
+					}
+					out << " " << (positions_written + index + 1);
+					if(has_uvs || has_normals)
+					{
+						out << "/" << (has_uvs ? std::to_string(uvs_written + index + 1) : "") << (has_normals ? "/" + std::to_string(normals_written + index + 1) : "");
+					}
+				}
+				out << "\n";
+			}
+			positions_written += part.vertex_count;
+			uvs_written += has_uvs ? part.vertex_count : 0;
+			normals_written += has_normals ? part.vertex_count : 0;
+		}
+	}
+	if(!out)
+	{
+		throw std::string("error writing " + outname);
+	}
+	report_written(filename, outname);
+}
+
+bool has_extension(const std::string& filename, const std::string& extension)
+{
+	if(filename.size() < extension.size())
+	{
+		return false;
+	}
+	std::string tail = filename.substr(filename.size() - extension.size());
+	std::transform(tail.begin(), tail.end(), tail.begin(), ::tolower);
+	return tail == extension;
+}
+
+// entry names come from the file, so keep them from escaping the output directory
+std::string safe_name(std::string name)
+{
+	for(char& c : name)
+	{
+		if(!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_')
+		{
+			c = '_';
+		}
+	}
+	return name;
+}
+
+void convert_wave_bank(const std::string& filename, const std::string& outname, const Options& options, TaskPool& pool)
+{
+	const XNA::XWB::WaveBank bank(filename);
+	const std::string base_outname = (outname != "") ? outname : filename + ".wav";
+	for(std::size_t i = 0; i < bank.entries.size(); ++i)
+	{
+		const std::string& entry_name = bank.entries[i].name;
+		const std::string entry_outname = add_suffix(base_outname, "." + (entry_name.empty() ? std::to_string(i) : safe_name(entry_name)));
+		const std::string entry_filename = filename + "[" + std::to_string(i) + "]";
+
+		// each sound keeps the mapping alive, so the bank itself can go away
+		std::shared_ptr<XNA::Content::Sound> sound;
+		guarded(entry_filename, [&]()
+		{
+			sound = bank.get_sound(i);
+		});
+		if(sound == nullptr)
+		{
+			continue;
+		}
+		pool.push([sound, entry_filename, entry_outname, &options]()
+		{
+			guarded(entry_filename, [&]()
+			{
+				export_sound(sound, entry_filename, entry_outname, options);
+			});
+		});
+	}
+}
+
+void convert_file(const std::string& filename, std::string outname, const Options& options, TaskPool& pool)
+{
+	if(has_extension(filename, ".xwb"))
+	{
+		convert_wave_bank(filename, outname, options, pool);
+		return;
+	}
+
+	std::unique_ptr<BinaryReader> reader;
 	{
-		BinaryReader reader(filename);
-		XNA::XNB::XNB xnb(reader);
-		std::shared_ptr<XNA::Content::ContentBase> content = xnb.objects[0];
+		const XNA::Stats::Timer timer(XNA::Stats::Stage::file_read);
+		reader.reset(new BinaryReader(filename));
+	}
+	XNA::Content::ReadOptions read_options;
+	// sounds are written straight from the XNB body
+	read_options.copy_sound_data = false;
+	read_options.max_total_bytes = options.max_memory;
+	if(options.thumbnail)
+	{
+		// only as much of the body as the primary asset's first mip is decompressed
+		read_options.primary_only = true;
+		read_options.max_mip_count = 1;
+	}
+	XNA::XNB::XNB xnb(*reader, read_options);
+	if(options.stats)
+	{
+		std::lock_guard<std::mutex> lock(output_mutex);
+		std::cerr << filename << ": peak memory " << xnb.peak_memory << " bytes\n";
+	}
+
+	for(std::size_t i = 0; i < xnb.objects.size(); ++i)
+	{
+		std::shared_ptr<XNA::Content::ContentBase> content = xnb.objects[i];
 
 		// TODO: should this check be in the XNB reader?
 		if(content == nullptr)
 		{
-			throw std::string("primary object is null");
+			if(i == 0)
+			{
+				throw std::string("primary object is null");
+			}
+			continue;
 		}
 
 		std::string type_reader_name = content->get_type_reader_name();
 		if(type_reader_name == "Microsoft.Xna.Framework.Content.Texture2DReader")
 		{
 			std::shared_ptr<XNA::Content::Texture2D> tex = std::static_pointer_cast<XNA::Content::Texture2D>(content);
-			if(outname == "")
+			std::string object_outname = (outname != "") ? outname : filename + "." + XNA::Export::to_string(options.image_format);
+			if(i != 0)
 			{
-				outname = filename + ".png";
+				// shared resources get their own images next to the primary asset
+				object_outname = add_suffix(object_outname, ".shared" + std::to_string(i));
 			}
-
-			std::vector<uint8_t> mip = tex->get_mip_data(0);
-			std::pair<uint32_t, uint32_t> mip_size = tex->get_mip_size(0);
-			uint32_t width = mip_size.first;
-			uint32_t height = mip_size.second;
-			write_png_RGBA(outname.c_str(), &mip[0], width, height);
+			export_texture(tex, filename, object_outname, options, pool);
+		}
+		else if(i != 0)
+		{
+			continue;
 		}
 		else if(type_reader_name == "Microsoft.Xna.Framework.Content.SoundEffectReader")
 		{
 			std::shared_ptr<XNA::Content::Sound> sound = std::static_pointer_cast<XNA::Content::Sound>(content);
-			uint_fast64_t sound_data_size = sound->data.size();
-			uint_fast64_t file_size = sound_data_size + 36;
-			if(file_size > UINT32_MAX)
-			{
-				throw std::string("file size is too big (" + std::to_string(file_size) + " > " + std::to_string(UINT32_MAX) + ")");
-			}
+			export_sound(sound, filename, (outname != "") ? outname : filename + ".wav", options);
+		}
+		else if(type_reader_name == "Microsoft.Xna.Framework.Content.SpriteFontReader")
+		{
+			std::shared_ptr<XNA::Content::SpriteFont> font = std::static_pointer_cast<XNA::Content::SpriteFont>(content);
+			export_texture(font->texture, filename, (outname != "") ? outname : filename + "." + XNA::Export::to_string(options.image_format), options, pool);
+		}
+		else if(type_reader_name == "Microsoft.Xna.Framework.Content.ModelReader")
+		{
+			std::shared_ptr<XNA::Content::Model> model = std::static_pointer_cast<XNA::Content::Model>(content);
+			export_model(model, filename, (outname != "") ? outname : filename + ".obj");
+		}
+		else
+		{
+			throw ("unhandled type reader name: " + type_reader_name);
+		}
+	}
+}
 
-			if(outname == "")
-			{
-				outname = filename + ".wav";
-			}
+// guarded by output_mutex
+LzxAnalysis lzx_total;
+
+// prints what the LZX stream of an XNB is made of, instead of converting it
+void analyze_file(const std::string& filename)
+{
+	BinaryReader reader(filename);
+	LzxAnalysis analysis;
+	XNA::XNB::XNB::analyze_lzx(reader, analysis);
+
+	std::lock_guard<std::mutex> lock(output_mutex);
+	std::cout << filename << ":\n";
+	analysis.print(std::cout);
+	lzx_total.merge(analysis);
+}
+
+std::vector<uint8_t> read_file(const std::string& filename)
+{
+	std::ifstream in(filename, std::ios::binary | std::ios::ate);
+	const std::streamoff size = in.tellg();
+	std::vector<uint8_t> data(static_cast<std::size_t>(std::max<std::streamoff>(size, 0)));
+	in.seekg(0);
+	in.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+	if(!in || size < 0)
+	{
+		throw std::string("could not read " + filename);
+	}
+	return data;
+}
+
+// the best of a few runs of reading the body of an XNB held in memory, in seconds
+double time_read_body(const std::vector<uint8_t>& file, XNA::XNB::Body& body)
+{
+	double best = 0;
+	for(uint_fast32_t i = 0; i < 3; ++i)
+	{
+		std::unique_ptr<uint8_t[]> data(new uint8_t[file.size()]);
+		std::copy(file.begin(), file.end(), data.get());
+		BinaryReader reader(std::move(data), file.size());
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		body = XNA::XNB::XNB::read_body(reader);
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		best = (i == 0) ? seconds : std::min(best, seconds);
+	}
+	return best;
+}
+
+struct RecompressTotals
+{
+	uint_fast64_t files = 0;
+	uint_fast64_t bytes_in = 0;
+	uint_fast64_t bytes_out = 0;
+	double seconds_in = 0;
+	double seconds_out = 0;
+};
+
+// guarded by output_mutex
+RecompressTotals recompress_totals;
+
+void print_recompressed(const std::string& name, const uint_fast64_t bytes_in, const uint_fast64_t bytes_out, const double seconds_in, const double seconds_out)
+{
+	const double size_change = (bytes_in == 0) ? 0 : 100.0 * (static_cast<double>(bytes_out) - static_cast<double>(bytes_in)) / static_cast<double>(bytes_in);
+	char line[256];
+	std::snprintf(line, sizeof(line), "%s: %llu -> %llu bytes (%+.1f%%), decode %.3f -> %.3f ms\n", name.c_str(),
+		static_cast<unsigned long long>(bytes_in), static_cast<unsigned long long>(bytes_out), size_change, seconds_in * 1e3, seconds_out * 1e3);
+	std::cout << line;
+}
+
+// writes filename.seek, a seek index for reading the XNB from the middle (see XNA::XNB::SeekIndex)
+void write_seek_index(const std::string& filename, const Options& options)
+{
+	BinaryReader reader(filename);
+	const XNA::XNB::SeekIndex index = XNA::XNB::XNB::build_seek_index(reader, options.seek_index_interval);
+	if(index.checkpoints.empty())
+	{
+		std::lock_guard<std::mutex> lock(output_mutex);
+		std::cout << filename << ": no index needed (not compressed, or no more than " << options.seek_index_interval << " frames)\n";
+		return;
+	}
+	const std::vector<uint8_t> data = XNA::XNB::encode_seek_index(index);
+	const std::string outname = filename + ".seek";
+	std::ofstream out(outname, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+	if(!out)
+	{
+		throw std::string("error writing " + outname);
+	}
+	std::lock_guard<std::mutex> lock(output_mutex);
+	std::cout << filename << ": wrote " << outname << " (" << index.checkpoints.size() << " checkpoints, " << data.size() << " bytes)\n";
+}
+
+// writes part of the body of the XNB to outname, decoding from the nearest checkpoint of filename.seek if there is one
+void write_range(const std::string& filename, std::string outname, const Options& options)
+{
+	std::unique_ptr<XNA::XNB::SeekIndex> index;
+	const std::string index_name = filename + ".seek";
+	if(std::ifstream(index_name, std::ios::binary))
+	{
+		const std::vector<uint8_t> data = read_file(index_name);
+		index.reset(new XNA::XNB::SeekIndex(XNA::XNB::decode_seek_index(data.data(), data.size())));
+	}
+	BinaryReader reader(filename);
+	const std::vector<uint8_t> range = XNA::XNB::XNB::read_range(reader, options.range_offset, options.range_length, index.get());
+
+	if(outname.empty())
+	{
+		outname = filename + ".range";
+	}
+	std::ofstream out(outname, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(range.data()), static_cast<std::streamsize>(range.size()));
+	if(!out)
+	{
+		throw std::string("error writing " + outname);
+	}
+	std::lock_guard<std::mutex> lock(output_mutex);
+	std::cout << filename << ": wrote " << outname << " (" << range.size() << " bytes from " << options.range_offset
+	          << ((index != nullptr) ? ", with " + index_name : std::string()) << ")\n";
+}
 
-			BinaryWriter writer(outname);
-			writer.WriteChars("RIFF");
-			writer.WriteUInt32(static_cast<uint32_t>(file_size));
-			writer.WriteChars("WAVEfmt ");
-			writer.WriteUInt32(16);
-			writer.WriteUInt16(static_cast<uint16_t>(sound->format));
-			writer.WriteUInt16(sound->channel_count);
-			writer.WriteUInt32(sound->sample_rate);
-			writer.WriteUInt32(sound->average_byte_rate);
-			writer.WriteUInt16(sound->block_align);
-			writer.WriteUInt16(sound->bits_per_sample);
-			writer.WriteChars("data");
-			writer.WriteUInt32(static_cast<uint32_t>(sound_data_size));
-			writer.WriteBytes(sound->data);
+// writes the XNB again with other compression, keeping its body byte for byte
+void recompress_file(const std::string& filename, const std::string& outname, const Options& options)
+{
+	const std::vector<uint8_t> original = read_file(filename);
+	XNA::XNB::Body body;
+	const double seconds_in = time_read_body(original, body);
+
+	const std::vector<uint8_t> rewritten = XNA::XNB::encode(body.data.get(), body.size, body.platform, body.profile, options.compression);
+	XNA::XNB::Body check;
+	const double seconds_out = time_read_body(rewritten, check);
+	if(check.size != body.size || !std::equal(body.data.get(), body.data.get() + body.size, check.data.get()))
+	{
+		throw std::string("the rewritten body does not match the original");
+	}
+
+	make_parent_directories(outname);
+	std::ofstream out(outname, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(rewritten.data()), static_cast<std::streamsize>(rewritten.size()));
+	if(!out)
+	{
+		throw std::string("error writing " + outname);
+	}
+
+	std::lock_guard<std::mutex> lock(output_mutex);
+	print_recompressed(filename, original.size(), rewritten.size(), seconds_in, seconds_out);
+	++recompress_totals.files;
+	recompress_totals.bytes_in += original.size();
+	recompress_totals.bytes_out += rewritten.size();
+	recompress_totals.seconds_in += seconds_in;
+	recompress_totals.seconds_out += seconds_out;
+}
+
+// length of the UTF-8 sequence at s[i], or 0 if it is not valid UTF-8
+std::size_t utf8_length(const std::string& s, const std::size_t i)
+{
+	const unsigned char c = static_cast<unsigned char>(s[i]);
+	std::size_t length;
+	uint_fast32_t code_point;
+	if(c < 0x80)
+	{
+		return 1;
+	}
+	else if(c >= 0xC2 && c <= 0xDF)
+	{
+		length = 2;
+		code_point = c & 0x1F;
+	}
+	else if(c >= 0xE0 && c <= 0xEF)
+	{
+		length = 3;
+		code_point = c & 0x0F;
+	}
+	else if(c >= 0xF0 && c <= 0xF4)
+	{
+		length = 4;
+		code_point = c & 0x07;
+	}
+	else
+	{
+		return 0;
+	}
+	if(s.size() - i < length)
+	{
+		return 0;
+	}
+	for(std::size_t k = 1; k < length; ++k)
+	{
+		const unsigned char continuation = static_cast<unsigned char>(s[i + k]);
+		if((continuation & 0xC0) != 0x80)
+		{
+			return 0;
+		}
+		code_point = (code_point << 6) | (continuation & 0x3F);
+	}
+	// overlong forms, surrogates and past U+10FFFF
+	const uint_fast32_t min_code_point[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+	if(code_point < min_code_point[length] || (code_point >= 0xD800 && code_point <= 0xDFFF) || code_point > 0x10FFFF)
+	{
+		return 0;
+	}
+	return length;
+}
+
+// a byte that is not part of valid UTF-8 (as in a file name) is written as a lone surrogate U+DC80-U+DCFF, as Python's surrogateescape does
+std::string json_string(const std::string& s)
+{
+	std::string out = "\"";
+	for(std::size_t i = 0; i < s.size();)
+	{
+		const char c = s[i];
+		const std::size_t length = utf8_length(s, i);
+		char escaped[7];
+		if(length == 0)
+		{
+			std::snprintf(escaped, sizeof(escaped), "\\u%04x", 0xDC00 | static_cast<unsigned char>(c));
+			out += escaped;
+			++i;
+			continue;
+		}
+		if(c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if(static_cast<unsigned char>(c) < 0x20)
+		{
+			std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned int>(c));
+			out += escaped;
 		}
 		else
 		{
-			throw ("unhandled type reader name: " + type_reader_name);
+			out.append(s, i, length);
 		}
-		std::cout << filename << ": wrote " << outname << "\n";
+		i += length;
+	}
+	return out + "\"";
+}
+
+struct ValidateTotals
+{
+	uint_fast64_t files = 0;
+	uint_fast64_t failed = 0;
+	uint_fast64_t bytes = 0;
+};
+
+// guarded by output_mutex
+ValidateTotals validate_totals;
+
+// reads everything in an XNB or wave bank and discards it
+void read_and_discard(const std::string& filename, const Options& options)
+{
+	if(has_extension(filename, ".xwb"))
+	{
+		const XNA::XWB::WaveBank bank(filename);
+		for(std::size_t i = 0; i < bank.entries.size(); ++i)
+		{
+			bank.get_sound(i);
+		}
+		return;
+	}
+	BinaryReader reader(filename);
+	XNA::Content::ReadOptions read_options;
+	// nothing is kept, so nothing needs to be copied
+	read_options.copy_sound_data = false;
+	read_options.view_arrays = true;
+	read_options.max_total_bytes = options.max_memory;
+	const XNA::XNB::XNB xnb(reader, read_options);
+}
+
+/*
+one line of JSON for each file that fails: its name, the stage that failed (container, lzx, lz4, content, memory, io or internal),
+the byte offset of the error if known (into the file, or into the decompressed body for content) and the message
+*/
+void validate_file(const std::string& filename, const Options& options)
+{
+	std::string stage;
+	std::string message;
+	uint_fast64_t position = xna_error::NO_POSITION;
+	uint64_t size = 0;
+	int64_t mtime_ns;
+	try
+	{
+		// what BinaryReader throws for a file it cannot open is not an I/O type, so a missing file is caught here
+		if(!stat_file(filename, size, mtime_ns))
+		{
+			throw std::string("could not stat " + filename);
+		}
+		read_and_discard(filename, options);
+	}
+	catch(const lzx_error& e)
+	{
+		stage = "lzx";
+		message = e.what();
+		position = e.position;
+	}
+	catch(const lz4_error& e)
+	{
+		stage = "lz4";
+		message = e.what();
+		position = e.position;
+	}
+	catch(const content_error& e)
+	{
+		stage = "content";
+		message = e.what();
+		position = e.position;
+	}
+	catch(const memory_error& e)
+	{
+		stage = "memory";
+		message = e.what();
+	}
+	catch(const xna_error& e)
+	{
+		stage = "container";
+		message = e.what();
+		position = e.position;
+	}
+	catch(const std::bad_alloc& e)
+	{
+		stage = "memory";
+		message = e.what();
+	}
+	catch(const std::ios_base::failure& e)
+	{
+		stage = "io";
+		message = e.what();
+	}
+	catch(const std::system_error& e)
+	{
+		stage = "io";
+		message = e.what();
+	}
+	catch(const std::exception& e)
+	{
+		// not thrown for any file on purpose, so a bug rather than a bad file
+		stage = "internal";
+		message = e.what();
 	}
 	catch(const std::string& e)
 	{
-		std::cerr << filename << ": " << e << "\n";
+		stage = "io";
+		message = e;
+	}
+
+	std::lock_guard<std::mutex> lock(output_mutex);
+	++validate_totals.files;
+	validate_totals.bytes += size;
+	if(stage.empty())
+	{
+		return;
+	}
+	++validate_totals.failed;
+	any_failed = true;
+	std::cout << "{\"file\":" << json_string(filename) << ",\"stage\":\"" << stage << "\",\"position\":";
+	if(position == xna_error::NO_POSITION)
+	{
+		std::cout << "null";
+	}
+	else
+	{
+		std::cout << position;
+	}
+	std::cout << ",\"error\":" << json_string(message) << "}\n";
+}
+
+// the library version and every option that changes what a conversion writes
+std::string conversion_key(const Options& options)
+{
+	std::string key = std::string("libxna ") + XNA::VERSION
+		+ " unpremultiply=" + std::to_string(options.unpremultiply)
+		+ " all-mips=" + std::to_string(options.all_mips)
+		+ " thumbnail=" + std::to_string(options.thumbnail)
+		+ " decode-adpcm=" + std::to_string(options.decode_adpcm)
+		+ " format=" + XNA::Export::to_string(options.image_format);
+	// the other formats ignore these, so changing them must not reconvert a tree of qoi files
+	if(options.image_format == XNA::Export::ImageFormat::png)
+	{
+		key += " png-level=" + std::to_string(options.png.compression_level)
+			+ " png-filter=" + std::to_string(static_cast<int>(options.png.filter));
+	}
+	return key;
+}
+
+// state of a --manifest run; guarded by output_mutex
+struct Incremental
+{
+	std::unique_ptr<Manifest> manifest;
+	// the outputs of inputs that are being converted again
+	std::unordered_map<std::string, std::vector<std::string>> previous_outputs;
+	std::unordered_set<std::string> seen;
+	uint_fast64_t unchanged = 0;
+};
+Incremental incremental;
+
+// converts filename unless it is in the manifest with the same size and time, or failing that the same contents
+void convert_if_changed(const std::string& filename, const Options& options, TaskPool& pool)
+{
+	ManifestEntry current;
+	if(!stat_file(filename, current.size, current.mtime_ns))
+	{
+		throw std::string("could not stat " + filename);
+	}
+	ManifestEntry previous;
+	bool known;
+	{
+		std::lock_guard<std::mutex> lock(output_mutex);
+		incremental.seen.insert(filename);
+		const std::unordered_map<std::string, ManifestEntry>::const_iterator i = incremental.manifest->entries.find(filename);
+		known = (i != incremental.manifest->entries.end() && !i->second.stale);
+		if(i != incremental.manifest->entries.end())
+		{
+			previous = i->second;
+		}
+	}
+	if(known && previous.size == current.size && previous.mtime_ns == current.mtime_ns)
+	{
+		std::lock_guard<std::mutex> lock(output_mutex);
+		++incremental.unchanged;
+		return;
+	}
+
+	current.hash = hash_file(filename);
+	{
+		std::lock_guard<std::mutex> lock(output_mutex);
+		if(known && previous.hash == current.hash)
+		{
+			// touched but not changed
+			current.outputs = std::move(previous.outputs);
+			incremental.manifest->entries[filename] = std::move(current);
+			++incremental.unchanged;
+			return;
+		}
+		incremental.previous_outputs[filename] = std::move(previous.outputs);
+		incremental.manifest->entries[filename] = std::move(current);
+	}
+	convert_file(filename, "", options, pool);
+}
+
+void remove_outputs(const std::vector<std::string>& outputs, const std::unordered_set<std::string>& keep)
+{
+	for(const std::string& output : outputs)
+	{
+		if(keep.count(output) == 0 && std::remove(output.c_str()) == 0)
+		{
+			std::cout << "removed " << output << "\n";
+		}
+	}
+}
+
+/*
+after the conversions: records their outputs, removes outputs they no longer write, and forgets inputs that are gone
+(removing their outputs too) or that failed, so they are tried again
+*/
+void update_manifest()
+{
+	Manifest& manifest = *incremental.manifest;
+	for(std::pair<const std::string, std::vector<std::string>>& converted : incremental.previous_outputs)
+	{
+		std::vector<std::string>& outputs = outputs_written[converted.first];
+		remove_outputs(converted.second, std::unordered_set<std::string>(outputs.begin(), outputs.end()));
+		if(inputs_failed.count(converted.first) != 0)
+		{
+			manifest.entries.erase(converted.first);
+			continue;
+		}
+		manifest.entries[converted.first].outputs = std::move(outputs);
+	}
+	uint_fast64_t gone = 0;
+	for(std::unordered_map<std::string, ManifestEntry>::iterator i = manifest.entries.begin(); i != manifest.entries.end();)
+	{
+		uint64_t size;
+		int64_t mtime_ns;
+		if(incremental.seen.count(i->first) != 0 || stat_file(i->first, size, mtime_ns))
+		{
+			++i;
+			continue;
+		}
+		remove_outputs(i->second.outputs, {});
+		i = manifest.entries.erase(i);
+		++gone;
+	}
+	manifest.save();
+	std::cout << "manifest: " << incremental.previous_outputs.size() << " converted, " << incremental.unchanged << " unchanged, " << gone << " removed\n";
+}
+
+// converts a --daemon job on the worker thread that took it, images and all
+DaemonResult convert_job(const DaemonJob& job, const Options& options)
+{
+	DaemonResult result;
+	TaskPool inline_pool;
+	current_job = &result;
+	try
+	{
+		guarded(job.input, [&]()
+		{
+			convert_file(job.input, job.output, options, inline_pool);
+		});
+	}
+	catch(const std::exception& e)
+	{
+		result.errors.push_back(job.input + ": " + e.what());
+	}
+	catch(...)
+	{
+		current_job = nullptr;
+		throw;
+	}
+	current_job = nullptr;
+	return result;
+}
+
+void print_usage(const char* argv0)
+{
+	std::cout << "usage: " << argv0 << " [options] <input file> [output file]\n"
+	          << "       (a .xwb wave bank is written as one file per entry: output.<name or index>.wav)\n"
+	          << "       (a model is written as Wavefront OBJ)\n"
+	          << "       " << argv0 << " [options] --batch <input file>...\n"
+	          << "       " << argv0 << " [options] --analyze-lzx <input file>...\n"
+	          << "       (prints the blocks, Huffman trees and matches of each file's LZX stream, and their total)\n"
+	          << "       " << argv0 << " [options] --recompress=lzx|lz4|none --out-dir=DIR <input file or directory>...\n"
+	          << "       (writes each XNB to DIR with its body unchanged, keeping the layout of input directories)\n"
+	          << "       " << argv0 << " [options] --daemon=SOCKET [--queue=N]\n"
+	          << "       (converts files for clients of a Unix socket, on --jobs threads that stay up between them; a\n"
+	          << "       client sends lines of convert<TAB>input[<TAB>output], stats or shutdown and gets a line back\n"
+	          << "       for each, in order. it may send more before the replies come, and its jobs then run side by\n"
+	          << "       side. at most N jobs wait (default: 4 per thread), and a client with N replies outstanding\n"
+	          << "       or one more job than fits is not read again until there is room.)\n"
+	          << "       " << argv0 << " [options] --seek-index=N <input file or directory>...\n"
+	          << "       (writes name.xnb.seek next to each compressed XNB, with the decoder state every N 32 KiB frames)\n"
+	          << "       " << argv0 << " [options] --read-range=OFFSET:LENGTH <input file> [output file]\n"
+	          << "       (writes LENGTH bytes of the XNB's body from OFFSET, by default to name.xnb.range; a compressed\n"
+	          << "       body is decoded from the nearest checkpoint of name.xnb.seek if there is one)\n"
+	          << "       " << argv0 << " [options] --validate <input file or directory>...\n"
+	          << "       (reads every file in full without writing anything, and prints one JSON object per line\n"
+	          << "       for each failure: {\"file\", \"stage\", \"position\", \"error\"}, then {\"summary\": {...}})\n"
+	          << "       (in batch modes, a directory stands for every .xnb file under it)\n"
+	          << "options:\n"
+	          << "  --unpremultiply        reverse premultiplied alpha of RGBA8888 textures\n"
+	          << "  --format=NAME          write textures as png (the default), qoi, tga, pam or dds; qoi, tga and pam\n"
+	          << "                         are lossless like png and much faster to write, and dds keeps every mip\n"
+	          << "  --all-mips             write every mip level (name.mipN.png)\n"
+	          << "  --thumbnail            write only the primary asset and its first mip, decoding no more than that\n"
+	          << "  --decode-adpcm         write ADPCM sounds as 16-bit PCM\n"
+	          << "  --jobs=N               encode images and convert files on N threads (0: all cores)\n"
+	          << "  --png-level=N          zlib compression level (0-9)\n"
+	          << "  --png-filter=NAME      default, none, sub, up, average, paeth or adaptive\n"
+	          << "  --stats                print time per stage and counters to stderr when done, and the peak memory of each XNB\n"
+	          << "  --max-memory=MB        reject an XNB that would need more memory than this to read\n"
+	          << "  --manifest=FILE        batch conversion that skips inputs unchanged since the run that wrote FILE,\n"
+	          << "                         and removes outputs of inputs that are gone or no longer write them\n";
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> positional;
+	Options options;
+	bool batch = false;
+	try
+	{
+		for(int i = 1; i < argc; ++i)
+		{
+			const std::string arg(argv[i]);
+			const std::string::size_type eq = arg.find('=');
+			const std::string name = arg.substr(0, eq);
+			const std::string value = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+			if(arg == "--unpremultiply")
+			{
+				options.unpremultiply = true;
+			}
+			else if(arg == "--all-mips")
+			{
+				options.all_mips = true;
+			}
+			else if(arg == "--thumbnail")
+			{
+				options.thumbnail = true;
+			}
+			else if(arg == "--decode-adpcm")
+			{
+				options.decode_adpcm = true;
+			}
+			else if(arg == "--batch")
+			{
+				batch = true;
+			}
+			else if(arg == "--analyze-lzx")
+			{
+				options.analyze_lzx = true;
+				batch = true;
+			}
+			else if(name == "--recompress")
+			{
+				if(value == "lzx")
+				{
+					options.compression = XNA::XNB::Compression::lzx;
+				}
+				else if(value == "lz4")
+				{
+					options.compression = XNA::XNB::Compression::lz4;
+				}
+				else if(value == "none")
+				{
+					options.compression = XNA::XNB::Compression::none;
+				}
+				else
+				{
+					throw std::string("unknown compression: " + value);
+				}
+				options.recompress = true;
+				batch = true;
+			}
+			else if(name == "--seek-index")
+			{
+				options.seek_index_interval = static_cast<uint_fast32_t>(std::stoul(value));
+				if(options.seek_index_interval == 0)
+				{
+					throw std::string("--seek-index needs at least 1 frame");
+				}
+				batch = true;
+			}
+			else if(name == "--read-range")
+			{
+				const std::string::size_type colon = value.find(':');
+				if(colon == std::string::npos)
+				{
+					throw std::string("--read-range needs OFFSET:LENGTH");
+				}
+				options.range_offset = std::stoull(value.substr(0, colon));
+				options.range_length = std::stoull(value.substr(colon + 1));
+				options.read_range = true;
+			}
+			else if(arg == "--validate")
+			{
+				options.validate = true;
+				batch = true;
+			}
+			else if(name == "--manifest")
+			{
+				options.manifest = value;
+				batch = true;
+			}
+			else if(name == "--out-dir")
+			{
+				options.out_dir = value;
+			}
+			else if(arg == "--stats")
+			{
+				options.stats = true;
+			}
+			else if(name == "--max-memory")
+			{
+				options.max_memory = std::stoull(value) * 1024 * 1024;
+			}
+			else if(name == "--jobs")
+			{
+				options.jobs = static_cast<unsigned int>(std::stoul(value));
+				if(options.jobs == 0)
+				{
+					options.jobs = std::max(1u, std::thread::hardware_concurrency());
+				}
+			}
+			else if(name == "--daemon")
+			{
+				options.daemon_socket = value;
+			}
+			else if(name == "--queue")
+			{
+				options.queue_capacity = std::stoul(value);
+			}
+			else if(name == "--format")
+			{
+				options.image_format = XNA::Export::image_format_from_string(value);
+			}
+			else if(name == "--png-level")
+			{
+				options.png.compression_level = std::stoi(value);
+				if(options.png.compression_level < 0 || options.png.compression_level > 9)
+				{
+					throw std::string("png level must be 0-9");
+				}
+			}
+			else if(name == "--png-filter")
+			{
+				options.png.filter = XNA::Export::png_filter_from_string(value);
+			}
+			else if(arg.compare(0, 2, "--") == 0)
+			{
+				throw std::string("unknown option: " + arg);
+			}
+			else
+			{
+				positional.push_back(arg);
+			}
+		}
+	}
+	catch(const std::string& e)
+	{
+		std::cerr << e << "\n";
 		return EXIT_FAILURE;
 	}
 	catch(const xna_error& e)
 	{
-		std::cerr << filename << ": " << e.what() << "\n";
+		std::cerr << e.what() << "\n";
 		return EXIT_FAILURE;
 	}
-	catch(const std::bad_alloc& e)
+	catch(const std::logic_error& e)
 	{
-		// caught so that afl-fuzz does not detect it as a crash
-		std::cerr << filename << ": error allocating memory (" << e.what() << ")\n";
+		std::cerr << "invalid option value (" << e.what() << ")\n";
 		return EXIT_FAILURE;
 	}
+	if(!options.daemon_socket.empty())
+	{
+		if(batch || !positional.empty() || options.recompress || options.validate || options.seek_index_interval != 0 || options.read_range || !options.manifest.empty())
+		{
+			std::cerr << "--daemon takes no input files and only works with conversion\n";
+			return EXIT_FAILURE;
+		}
+		XNA::Stats::enable(options.stats);
+		DaemonOptions daemon_options;
+		daemon_options.socket_path = options.daemon_socket;
+		daemon_options.workers = options.jobs;
+		daemon_options.queue_capacity = (options.queue_capacity != 0) ? options.queue_capacity : 4 * options.jobs;
+		try
+		{
+			Daemon daemon(daemon_options, [&options](const DaemonJob& job) { return convert_job(job, options); });
+			daemon.run();
+		}
+		catch(const std::string& e)
+		{
+			std::cerr << e << "\n";
+			return EXIT_FAILURE;
+		}
+		if(options.stats)
+		{
+			XNA::Stats::print(std::cerr, XNA::Stats::snapshot());
+		}
+		return EXIT_SUCCESS;
+	}
+	if(positional.empty() || (!batch && positional.size() > 2))
+	{
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	XNA::Stats::enable(options.stats);
+
+	if(options.recompress && options.out_dir.empty())
+	{
+		std::cerr << "--recompress needs --out-dir\n";
+		return EXIT_FAILURE;
+	}
+
+	std::vector<std::pair<std::string, std::string>> files;
+	if(batch)
+	{
+		// only --recompress names its outputs; the others derive them from the input
+		auto outname = [&options](const std::string& relative_path)
+		{
+			return options.recompress ? options.out_dir + "/" + relative_path : "";
+		};
+		for(const std::string& filename : positional)
+		{
+			if(is_directory(filename))
+			{
+				try
+				{
+					for(const TreeFile& file : list_files(filename, ".xnb"))
+					{
+						files.emplace_back(file.path, outname(file.relative_path));
+					}
+				}
+				catch(const std::string& e)
+				{
+					std::cerr << e << "\n";
+					return EXIT_FAILURE;
+				}
+				continue;
+			}
+			const std::string::size_type slash = filename.rfind('/');
+			files.emplace_back(filename, outname((slash == std::string::npos) ? filename : filename.substr(slash + 1)));
+		}
+	}
+	else
+	{
+		files.emplace_back(positional[0], positional.size() > 1 ? positional[1] : "");
+	}
+
+	// every image is a task on the --jobs pool already; only a lone file's image gets threads of its own as well
+	if(files.size() == 1)
+	{
+		options.png.threads = options.jobs;
+	}
 
-	return EXIT_SUCCESS;
-}
\ No newline at end of file
+	if(!options.manifest.empty())
+	{
+		if(options.analyze_lzx || options.recompress || options.validate || options.seek_index_interval != 0 || options.read_range)
+		{
+			std::cerr << "--manifest only works with conversion\n";
+			return EXIT_FAILURE;
+		}
+		incremental.manifest.reset(new Manifest(options.manifest, conversion_key(options)));
+	}
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	{
+		TaskPool pool(options.jobs);
+		for(const std::pair<std::string, std::string>& file : files)
+		{
+			pool.push([file, &options, &pool]()
+			{
+				guarded(file.first, [&]()
+				{
+					if(options.analyze_lzx)
+					{
+						analyze_file(file.first);
+					}
+					else if(options.validate)
+					{
+						validate_file(file.first, options);
+					}
+					else if(options.recompress)
+					{
+						recompress_file(file.first, file.second, options);
+					}
+					else if(options.read_range)
+					{
+						write_range(file.first, file.second, options);
+					}
+					else if(options.seek_index_interval != 0)
+					{
+						write_seek_index(file.first, options);
+					}
+					else if(incremental.manifest != nullptr)
+					{
+						convert_if_changed(file.first, options, pool);
+					}
+					else
+					{
+						convert_file(file.first, file.second, options, pool);
+					}
+				});
+			});
+		}
+		pool.wait();
+	}
+	if(options.analyze_lzx && files.size() > 1)
+	{
+		std::cout << "total:\n";
+		lzx_total.print(std::cout);
+	}
+	if(options.validate)
+	{
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "{\"summary\":{\"files\":" << validate_totals.files << ",\"failed\":" << validate_totals.failed
+		          << ",\"bytes\":" << validate_totals.bytes << ",\"seconds\":" << seconds << "}}\n";
+	}
+	if(incremental.manifest != nullptr)
+	{
+		try
+		{
+			update_manifest();
+		}
+		catch(const std::string& e)
+		{
+			std::cerr << e << "\n";
+			return EXIT_FAILURE;
+		}
+	}
+	if(options.recompress && recompress_totals.files > 1)
+	{
+		print_recompressed("total (" + std::to_string(recompress_totals.files) + " files)", recompress_totals.bytes_in, recompress_totals.bytes_out, recompress_totals.seconds_in, recompress_totals.seconds_out);
+	}
+	if(options.stats)
+	{
+		XNA::Stats::print(std::cerr, XNA::Stats::snapshot());
+	}
+
+	return any_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}